@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "batch.h"
+#include "rom.h"
+
+namespace Emu8080 {
+	namespace {
+		// A started job and the CPU running it
+		class batchTask {
+		public:
+			batchJob *job;
+			state s;
+			scheduler q;
+		};
+
+		// Queue of started jobs, the owner takes from the front and thieves from the back
+		class worker {
+		public:
+			std::mutex lock;
+			std::deque<std::unique_ptr<batchTask>> tasks;
+			uint64_t cycles = 0;
+			uint64_t instructions = 0;
+			uint64_t steals = 0;
+		};
+
+		class pool {
+		public:
+			std::vector<batchJob> &jobs;
+			std::vector<worker> workers;
+			std::atomic<size_t> next; // First job not started yet
+			std::atomic<size_t> remaining; // Jobs not finished yet
+
+			pool(std::vector<batchJob> &jobs, unsigned threads) : jobs(jobs), workers(threads), next(0), remaining(jobs.size()) {}
+
+			// Load the next job, null if every job has started or it failed to load
+			std::unique_ptr<batchTask> start() {
+				size_t i = next.fetch_add(1);
+				if (i >= jobs.size()) {
+					return nullptr;
+				}
+				std::unique_ptr<batchTask> task(new batchTask());
+				task->job = &jobs[i];
+				batchJob &job = jobs[i];
+				job.loaded = job.setup != nullptr ? job.setup(&task->s, &task->q, job) : loadImage(&task->s, job.path, job.address);
+				if (!job.loaded) {
+					remaining--;
+					return nullptr;
+				}
+				return task;
+			}
+
+			// Take a started job from the back of another worker's queue
+			std::unique_ptr<batchTask> steal(size_t self) {
+				for (size_t i = 1; i < workers.size(); i++) {
+					worker &victim = workers[(self + i) % workers.size()];
+					std::lock_guard<std::mutex> guard(victim.lock);
+					if (!victim.tasks.empty()) {
+						std::unique_ptr<batchTask> task = std::move(victim.tasks.back());
+						victim.tasks.pop_back();
+						return task;
+					}
+				}
+				return nullptr;
+			}
+
+			// Run one slice of a job, returns true once the job is finished
+			bool slice(worker &w, batchTask *task) {
+				batchJob &job = *task->job;
+				runResult result = runScheduled(&task->s, &task->q, std::min(job.cycles - job.ran, BATCH_SLICE));
+				job.ran += result.cycles;
+				job.instructions += result.instructions;
+				job.reason = result.reason;
+				job.pc = task->s.r.pc;
+				w.cycles += result.cycles;
+				w.instructions += result.instructions;
+				if (result.reason == STOP_IO) {
+					if (result.input) {
+						task->s.r.a = 0;
+					}
+				} else if (result.reason != STOP_BUDGET) {
+					return true;
+				}
+				return job.ran >= job.cycles;
+			}
+
+			void work(size_t self) {
+				worker &w = workers[self];
+				while (remaining > 0) {
+					std::unique_ptr<batchTask> task;
+					size_t inFlight;
+					{
+						std::lock_guard<std::mutex> guard(w.lock);
+						inFlight = w.tasks.size();
+					}
+					// Admit new jobs first so they get their first slice early
+					if (inFlight < BATCH_IN_FLIGHT && next < jobs.size()) {
+						task = start();
+					}
+					if (task == nullptr) {
+						std::lock_guard<std::mutex> guard(w.lock);
+						if (!w.tasks.empty()) {
+							task = std::move(w.tasks.front());
+							w.tasks.pop_front();
+						}
+					}
+					if (task == nullptr && next >= jobs.size()) {
+						task = steal(self);
+						if (task != nullptr) {
+							w.steals++;
+						}
+					}
+					if (task == nullptr) {
+						std::this_thread::yield();
+						continue;
+					}
+					if (slice(w, task.get())) {
+						remaining--;
+					} else {
+						std::lock_guard<std::mutex> guard(w.lock);
+						w.tasks.push_back(std::move(task));
+					}
+				}
+			}
+		};
+	}
+
+	batchStats runBatch(std::vector<batchJob> &jobs, unsigned threads) {
+		batchStats stats;
+		if (threads == 0) {
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		stats.threads = threads;
+		pool p(jobs, threads);
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> running;
+		for (unsigned i = 1; i < threads; i++) {
+			running.emplace_back(&pool::work, &p, i);
+		}
+		p.work(0);
+		for (std::thread &t : running) {
+			t.join();
+		}
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		stats.seconds = time.count();
+		for (worker &w : p.workers) {
+			stats.cycles += w.cycles;
+			stats.instructions += w.instructions;
+			stats.steals += w.steals;
+		}
+		return stats;
+	}
+}
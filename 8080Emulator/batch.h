@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cpu.h"
+#include "emulator.h"
+#include "scheduler.h"
+
+namespace Emu8080 {
+	class batchJob;
+
+	// Loads a job's CPU and schedules its events, returns false if the job can't start
+	// Called on a worker thread when the job first runs
+	typedef bool (*jobSetup)(state *s, scheduler *q, const batchJob &job);
+
+	// One guest program in a batch
+	class batchJob {
+	public:
+		std::string path; // ROM, or whatever setup understands
+		uint16_t address = 0; // Where the ROM is loaded when there is no setup
+		uint64_t cycles = 0; // Guest cycles the job runs for unless it stops first
+		jobSetup setup = nullptr; // Null loads path at address with no events
+		void *context = nullptr; // For setup
+		// Filled in by runBatch
+		bool loaded = false;
+		stopReason reason = STOP_BUDGET;
+		uint64_t ran = 0; // Cycles
+		uint64_t instructions = 0;
+		uint16_t pc = 0; // Where the job stopped
+	};
+
+	class batchStats {
+	public:
+		unsigned threads = 0;
+		uint64_t cycles = 0;
+		uint64_t instructions = 0;
+		uint64_t steals = 0; // Jobs taken from another worker's queue
+		double seconds = 0;
+		// Aggregate guest MIPS over every thread
+		double mips() const {
+			return seconds > 0 ? instructions / seconds / 1e6 : 0;
+		}
+	};
+
+	// Cycles a job runs before it goes to the back of its worker's queue
+	constexpr uint64_t BATCH_SLICE = 1000000;
+	// Jobs each worker keeps in flight, each holds a whole CPU
+	constexpr size_t BATCH_IN_FLIGHT = 64;
+
+	// Run every job to completion on a work stealing pool of threads, 0 uses every core
+	// Jobs are time sliced by BATCH_SLICE cycles, so long jobs don't hold up short ones
+	// IN reads 0 and OUT is ignored
+	batchStats runBatch(std::vector<batchJob> &jobs, unsigned threads = 0);
+}
@@ -0,0 +1,337 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include "bench.h"
+#include "cpm.h"
+#include "decode.h"
+#include "emulator.h"
+#include "jit.h"
+#include "scheduler.h"
+
+namespace Emu8080 {
+	// Cycles the reference runs between checks of its instruction limit
+	constexpr uint64_t BENCH_SLICE = 1000000;
+
+	// ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP, INR, DCR, rotates, immediates and DAD in a loop
+	static const uint8_t ALU_MIX[] = {
+		0x80, 0x89, 0x92, 0x9B, 0xA4, 0xAD, 0xB0, 0xB9, // ADD B, ADC C, SUB D, SBB E, ANA H, XRA L, ORA B, CMP C
+		0x04, 0x0D, 0x14, 0x07, // INR B, DCR C, INR D, RLC
+		0xC6, 0x35, 0xEE, 0x5A, // ADI 35, XRI 5A
+		0x1F, 0x2F, 0x09, // RAR, CMA, DAD B
+		0xC3, 0x00, 0x00 // JMP 0
+	};
+
+	// Loads and stores through HL, BC, direct addresses and the stack, walking 0x2000-0x3FFF
+	static const uint8_t MEMORY_MIX[] = {
+		0x21, 0x00, 0x20, // LXI H, 2000
+		0x01, 0x00, 0x30, // LXI B, 3000
+		0x7E, 0x02, 0x34, 0x0A, 0x77, // MOV A, M; STAX B; INR M; LDAX B; MOV M, A
+		0x32, 0x00, 0x38, 0x3A, 0x01, 0x38, // STA 3800, LDA 3801
+		0xE5, 0xC5, 0xC1, 0xE1, // PUSH H, PUSH B, POP B, POP H
+		0x23, 0x03, // INX H, INX B
+		0x7C, 0xE6, 0x0F, 0xF6, 0x20, 0x67, // H = H & 0F | 20
+		0x78, 0xE6, 0x07, 0xF6, 0x30, 0x47, // B = B & 07 | 30
+		0xC3, 0x06, 0x00 // JMP 6
+	};
+
+	// Counted loops around a call whose return depends on the low bit of A
+	static const uint8_t BRANCH_MIX[] = {
+		0x31, 0x00, 0xF0, // LXI SP, F000
+		0x06, 0x10, // 03: MVI B, 10
+		0xCD, 0x13, 0x00, // 05: CALL 13
+		0x05, // DCR B
+		0xC2, 0x05, 0x00, // JNZ 5
+		0x37, // STC
+		0xDA, 0x03, 0x00, // JC 3
+		0xC3, 0x00, 0x00, // JMP 0
+		0x3C, 0xE6, 0x01, // 13: INR A, ANI 1
+		0xCA, 0x1B, 0x00, // JZ 1B
+		0x0C, 0xC9, // INR C, RET
+		0x0D, 0xC8, 0xC9 // 1B: DCR C, RZ, RET
+	};
+
+	std::vector<benchWorkload> syntheticWorkloads(uint64_t instructions) {
+		std::vector<benchWorkload> workloads(3);
+		workloads[0].name = "alu";
+		workloads[0].program.assign(ALU_MIX, ALU_MIX + sizeof(ALU_MIX));
+		workloads[1].name = "memory";
+		workloads[1].program.assign(MEMORY_MIX, MEMORY_MIX + sizeof(MEMORY_MIX));
+		workloads[2].name = "branch";
+		workloads[2].program.assign(BRANCH_MIX, BRANCH_MIX + sizeof(BRANCH_MIX));
+		for (benchWorkload &w : workloads) {
+			w.instructions = instructions;
+		}
+		return workloads;
+	}
+
+	namespace {
+		// A CPU set up for a workload, with the devices it needs
+		class benchMachine {
+		public:
+			state s;
+			scheduler q;
+			portBus bus;
+			cpmConsole console;
+
+			bool load(const benchWorkload &w) {
+				bool loaded = true;
+				switch (w.kind) {
+				case WORKLOAD_PROGRAM:
+					std::memcpy(s.memory.data(), w.program.data(), w.program.size());
+					break;
+				case WORKLOAD_CPM:
+					console.attach(&bus);
+					s.ports = &bus;
+					loaded = loadCpm(&s, w.job.path);
+					break;
+				case WORKLOAD_SCHEDULED:
+					loaded = w.job.setup(&s, &q, w.job);
+					break;
+				}
+				if (loaded && w.patch != nullptr) {
+					w.patch(&s);
+				}
+				return loaded;
+			}
+		};
+
+		const char *stopName(state *s, stopReason reason) {
+			switch (reason) {
+			case STOP_HALT:
+				return s->r.pc == CPM_WARM_BOOT ? "warm boot" : "halt";
+			case STOP_BREAKPOINT:
+				return "breakpoint";
+			case STOP_UNIMPLEMENTED:
+				return "unimplemented instruction";
+			case STOP_IO:
+				return "I/O";
+			default:
+				return "";
+			}
+		}
+
+		// Run a workload with events for its cycles on runScheduled, IN from ports nobody handles reads 0
+		void runScheduledWorkload(benchMachine *m, const benchWorkload &w, benchResult &r) {
+			while (m->q.now < w.job.cycles) {
+				runResult slice = runScheduled(&m->s, &m->q, w.job.cycles - m->q.now);
+				r.instructions += slice.instructions;
+				if (slice.reason == STOP_IO) {
+					if (slice.input) {
+						m->s.r.a = 0;
+					}
+				} else if (slice.reason != STOP_BUDGET) {
+					r.stop = stopName(&m->s, slice.reason);
+					r.truncated = true;
+					break;
+				}
+			}
+			r.cycles = m->q.now;
+		}
+	}
+
+	std::vector<benchResult> runWorkload(const benchWorkload &w) {
+		std::vector<benchResult> results;
+		// Each engine's peak resident set is measured from its own start, with what the rows before left resident
+		bool peaks = resetPeakRss();
+		// Reference
+		std::unique_ptr<benchMachine> ref(new benchMachine);
+		if (!ref->load(w)) {
+			return results;
+		}
+		benchResult r;
+		r.workload = w.name;
+		r.engine = ENGINE_RUN;
+		auto start = std::chrono::steady_clock::now();
+		if (w.kind == WORKLOAD_SCHEDULED) {
+			runScheduledWorkload(ref.get(), w, r);
+		} else {
+			// A CP/M program that hits the limit before warm booting is cut short too
+			r.truncated = w.kind == WORKLOAD_CPM;
+			while (r.instructions < w.instructions) {
+				runResult slice = run(&ref->s, BENCH_SLICE);
+				r.instructions += slice.instructions;
+				r.cycles += slice.cycles;
+				if (slice.reason != STOP_BUDGET) {
+					r.stop = stopName(&ref->s, slice.reason);
+					r.truncated = !(w.kind == WORKLOAD_CPM && slice.reason == STOP_HALT && ref->s.r.pc == CPM_WARM_BOOT);
+					break;
+				}
+			}
+		}
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		r.seconds = time.count();
+		r.peakRss = peaks ? peakRss() : 0;
+		results.push_back(r);
+		if (w.kind == WORKLOAD_SCHEDULED) {
+			// Only runScheduled keeps time for the events, the tiered engine runs under it through runJit
+			// and must take every interrupt on the same instruction to end up the same
+			peaks = resetPeakRss();
+			std::unique_ptr<benchMachine> m(new benchMachine);
+			m->load(w);
+			jitCache jit(&m->s);
+			m->q.jit = &jit;
+			benchResult e;
+			e.workload = w.name;
+			e.engine = ENGINE_JIT;
+			start = std::chrono::steady_clock::now();
+			runScheduledWorkload(m.get(), w, e);
+			time = std::chrono::steady_clock::now() - start;
+			e.seconds = time.count();
+			e.peakRss = peaks ? peakRss() : 0;
+			e.match = sameState(&ref->s, &m->s) && e.cycles == r.cycles && e.instructions == r.instructions;
+			results.push_back(e);
+			return results;
+		}
+
+		// The other engines run as many instructions as the reference did
+		const benchEngine engines[] = { ENGINE_SWITCH, ENGINE_THREADED, ENGINE_DECODED, ENGINE_JIT };
+		for (benchEngine engine : engines) {
+			peaks = resetPeakRss();
+			std::unique_ptr<benchMachine> m(new benchMachine);
+			m->load(w);
+			std::unique_ptr<decodeCache> decoder;
+			std::unique_ptr<jitCache> jit;
+			if (engine == ENGINE_DECODED) {
+				decoder.reset(new decodeCache);
+			} else if (engine == ENGINE_JIT) {
+				jit.reset(new jitCache(&m->s));
+			}
+			uint64_t cycles = r.cycles;
+			start = std::chrono::steady_clock::now();
+			switch (engine) {
+			case ENGINE_SWITCH:
+				for (uint64_t i = 0; i < r.instructions; i++) {
+					emulate8080(&m->s);
+				}
+				break;
+			case ENGINE_THREADED:
+				emulateThreaded(&m->s, r.instructions);
+				break;
+			case ENGINE_DECODED:
+				cycles = emulateDecoded(&m->s, decoder.get(), r.instructions);
+				break;
+			case ENGINE_JIT:
+				emulateJit(&m->s, jit.get(), r.instructions);
+				break;
+			default:
+				break;
+			}
+			time = std::chrono::steady_clock::now() - start;
+			benchResult e = r;
+			e.engine = engine;
+			e.seconds = time.count();
+			e.peakRss = peaks ? peakRss() : 0;
+			e.cycles = cycles;
+			e.match = sameState(&ref->s, &m->s) && ref->console.output == m->console.output && cycles == r.cycles;
+			results.push_back(e);
+		}
+		return results;
+	}
+
+	const char *engineName(benchEngine engine) {
+		const char *names[] = { "switch", "threaded", "decoded", "jit", "run" };
+		return names[engine];
+	}
+
+	std::string buildConfig() {
+		std::string config;
+#ifdef EMU8080_LAZY_FLAGS
+		config += "lazy-flags";
+#else
+		config += "eager-flags";
+#endif
+#ifdef EMU8080_THREADED
+		config += " threaded-execute";
+#endif
+#ifdef EMU8080_JIT_X64
+		config += " jit-x64";
+#else
+		config += " no-jit";
+#endif
+#ifdef NDEBUG
+		config += " release";
+#else
+		config += " debug";
+#endif
+		return config;
+	}
+
+	// Linux keeps the peak in VmHWM and lets clear_refs set it back to the current resident set,
+	// elsewhere the peak only ever grows, so it can't be told apart per engine
+	bool resetPeakRss() {
+#ifdef __linux__
+		std::ofstream clear("/proc/self/clear_refs");
+		clear << "5";
+		clear.close();
+		return !clear.fail();
+#else
+		return false;
+#endif
+	}
+
+	uint64_t peakRss() {
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line)) {
+			if (line.compare(0, 6, "VmHWM:") == 0) {
+				return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024; // Kilobytes
+			}
+		}
+		return 0;
+	}
+
+	void writeTable(std::ostream &out, const std::vector<benchResult> &results) {
+		out << "build: " << buildConfig() << "\n";
+		std::string workload;
+		for (const benchResult &r : results) {
+			if (r.workload != workload) {
+				workload = r.workload;
+				out << workload << ", " << r.instructions << " instructions";
+				if (!r.stop.empty()) {
+					out << ", stopped on " << r.stop;
+				}
+				if (r.truncated) {
+					out << ", TRUNCATED";
+				}
+				out << "\n";
+			}
+			out << "  " << engineName(r.engine) << ": " << r.mips() << " MIPS, "
+				<< r.nsPerInstruction() << " ns/instruction, " << r.speed() << "x 2 MHz, ";
+			if (r.peakRss > 0) {
+				out << r.peakRss / 1024 << " KB peak, ";
+			}
+			out << "state " << (r.match ? "match" : "MISMATCH") << "\n";
+		}
+	}
+
+	void writeCsv(std::ostream &out, const std::vector<benchResult> &results) {
+		out << "workload,engine,config,instructions,cycles,seconds,mips,ns_per_instruction,speed_vs_2mhz,peak_rss,match,stop,truncated\n";
+		std::string config = buildConfig();
+		for (const benchResult &r : results) {
+			out << r.workload << "," << engineName(r.engine) << "," << config << ","
+				<< r.instructions << "," << r.cycles << "," << r.seconds << ","
+				<< r.mips() << "," << r.nsPerInstruction() << "," << r.speed() << ","
+				<< r.peakRss << "," << (r.match ? 1 : 0) << "," << r.stop << "," << (r.truncated ? 1 : 0) << "\n";
+		}
+	}
+
+	void writeJson(std::ostream &out, const std::vector<benchResult> &results) {
+		std::string config = buildConfig();
+		out << "[\n";
+		for (size_t i = 0; i < results.size(); i++) {
+			const benchResult &r = results[i];
+			out << "  {\"workload\": \"" << r.workload << "\", \"engine\": \"" << engineName(r.engine)
+				<< "\", \"config\": \"" << config << "\", \"instructions\": " << r.instructions
+				<< ", \"cycles\": " << r.cycles << ", \"seconds\": " << r.seconds
+				<< ", \"mips\": " << r.mips() << ", \"ns_per_instruction\": " << r.nsPerInstruction()
+				<< ", \"speed_vs_2mhz\": " << r.speed() << ", \"peak_rss\": " << r.peakRss
+				<< ", \"match\": " << (r.match ? "true" : "false") << ", \"stop\": \"" << r.stop
+				<< "\", \"truncated\": " << (r.truncated ? "true" : "false") << "}"
+				<< (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "]\n";
+	}
+}
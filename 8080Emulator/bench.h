@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "cpu.h"
+
+namespace Emu8080 {
+	// Benchmark suite, fixed workloads timed on every engine that can run them
+	// Each workload is run once on run() as the reference, then every other engine runs exactly
+	// as many instructions from the same start and must end in the same state
+	// Workloads with events run for their cycles instead, on runScheduled and again on it through the JIT
+
+	// Space Invaders and the 8080 it emulates ran at 2 MHz
+	constexpr double BENCH_REAL_HZ = 2000000;
+
+	enum benchEngine {
+		ENGINE_SWITCH, // emulate8080
+		ENGINE_THREADED, // emulateThreaded
+		ENGINE_DECODED, // emulateDecoded
+		ENGINE_JIT, // emulateJit, or runJit under runScheduled for workloads with events
+		ENGINE_RUN // run, or runScheduled for workloads with events
+	};
+
+	enum workloadKind {
+		WORKLOAD_PROGRAM, // program loaded at 0
+		WORKLOAD_CPM, // job.path run as a CP/M program until it warm boots
+		WORKLOAD_SCHEDULED // job.setup loads it and schedules its events, only runScheduled keeps time for them
+	};
+
+	class benchWorkload {
+	public:
+		std::string name;
+		workloadKind kind = WORKLOAD_PROGRAM;
+		std::vector<uint8_t> program;
+		batchJob job; // path for CP/M programs, path, setup and cycles for scheduled ones
+		void (*patch)(state *s) = nullptr; // Applied to memory after loading, if set
+		uint64_t instructions = 0; // Most instructions to run, scheduled workloads run job.cycles instead
+	};
+
+	class benchResult {
+	public:
+		std::string workload;
+		benchEngine engine = ENGINE_RUN;
+		uint64_t instructions = 0;
+		uint64_t cycles = 0; // Guest cycles, from the reference run for engines that don't count them
+		double seconds = 0;
+		uint64_t peakRss = 0; // Peak resident set of the process while this engine ran in bytes, 0 if unknown
+		bool match = true; // Ended in the same state as the reference, and the same cycles if counted
+		std::string stop; // Why the reference stopped before its limit, empty if it didn't
+		// The reference stopped before the workload's end, a warm boot for CP/M programs and the
+		// limit for the rest, so every engine timed only part of it
+		bool truncated = false;
+
+		double mips() const {
+			return seconds > 0 ? instructions / seconds / 1e6 : 0;
+		}
+		double nsPerInstruction() const {
+			return instructions > 0 ? seconds * 1e9 / instructions : 0;
+		}
+		// Guest cycles per second as a multiple of a real 8080
+		double speed() const {
+			return seconds > 0 ? cycles / seconds / BENCH_REAL_HZ : 0;
+		}
+	};
+
+	// Synthetic ALU, memory and branch heavy loops that never stop
+	std::vector<benchWorkload> syntheticWorkloads(uint64_t instructions);
+	// Time a workload on every engine that can run it
+	std::vector<benchResult> runWorkload(const benchWorkload &w);
+
+	// Name of an engine as printed
+	const char *engineName(benchEngine engine);
+	// Build options the engines were compiled with
+	std::string buildConfig();
+	// Start the peak resident set over from the current one, returns false if the platform can't
+	bool resetPeakRss();
+	// Peak resident set of the process since the last resetPeakRss in bytes, 0 if the platform doesn't say
+	uint64_t peakRss();
+
+	// Results as a table, CSV with a header row, or a JSON array
+	void writeTable(std::ostream &out, const std::vector<benchResult> &results);
+	void writeCsv(std::ostream &out, const std::vector<benchResult> &results);
+	void writeJson(std::ostream &out, const std::vector<benchResult> &results);
+}
@@ -0,0 +1,99 @@
+#include <cstring>
+#include "bus.h"
+
+namespace Emu8080 {
+	// Attributes set by the memory map, the rest track code
+	constexpr uint8_t PAGE_MAPPING = PAGE_ROM | PAGE_HANDLER | PAGE_MIRROR;
+
+	// Store a byte to memory, keeping the wrap mirror and code tracking up to date
+	static void storeDirect(state *s, uint16_t address, uint8_t value) {
+		s->memory[address] = value;
+		if (address < 2) {
+			s->memory[0x10000 + address] = value;
+		}
+		pageWritten(s, address >> 8);
+	}
+
+	void pageWritten(state *s, uint8_t page) {
+		if (s->pageFlags[page] & PAGE_CODE) {
+			s->dirtyPages[page] = 1;
+			s->codeDirty = 1;
+		}
+		if (s->pageFlags[page] & PAGE_SHARED) {
+			s->pageFlags[page] &= ~PAGE_SHARED;
+			s->sharedPages[page].reset();
+		}
+		if (s->pageFlags[page] & PAGE_WATCH) {
+			s->pageFlags[page] &= ~PAGE_WATCH;
+			s->writtenPages[page] = 1;
+		}
+	}
+
+	void busWrite(state *s, uint16_t address, uint8_t value) {
+		uint8_t page = address >> 8;
+		uint8_t flags = s->pageFlags[page];
+		if (flags & PAGE_ROM) {
+			return;
+		}
+		if (flags & PAGE_HANDLER) {
+			s->writers[page](s, address, value, s->writerContexts[page]);
+			// The handler may have written memory
+			pageWritten(s, page);
+			return;
+		}
+		storeDirect(s, address, value);
+		if (flags & PAGE_MIRROR) {
+			storeDirect(s, (s->mirrors[page] << 8) | (address & 0xFF), value);
+		}
+	}
+
+	// Set the mapping attributes of every page in a range
+	static void mapPages(state *s, uint16_t start, uint32_t size, uint8_t flags) {
+		if (size == 0) {
+			return;
+		}
+		s->sharedMap.reset();
+		uint32_t last = (start + size - 1) >> 8;
+		for (uint32_t page = start >> 8; page <= last && page < 256; page++) {
+			s->pageFlags[page] = (s->pageFlags[page] & ~PAGE_MAPPING) | flags;
+			s->writers[page] = nullptr;
+			s->writerContexts[page] = nullptr;
+		}
+	}
+
+	void mapRam(state *s, uint16_t start, uint32_t size) {
+		mapPages(s, start, size, 0);
+	}
+
+	void mapRom(state *s, uint16_t start, uint32_t size) {
+		mapPages(s, start, size, PAGE_ROM);
+	}
+
+	void mapHandler(state *s, uint16_t start, uint32_t size, pageWriter writer, void *context) {
+		mapPages(s, start, size, PAGE_HANDLER);
+		if (size == 0) {
+			return;
+		}
+		uint32_t last = (start + size - 1) >> 8;
+		for (uint32_t page = start >> 8; page <= last && page < 256; page++) {
+			s->writers[page] = writer;
+			s->writerContexts[page] = context;
+		}
+	}
+
+	void mapMirror(state *s, uint16_t start, uint32_t size, uint16_t mirror) {
+		mapPages(s, start, size, PAGE_MIRROR);
+		mapPages(s, mirror, size, PAGE_MIRROR);
+		uint32_t pages = (size + 0xFF) >> 8;
+		for (uint32_t i = 0; i < pages && (start >> 8) + i < 256 && (mirror >> 8) + i < 256; i++) {
+			uint8_t from = (uint8_t)((start >> 8) + i);
+			uint8_t to = (uint8_t)((mirror >> 8) + i);
+			s->mirrors[from] = to;
+			s->mirrors[to] = from;
+			std::memcpy(&s->memory[to << 8], &s->memory[from << 8], 0x100);
+			pageWritten(s, to);
+		}
+		s->memory[0x10000] = s->memory[0];
+		s->memory[0x10001] = s->memory[1];
+	}
+}
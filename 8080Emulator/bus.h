@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include "cpu.h"
+
+namespace Emu8080 {
+	// Note a page's memory was written without going through the bus,
+	// marks any code decoded from it dirty, ends its snapshot sharing and tells its watcher
+	void pageWritten(state *s, uint8_t page);
+
+	// Memory map, ranges are rounded out to whole 256 byte pages
+	// Pages start out as RAM, mapping a range replaces whatever was mapped there
+
+	// Plain RAM, stores take the fast path unless the page holds code
+	void mapRam(state *s, uint16_t start, uint32_t size);
+	// Write protected, stores are dropped
+	void mapRom(state *s, uint16_t start, uint32_t size);
+	// Stores call writer with context
+	void mapHandler(state *s, uint16_t start, uint32_t size, pageWriter writer, void *context);
+	// [start, start + size) and [mirror, mirror + size) hold the same bytes, stores to either land in both
+	// The current contents of the first range are copied to the second
+	void mapMirror(state *s, uint16_t start, uint32_t size, uint16_t mirror);
+}
@@ -0,0 +1,130 @@
+#include "coroutine.h"
+
+namespace Emu8080 {
+	guestTask &guestTask::operator=(guestTask &&other) noexcept {
+		std::swap(handle, other.handle);
+		return *this;
+	}
+
+	guestTask::~guestTask() {
+		if (handle) {
+			handle.destroy();
+		}
+	}
+
+	namespace {
+		// Suspends the guest on wait, resuming gives the answer to an IN
+		class guestAwait {
+		public:
+			guest *g;
+			guestWait wait;
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+			void await_suspend(std::coroutine_handle<>) const noexcept {
+				g->wait = wait;
+			}
+			uint8_t await_resume() const noexcept {
+				return g->value;
+			}
+		};
+	}
+
+	guestTask guestLoop::execute(guestLoop *loop, guest *g) {
+		state *s = g->s;
+		for (;;) {
+			runResult result = run(s, loop->slice);
+			g->cycles += result.cycles;
+			g->instructions += result.instructions;
+			switch (result.reason) {
+			case STOP_BUDGET:
+				co_await guestAwait{ g, WAIT_READY };
+				break;
+			case STOP_HALT:
+				co_await guestAwait{ g, WAIT_HALT };
+				break;
+			case STOP_IO: {
+				g->input = result.input;
+				uint8_t value = 0;
+				if (loop->devices[s->port] != nullptr) {
+					value = co_await guestAwait{ g, WAIT_IO };
+				}
+				if (result.input) {
+					s->r.a = value;
+				}
+				break;
+			}
+			default:
+				g->reason = result.reason;
+				g->wait = WAIT_DONE;
+				co_return;
+			}
+		}
+	}
+
+	uint32_t guestLoop::add(state *s) {
+		uint32_t id = (uint32_t)guests.size();
+		guests.emplace_back(s, guestTask());
+		guests.back().task = execute(this, &guests.back());
+		queue.push_back(id);
+		return id;
+	}
+
+	void guestLoop::attach(uint8_t port, hostDevice device, void *context) {
+		devices[port] = device;
+		deviceContexts[port] = context;
+	}
+
+	void guestLoop::complete(uint32_t id, uint8_t value) {
+		guest &g = guests[id];
+		if (g.wait != WAIT_IO) {
+			return;
+		}
+		g.value = value;
+		g.wait = WAIT_READY;
+		queue.push_back(id);
+	}
+
+	bool guestLoop::interrupt(uint32_t id, uint8_t n) {
+		guest &g = guests[id];
+		if (g.wait == WAIT_DONE || !Emu8080::interrupt(g.s, n)) {
+			return false;
+		}
+		if (g.wait == WAIT_HALT) {
+			g.wait = WAIT_READY;
+			queue.push_back(id);
+		}
+		return true;
+	}
+
+	bool guestLoop::step() {
+		if (queue.empty()) {
+			return false;
+		}
+		uint32_t id = queue.front();
+		queue.pop_front();
+		guest &g = guests[id];
+		g.switches++;
+		switches++;
+		g.task.handle.resume();
+		switch (g.wait) {
+		case WAIT_READY:
+			queue.push_back(id);
+			break;
+		case WAIT_IO: {
+			state *s = g.s;
+			devices[s->port](this, id, s->port, g.input, g.input ? 0 : s->r.a, deviceContexts[s->port]);
+			break;
+		}
+		default:
+			break;
+		}
+		return true;
+	}
+
+	void guestLoop::runReady() {
+		while (step()) {
+		}
+	}
+}
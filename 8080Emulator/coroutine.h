@@ -0,0 +1,132 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include "cpu.h"
+#include "emulator.h"
+
+namespace Emu8080 {
+	// Guests as coroutines
+	// Each guest runs run() in a coroutine that suspends when it uses up its slice, executes IN or OUT
+	// on a port the host answers, or halts, so one host thread interleaves any number of guests
+	// The coroutine only holds a pointer to the guest's state, suspending and resuming copies nothing
+
+	class guestLoop;
+
+	// What a guest is suspended on
+	enum guestWait {
+		WAIT_READY, // Queued to run, after its slice ran out or whatever it waited on was answered
+		WAIT_IO, // IN or OUT on a host device, until complete
+		WAIT_HALT, // HLT, until an interrupt is accepted
+		WAIT_DONE // Stopped for good on another stop reason
+	};
+
+	// Host side of a port, called when a guest suspends on IN or OUT to it, value is A for OUT
+	// The device answers with guestLoop::complete, before returning or any time later
+	typedef void (*hostDevice)(guestLoop *loop, uint32_t guest, uint8_t port, bool in, uint8_t value, void *context);
+
+	// Coroutine running one guest, owned by the guestLoop it was added to
+	class guestTask {
+	public:
+		class promise_type {
+		public:
+			guestTask get_return_object() {
+				return guestTask(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+			// Doesn't run until the loop first resumes it
+			std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+			// Stays suspended at the end so the loop can see it finished and destroy it
+			std::suspend_always final_suspend() noexcept {
+				return {};
+			}
+			void return_void() {}
+			void unhandled_exception() {
+				throw;
+			}
+		};
+
+		guestTask() = default;
+		guestTask(guestTask &&other) noexcept : handle(other.handle) {
+			other.handle = nullptr;
+		}
+		guestTask &operator=(guestTask &&other) noexcept;
+		guestTask(const guestTask &) = delete;
+		guestTask &operator=(const guestTask &) = delete;
+		~guestTask();
+
+		std::coroutine_handle<promise_type> handle = nullptr;
+
+	private:
+		explicit guestTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+	};
+
+	class guest {
+	public:
+		state *s = nullptr;
+		guestWait wait = WAIT_READY;
+		stopReason reason = STOP_BUDGET; // Why it stopped once done
+		bool input = false; // Waits on IN rather than OUT
+		uint8_t value = 0; // Answer to the IN it waits on
+		uint64_t cycles = 0;
+		uint64_t instructions = 0;
+		uint64_t switches = 0; // Times it was resumed
+		guestTask task;
+
+		guest(state *s, guestTask task) : s(s), task(std::move(task)) {}
+	};
+
+	// Cycles a guest runs before it goes to the back of the ready queue
+	constexpr uint64_t GUEST_SLICE = 10000;
+
+	// Interleaves guests on the calling thread, round robin over the ready ones
+	// Devices are attached to ports and shared by every guest, a port the guest's own portBus handles
+	// never suspends it, and one with neither reads 0 and ignores writes like runBatch
+	class guestLoop {
+	public:
+		uint64_t slice = GUEST_SLICE;
+		uint64_t switches = 0; // Resumes of any guest
+
+		guestLoop() = default;
+		guestLoop(const guestLoop &) = delete;
+		guestLoop &operator=(const guestLoop &) = delete;
+
+		// Add a guest running s from where it is, returns its id
+		// s must outlive the loop, the loop never copies it
+		uint32_t add(state *s);
+		// Put port on a host device, guests suspend on IN and OUT to it until the device answers
+		void attach(uint8_t port, hostDevice device, void *context);
+
+		// Answer the IN or OUT guest id waits on, value is read into A for IN
+		void complete(uint32_t id, uint8_t value = 0);
+		// Interrupt request with RST n to guest id, waking it if it was halted
+		// Returns false if its interrupts are disabled, or it was just enabled by the last instruction
+		bool interrupt(uint32_t id, uint8_t n);
+
+		// Resume the next ready guest for a slice, false if none is ready
+		bool step();
+		// Step until no guest is ready, those left wait on a device or an interrupt, or are done
+		void runReady();
+
+		const guest &operator[](uint32_t id) const {
+			return guests[id];
+		}
+		size_t size() const {
+			return guests.size();
+		}
+		size_t ready() const {
+			return queue.size();
+		}
+
+	private:
+		std::deque<guest> guests; // Never moved once added, coroutines keep pointers to them
+		std::deque<uint32_t> queue; // Ready guests
+		hostDevice devices[256] = {};
+		void *deviceContexts[256] = {};
+
+		static guestTask execute(guestLoop *loop, guest *g);
+	};
+}
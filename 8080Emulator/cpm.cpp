@@ -0,0 +1,64 @@
+#include "cpm.h"
+#include "rom.h"
+
+namespace Emu8080 {
+	static void bdosTrap(state *s, uint8_t port, uint8_t value, void *context) {
+		static_cast<cpmConsole *>(context)->call(s);
+	}
+
+	void cpmConsole::attach(portBus *bus) {
+		bus->writers[CPM_PORT] = bdosTrap;
+		bus->writerContexts[CPM_PORT] = this;
+	}
+
+	void cpmConsole::flush() {
+		if (echo != nullptr && echoed < output.size()) {
+			echo->write(output.data() + echoed, output.size() - echoed);
+			echo->flush();
+		}
+		echoed = output.size();
+	}
+
+	void cpmConsole::call(state *s) {
+		calls++;
+		switch (s->r.c) {
+		case 2: // Console output
+			output.push_back((char)s->r.e);
+			break;
+		case 9: // Print string
+			for (uint16_t address = s->r.de; s->memory[address] != '$' && address != (uint16_t)(s->r.de - 1); address++) {
+				output.push_back((char)s->memory[address]);
+			}
+			break;
+		default:
+			unsupported++;
+			break;
+		}
+		if (output.size() - echoed >= CPM_ECHO_BLOCK) {
+			flush();
+		}
+	}
+
+	bool loadCpm(state *s, const std::string &path) {
+		if (!loadImage(s, path, CPM_TPA)) {
+			return false;
+		}
+		const uint8_t pageZero[] = {
+			0xF3, 0x76, // DI, HLT
+			0x00, 0x00, 0x00, // IOBYTE, drive and user
+			0xC3, CPM_BDOS & 0xFF, CPM_BDOS >> 8 // JMP CPM_BDOS
+		};
+		for (uint16_t i = 0; i < sizeof(pageZero); i++) {
+			write8(s, i, pageZero[i]);
+		}
+		write8(s, CPM_BDOS, 0xD3); // OUT CPM_PORT
+		write8(s, CPM_BDOS + 1, CPM_PORT);
+		write8(s, CPM_BDOS + 2, 0xC9); // RET
+		// Return address of the program, so RET exits through warm boot as it would to the CCP
+		write8(s, CPM_BDOS - 1, 0x00);
+		write8(s, CPM_BDOS - 2, 0x00);
+		s->r.sp = CPM_BDOS - 2;
+		s->r.pc = CPM_TPA;
+		return true;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "cpu.h"
+
+namespace Emu8080 {
+	// CP/M high level emulation, just enough of the system for test programs that print through BDOS
+	// Page zero is set up the way CP/M leaves it, but the entries lead to traps rather than an OS:
+	//   0x0000 warm boot: DI, HLT, so run stops with STOP_HALT and PC on CPM_WARM_BOOT
+	//   0x0005 BDOS: JMP CPM_BDOS, which does OUT CPM_PORT, RET
+	// The OUT reaches the console on the port bus, so the trap costs nothing on any other instruction
+	constexpr uint16_t CPM_TPA = 0x0100; // Programs are loaded and started here
+	constexpr uint16_t CPM_WARM_BOOT = 0x0001; // PC of the HLT a program exiting through 0 stops on
+	constexpr uint16_t CPM_BDOS = 0xFE00; // Top of the program area, programs read it from 0x0006 to place their stack
+	constexpr uint8_t CPM_PORT = 0xFF;
+
+	// BDOS console, buffers what programs print
+	// Handles function 2, print E, and 9, print from DE up to a '$', the rest are counted and ignored
+	class cpmConsole {
+	public:
+		std::string output; // Everything printed so far
+		uint64_t calls = 0; // BDOS calls
+		uint64_t unsupported = 0; // Calls for functions other than 2 and 9
+
+		// Output is copied to echo, when given, each time CPM_ECHO_BLOCK bytes have built up and on flush
+		cpmConsole(std::ostream *echo = nullptr) : echo(echo) {}
+		void attach(portBus *bus);
+		// Copy whatever hasn't been echoed yet
+		void flush();
+		// Serve the BDOS call in s
+		void call(state *s);
+
+	private:
+		std::ostream *echo;
+		size_t echoed = 0;
+	};
+	constexpr size_t CPM_ECHO_BLOCK = 0x1000;
+
+	// Set up page zero and the BDOS trap, load a .COM program at CPM_TPA and point PC at it
+	// The stack starts below CPM_BDOS holding a return address of 0, so RET from the program is a warm boot
+	// Returns false, with memory untouched, if the program can't be loaded
+	bool loadCpm(state *s, const std::string &path);
+}
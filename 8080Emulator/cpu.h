@@ -0,0 +1,380 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Emu8080 {
+	// CPU
+	// Register pair, directly addressable as a 16 bit value or as its two 8 bit halves
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define EMU8080_PAIR(pair, high, low) union { uint16_t pair; struct { uint8_t high, low; }; }
+#else
+#define EMU8080_PAIR(pair, high, low) union { uint16_t pair; struct { uint8_t low, high; }; }
+#endif
+
+	// Last ALU operation, kept so its flags are only computed when an instruction reads them
+	// Used when built with EMU8080_LAZY_FLAGS
+	class lazyFlags {
+	public:
+		uint8_t op; // aluOp
+		uint8_t lhs, rhs; // Operands
+		uint16_t result;
+		uint8_t checkCY; // Carry comes from this result rather than the F byte
+		uint8_t pending; // Flags have not been written to the F byte yet
+		lazyFlags() : op(0), lhs(0), rhs(0), result(0), checkCY(0), pending(0) {}
+	};
+
+	class registers {
+	public:
+		EMU8080_PAIR(psw, a, f); // F holds the flags as laid out in the PSW byte
+		EMU8080_PAIR(bc, b, c);
+		EMU8080_PAIR(de, d, e);
+		EMU8080_PAIR(hl, h, l);
+		uint16_t sp, pc;
+		registers() : psw(0x00D6), bc(0), de(0), hl(0), sp(0), pc(0) {} // Z, S, P and AC start set
+	};
+
+	class state;
+
+	// Memory page attributes
+	constexpr uint8_t PAGE_CODE = 0x01; // Holds decoded or translated code, stores mark it dirty
+	constexpr uint8_t PAGE_ROM = 0x02; // Stores are dropped
+	constexpr uint8_t PAGE_HANDLER = 0x04; // Stores go to the page's writer instead of memory
+	constexpr uint8_t PAGE_MIRROR = 0x08; // Stores land in this page and its mirror
+	constexpr uint8_t PAGE_WRAP = 0x10; // Page 0, whose first two bytes are repeated past 0xFFFF
+	constexpr uint8_t PAGE_SHARED = 0x20; // Still matches its snapshot copy, the first store ends the sharing
+	constexpr uint8_t PAGE_WATCH = 0x40; // The first store sets writtenPages and clears this, until the watcher sets it again
+
+	// 256 bytes of memory as kept by snapshots, never written once shared
+	typedef std::array<uint8_t, 0x100> memoryPage;
+	class busMap;
+
+	// Store handler of a PAGE_HANDLER page, memory is only written if the handler writes it
+	typedef void (*pageWriter)(state *s, uint16_t address, uint8_t value, void *context);
+
+	// Handlers of an I/O port, context is whatever the device was attached with
+	typedef uint8_t (*portReader)(state *s, uint8_t port, void *context);
+	typedef void (*portWriter)(state *s, uint8_t port, uint8_t value, void *context);
+
+	// State of a device kept by snapshots, save appends its bytes and load reads them back, returning past them
+	typedef void (*deviceSaver)(std::vector<uint8_t> &out, void *context);
+	typedef const uint8_t *(*deviceLoader)(const uint8_t *in, void *context);
+
+	// A device on a portBus with state of its own
+	class portDevice {
+	public:
+		deviceSaver save;
+		deviceLoader load;
+		void *context;
+	};
+
+	// Devices on the 256 I/O ports, IN and OUT call the port's handler straight from the table
+	// A port without a handler is left to the host, run stops on it with STOP_IO
+	class portBus {
+	public:
+		portReader readers[256] = {};
+		void *readerContexts[256] = {};
+		portWriter writers[256] = {};
+		void *writerContexts[256] = {};
+		std::vector<portDevice> devices; // Saved by snapshots in this order
+	};
+
+	class state {
+	public:
+		// Fields touched on every instruction come first and share a cache line
+		registers r;
+		lazyFlags lazy;
+		uint8_t enabled = 0;
+		uint8_t eiDelay = 0; // EI was the last instruction, interrupts are taken after the one following it
+		uint8_t halted = 0; // Waiting on HLT for an interrupt
+		uint8_t codeDirty = 0; // Any page is dirty
+		uint8_t port = 0; // Port of the IN or OUT that stopped run
+		uint32_t jitBudget = 0; // Instructions compiled code may still run
+		uint32_t jitCycles = 0; // Cycles compiled code has run, each block adds its own
+		std::vector<uint8_t> memory; // 64KB, then its first two bytes again so fetches at 0xFFFE and 0xFFFF wrap
+		portBus *ports = nullptr; // Null leaves every port to the host, copies of the state share it
+		// Memory bus of 256 byte pages
+		// Loads read memory directly, stores to a page with any attribute set go through busWrite
+		uint8_t pageFlags[256] = {};
+		uint8_t mirrors[256] = {}; // Page each PAGE_MIRROR page is mirrored at
+		pageWriter writers[256] = {}; // Handler of each PAGE_HANDLER page
+		void *writerContexts[256] = {};
+		// Decoded and translated code tracking, stores to a PAGE_CODE page mark it dirty
+		// so whoever decoded or translated it can drop the stale copies
+		uint8_t dirtyPages[256] = {};
+		uint8_t writtenPages[256] = {}; // PAGE_WATCH pages stored to since they were watched
+		// Snapshot copy of each PAGE_SHARED page, and of the memory map until it is changed
+		// Snapshots share these rather than copying memory again
+		std::shared_ptr<const memoryPage> sharedPages[256];
+		std::shared_ptr<const busMap> sharedMap;
+		std::vector<uint8_t> breakpoints; // Addresses run stops at, empty or one flag per address
+		state() {
+			memory = std::vector<uint8_t>(0x10000 + 2, 0); // Reserve 64KB and the wrap mirror
+			pageFlags[0] = PAGE_WRAP;
+		}
+	};
+
+	// Operations
+
+	// Store to a page with attributes
+	void busWrite(state *s, uint16_t address, uint8_t value);
+
+	// Write byte to memory, pages with attributes take the slow path through busWrite
+	inline void write8(state *s, uint16_t address, uint8_t value) {
+		if (s->pageFlags[address >> 8]) {
+			busWrite(s, address, value);
+		} else {
+			s->memory[address] = value;
+		}
+	}
+
+	// Flag tables
+
+	// Flag bits as laid out in the PSW byte
+	constexpr uint8_t FLAG_S = 0x80;
+	constexpr uint8_t FLAG_Z = 0x40;
+	constexpr uint8_t FLAG_AC = 0x10;
+	constexpr uint8_t FLAG_P = 0x04;
+	constexpr uint8_t FLAG_CY = 0x01;
+	constexpr uint8_t FLAG_ONE = 0x02; // Always set, bits 3 and 5 are always clear
+
+	// ALU operation kinds, each computes half carry differently
+	enum aluOp : uint8_t {
+		ALU_ADD, // ADD, ADC, INR
+		ALU_SUB, // SUB, SBB, CMP, DCR
+		ALU_AND, // ANA
+		ALU_LOGIC // XRA, ORA
+	};
+
+	class flagTable {
+	public:
+		uint8_t szp[256]; // S, Z and P of a result byte
+		uint8_t halfCarry[4][8]; // AC by operation, indexed by bit 3 of lhs, rhs and result
+	};
+
+	// Build the flag tables at compile time
+	constexpr flagTable makeFlagTable() {
+		flagTable t{};
+		for (int i = 0; i < 256; i++) {
+			int bits = 0;
+			for (int b = 0; b < 8; b++) {
+				bits += (i >> b) & 1;
+			}
+			t.szp[i] = (i & 0x80 ? FLAG_S : 0) | (i == 0 ? FLAG_Z : 0) | ((bits & 1) == 0 ? FLAG_P : 0);
+		}
+		for (int i = 0; i < 8; i++) {
+			int lhs = (i >> 2) & 1, rhs = (i >> 1) & 1, result = i & 1;
+			// Carry into bit 4 from the carry into bit 3 that produced the result bit,
+			// subtraction is done as lhs + ~rhs + 1
+			int carry3 = result ^ lhs ^ rhs;
+			t.halfCarry[ALU_ADD][i] = (lhs + rhs + carry3) >= 2 ? FLAG_AC : 0;
+			carry3 = result ^ lhs ^ !rhs;
+			t.halfCarry[ALU_SUB][i] = (lhs + !rhs + carry3) >= 2 ? FLAG_AC : 0;
+			t.halfCarry[ALU_AND][i] = (lhs | rhs) ? FLAG_AC : 0;
+			t.halfCarry[ALU_LOGIC][i] = 0;
+		}
+		return t;
+	}
+	constexpr flagTable flagTables = makeFlagTable();
+
+	// Check flags
+	inline void checkFlags(state *s, uint8_t op, uint8_t lhs, uint8_t rhs, uint16_t result, bool checkCY) {
+		uint8_t f = flagTables.szp[result & 0xFF]
+			| flagTables.halfCarry[op][((lhs & 0x08) >> 1) | ((rhs & 0x08) >> 2) | ((result & 0x08) >> 3)];
+		if (checkCY) {
+			f |= (result & 0xFF00) != 0; // Carry or borrow out of bit 7
+		} else {
+			f |= s->r.f & FLAG_CY;
+		}
+		s->r.f = f | FLAG_ONE;
+	}
+
+	// Read flags, computing them from the last ALU operation if they are still pending
+	inline uint8_t flags(state *s) {
+#ifdef EMU8080_LAZY_FLAGS
+		if (s->lazy.pending) {
+			checkFlags(s, s->lazy.op, s->lazy.lhs, s->lazy.rhs, s->lazy.result, s->lazy.checkCY);
+			s->lazy.pending = 0;
+		}
+#endif
+		return s->r.f;
+	}
+	// Read carry without computing the other flags
+	inline uint8_t carry(state *s) {
+#ifdef EMU8080_LAZY_FLAGS
+		if (s->lazy.pending && s->lazy.checkCY) {
+			return (s->lazy.result & 0xFF00) > 0;
+		}
+#endif
+		return s->r.f & FLAG_CY;
+	}
+	// Set carry without computing the other flags
+	inline void setCarry(state *s, uint8_t cy) {
+#ifdef EMU8080_LAZY_FLAGS
+		s->lazy.checkCY = 0;
+#endif
+		s->r.f = (s->r.f & ~FLAG_CY) | (cy & FLAG_CY);
+	}
+	// Overwrite every flag with a PSW byte, dropping any pending ALU result
+	inline void setFlags(state *s, uint8_t f) {
+#ifdef EMU8080_LAZY_FLAGS
+		s->lazy.pending = 0;
+#endif
+		s->r.f = (f & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_ONE;
+	}
+
+	// Set flags for the result of an ALU operation
+	// Lazy builds only record the operation, an instruction that reads the flags computes them
+	inline void aluFlags(state *s, uint8_t op, uint8_t lhs, uint8_t rhs, uint16_t result, bool checkCY) {
+#ifdef EMU8080_LAZY_FLAGS
+		// Carry is kept from the previous operation, resolve it before the record is replaced
+		if (!checkCY && s->lazy.pending && s->lazy.checkCY) {
+			s->r.f = (s->r.f & ~FLAG_CY) | ((s->lazy.result & 0xFF00) != 0);
+		}
+		s->lazy.op = op;
+		s->lazy.lhs = lhs;
+		s->lazy.rhs = rhs;
+		s->lazy.result = result;
+		s->lazy.checkCY = checkCY;
+		s->lazy.pending = 1;
+#else
+		checkFlags(s, op, lhs, rhs, result, checkCY);
+#endif
+	}
+
+	// Check carry 32 bit
+	inline void checkCarry32(state *s, uint32_t result) {
+		setCarry(s, (result & 0xFFFF0000) > 0);
+	}
+
+	// Add value to 8 bit register
+	inline void add8(state *s, uint8_t &reg, uint8_t val, bool cy) {
+		uint16_t result = (uint16_t)reg + (uint16_t)val;
+		aluFlags(s, ALU_ADD, reg, val, result, cy);
+		reg = result & 0xFF;
+	}
+	// Add register pair to HL
+	inline void dad(state *s, uint16_t pair) {
+		uint32_t result = (uint32_t)s->r.hl + pair;
+		s->r.hl = result & 0xFFFF;
+		checkCarry32(s, result);
+	}
+	// Add value and carry to 8 bit register
+	inline void adc(state *s, uint8_t &reg, uint8_t val, bool cy) {
+		uint16_t result = (uint16_t)reg + (uint16_t)val + carry(s);
+		aluFlags(s, ALU_ADD, reg, val, result, cy);
+		reg = result & 0xFF;
+	}
+
+	// Subtract value from 8 bit register
+	inline void sub8(state *s, uint8_t &reg, uint8_t val, bool cy) {
+		uint16_t result = (uint16_t)reg - (uint16_t)val;
+		aluFlags(s, ALU_SUB, reg, val, result, cy);
+		reg = result & 0xFF;
+	}
+	// Subtract value and carry from 8 bit register
+	inline void sbb(state *s, uint8_t &reg, uint8_t val, bool cy) {
+		uint16_t result = (uint16_t)reg - (uint16_t)val - carry(s);
+		aluFlags(s, ALU_SUB, reg, val, result, cy);
+		reg = result & 0xFF;
+	}
+
+	// AND value from 8 bit register
+	inline void ana(state *s, uint8_t &reg, uint8_t val) {
+		uint16_t result = (uint16_t)reg & (uint16_t)val;
+		aluFlags(s, ALU_AND, reg, val, result, true);
+		reg = result & 0xFF;
+	}
+	// XOR value from 8 bit register
+	inline void xra(state *s, uint8_t &reg, uint8_t val) {
+		uint16_t result = (uint16_t)reg ^ (uint16_t)val;
+		aluFlags(s, ALU_LOGIC, reg, val, result, true);
+		reg = result & 0xFF;
+	}
+	// OR value from 8 bit register
+	inline void ora(state *s, uint8_t &reg, uint8_t val) {
+		uint16_t result = (uint16_t)reg | (uint16_t)val;
+		aluFlags(s, ALU_LOGIC, reg, val, result, true);
+		reg = result & 0xFF;
+	}
+
+	// Move 8 bit register to 8 bit register
+	inline void mov8(uint8_t &reg1, uint8_t &reg2) {
+		reg1 = reg2;
+	}
+	// Move 8 bit register to/from register at location HL
+	inline void movHL(state *s, uint8_t &reg, bool toHL) {
+		if (toHL) {
+			write8(s, s->r.hl, reg);
+		} else {
+			reg = s->memory[s->r.hl];
+		}
+	}
+
+	// Compare register with accumulator
+	inline void cmp(state *s, uint8_t &reg) {
+		uint16_t result = (uint16_t)s->r.a - (uint16_t)reg;
+		aluFlags(s, ALU_SUB, s->r.a, reg, result, true);
+	}
+
+	// Push register pair to stack
+	inline void push(state *s, uint16_t pair) {
+		write8(s, s->r.sp - 1, pair >> 8);
+		write8(s, s->r.sp - 2, pair & 0xFF);
+		s->r.sp -= 2;
+	}
+	// Pop register pair from stack
+	inline void pop(state *s, uint16_t &pair) {
+		pair = s->memory[s->r.sp] | (s->memory[s->r.sp + 1] << 8);
+		s->r.sp += 2;
+	}
+
+	// Return
+	inline void ret(state *s) {
+		s->r.pc = s->memory[s->r.sp] | (s->memory[s->r.sp + 1] << 8);
+		s->r.sp += 2;
+	}
+
+	// Call adr
+	// PC already points at the next instruction, which is the return address
+	// The target is read before the push, which may overwrite it
+	inline void call(state *s, uint8_t *opcode) {
+		uint16_t target = (opcode[2] << 8) | opcode[1];
+		write8(s, s->r.sp - 1, (s->r.pc >> 8) & 0xff);
+		write8(s, s->r.sp - 2, s->r.pc & 0xff);
+		s->r.sp = s->r.sp - 2;
+		s->r.pc = target;
+	}
+
+	// Restart, call the fixed vector n * 8
+	inline void rst(state *s, uint16_t vector) {
+		write8(s, s->r.sp - 1, (s->r.pc >> 8) & 0xff);
+		write8(s, s->r.sp - 2, s->r.pc & 0xff);
+		s->r.sp = s->r.sp - 2;
+		s->r.pc = vector;
+	}
+
+	// Interrupt request with RST n on the bus
+	// Ignored while interrupts are disabled or EI was the last instruction run, accepting one
+	// disables them until the next EI
+	inline bool interrupt(state *s, uint8_t n) {
+		if (!s->enabled || s->eiDelay) {
+			return false;
+		}
+		s->enabled = 0;
+		if (s->halted) {
+			// Return past the HLT
+			s->halted = 0;
+			s->r.pc += 1;
+		}
+		rst(s, n * 8);
+		return true;
+	}
+
+	// Jump adr
+	inline void jump(state* s, uint8_t *opcode) {
+		s->r.pc = (opcode[2] << 8) | opcode[1];
+	}
+}
@@ -0,0 +1,64 @@
+#include "decode.h"
+
+namespace Emu8080 {
+	decodedInstruction &decodeCache::decode(state *s, uint16_t pc) {
+		decodedInstruction &in = slots[pc];
+		uint8_t op = s->memory[pc];
+		in.handler = instructionTable[op];
+		in.length = instructionLength[op];
+		in.cycles = instructionCycles[op];
+		in.branch = branchCycles[op];
+		for (int i = 0; i < 3; i++) {
+			in.bytes[i] = i < in.length ? s->memory[(uint16_t)(pc + i)] : 0;
+		}
+		// Watch every page the instruction was read from
+		s->pageFlags[pc >> 8] |= PAGE_CODE;
+		s->pageFlags[(uint16_t)(pc + in.length - 1) >> 8] |= PAGE_CODE;
+		decoded++;
+		return in;
+	}
+
+	void decodeCache::invalidatePage(state *s, int page) {
+		// Instructions starting in the last two bytes of the previous page can reach into this one
+		for (int i = (page << 8) - 2; i <= (page << 8) + 0xFF; i++) {
+			slots[i & 0xFFFF].handler = nullptr;
+		}
+		s->pageFlags[page] &= ~PAGE_CODE;
+		invalidated++;
+	}
+
+	void decodeCache::flushDirty(state *s) {
+		for (int page = 0; page < 256; page++) {
+			if (s->dirtyPages[page]) {
+				invalidatePage(s, page);
+				s->dirtyPages[page] = 0;
+			}
+		}
+		s->codeDirty = 0;
+	}
+
+	uint64_t emulateDecoded(state *s, decodeCache *d, uint64_t count) {
+		uint64_t cycles = 0;
+		while (count-- > 0) {
+			// Stores from the last instruction may have hit decoded code
+			if (s->codeDirty) {
+				d->flushDirty(s);
+			}
+			decodedInstruction *in = &d->slots[s->r.pc];
+			if (in->handler == nullptr) {
+				in = &d->decode(s, s->r.pc);
+			}
+			uint16_t next = s->r.pc + in->length;
+			uint16_t sp = s->r.sp;
+			s->r.pc = next;
+			s->eiDelay = 0; // Any instruction ends the delay of an EI before it
+			in->handler(s, in->bytes);
+			// The slot stays filled until the next flush even if the handler wrote over its bytes
+			cycles += in->cycles;
+			if (in->branch && (s->r.pc != next || s->r.sp != sp)) {
+				cycles += in->branch;
+			}
+		}
+		return cycles;
+	}
+}
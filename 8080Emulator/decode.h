@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "cpu.h"
+#include "instructions.h"
+
+namespace Emu8080 {
+	// An instruction decoded once and run from its slot until its bytes are written
+	class decodedInstruction {
+	public:
+		instruction handler = nullptr; // Null until the slot is decoded
+		uint8_t bytes[3] = {}; // Opcode and operands, handed to the handler in place of memory
+		uint8_t length = 0;
+		uint8_t cycles = 0;
+		uint8_t branch = 0; // Extra cycles when a conditional call or return is taken
+	};
+
+	// Decode cache, one slot per guest address
+	// Pages holding decoded slots are flagged PAGE_CODE and watched for stores, so each state needs its own cache
+	class decodeCache {
+	public:
+		std::vector<decodedInstruction> slots;
+		uint64_t decoded = 0; // Slots filled so far
+		uint64_t invalidated = 0; // Pages dropped because they were written
+
+		decodeCache() : slots(0x10000) {}
+
+		// Fill the slot of the instruction at pc
+		decodedInstruction &decode(state *s, uint16_t pc);
+		// Drop the slots of every dirty page
+		void flushDirty(state *s);
+
+	private:
+		void invalidatePage(state *s, int page);
+	};
+
+	// Execute count instructions from the decode cache, returns the cycles they took as run counts them
+	uint64_t emulateDecoded(state *s, decodeCache *d, uint64_t count);
+}
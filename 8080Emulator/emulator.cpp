@@ -0,0 +1,616 @@
+#include <iostream>
+#include <iomanip>
+#include <bitset>
+#include "emulator.h"
+#include "instructions.h"
+#include "rom.h"
+#include "trace.h"
+
+namespace Emu8080 {
+	// Exit program when an unimplemented instruction is encountered
+	void unimplementedInstruction(uint8_t opcode) {
+		std::cout << "Error: Instruction "
+			<< std::uppercase << std::hex << std::setw(2) << std::setfill('0')
+			<< (int)opcode << " is unimplemented\n";
+	}
+
+	// Print CPU state
+	void printState(state *s, uint8_t opcode, uint16_t data) {
+		uint8_t f = flags(s);
+		std::cout << "PC: " <<  s->r.pc << " Opcode: "
+			<< std::uppercase << std::hex << std::setw(2) << std::setfill('0') << (int)opcode
+			<< " Data: " << data 
+			<< "\n"
+			<< "SP:" << std::uppercase << std::hex << std::setw(2) << std::setfill('0') << (s->r.sp) << "\n"
+			<< "Z:" << std::bitset<1>((f & FLAG_Z) != 0)
+			<< " S:" << std::bitset<1>((f & FLAG_S) != 0)
+			<< " P:" << std::bitset<1>((f & FLAG_P) != 0)
+			<< " CY:" << std::bitset<1>((f & FLAG_CY) != 0)
+			<< " AC:" << std::bitset<1>((f & FLAG_AC) != 0) 
+			<< "\n"
+			<< "A:" << std::bitset<8>(s->r.a)
+			<< " B:" << std::bitset<8>(s->r.b)
+			<< " C:" << std::bitset<8>(s->r.c)
+			<< "\nD:" << std::bitset<8>(s->r.d)
+			<< " E:" << std::bitset<8>(s->r.e)
+			<< " H:" << std::bitset<8>(s->r.h)
+			<< " L:" << std::bitset<8>(s->r.l) 
+			<< "\n\n";
+	}
+
+	// Reading file into memory at 0
+	void readFile(state *s, const std::string &path) {
+		loadImage(s, path, 0);
+	}
+
+	// Parse code and execute instruction
+	void emulate8080(state *s) {
+		// Get the current instruction from the program counter
+		uint8_t *opcode = &s->memory[s->r.pc];
+		// Step past the instruction and its operands
+		s->r.pc += instructionLength[*opcode];
+		// Any instruction ends the delay of an EI before it
+		s->eiDelay = 0;
+		// Check the instruction and execute it
+		switch (*opcode) {
+		case 0x00: // NOP
+			op00(s, opcode); break;
+		case 0x01: // LXI B, D16
+			op01(s, opcode); break;
+		case 0x02: // STAX B
+			op02(s, opcode); break;
+		case 0x03: // INX B
+			op03(s, opcode); break;
+		case 0x04: // INR B
+			op04(s, opcode); break;
+		case 0x05: // DCR B
+			op05(s, opcode); break;
+		case 0x06: // MVI B, D8
+			op06(s, opcode); break;
+		case 0x07: // RLC
+			op07(s, opcode); break;
+		case 0x08: // -
+			op08(s, opcode); break;
+		case 0x09: // DAD B
+			op09(s, opcode); break;
+		case 0x0A: // LDAX B
+			op0A(s, opcode); break;
+		case 0x0B: // DCX B
+			op0B(s, opcode); break;
+		case 0x0C: // INR C
+			op0C(s, opcode); break;
+		case 0x0D: // DCR C
+			op0D(s, opcode); break;
+		case 0x0E: // MVI C, D8
+			op0E(s, opcode); break;
+		case 0x0F: // RRC
+			op0F(s, opcode); break;
+		case 0x10: // -
+			op10(s, opcode); break;
+		case 0x11: // LXI D, D16
+			op11(s, opcode); break;
+		case 0x12: // STAX D
+			op12(s, opcode); break;
+		case 0x13: // INX D
+			op13(s, opcode); break;
+		case 0x14: // INR D
+			op14(s, opcode); break;
+		case 0x15: // DCR D
+			op15(s, opcode); break;
+		case 0x16: // MVI D, D8
+			op16(s, opcode); break;
+		case 0x17: // RAL
+			op17(s, opcode); break;
+		case 0x18: // -
+			op18(s, opcode); break;
+		case 0x19: // DAD D
+			op19(s, opcode); break;
+		case 0x1A: // LDAX D
+			op1A(s, opcode); break;
+		case 0x1B: // DCX D
+			op1B(s, opcode); break;
+		case 0x1C: // INR E
+			op1C(s, opcode); break;
+		case 0x1D: // DCR E
+			op1D(s, opcode); break;
+		case 0x1E: // MVI E, D8
+			op1E(s, opcode); break;
+		case 0x1F: // RAR
+			op1F(s, opcode); break;
+		case 0x20: // -
+			op20(s, opcode); break;
+		case 0x21: // LXI H, D16
+			op21(s, opcode); break;
+		case 0x22: // SHLD adr
+			op22(s, opcode); break;
+		case 0x23: // INX H
+			op23(s, opcode); break;
+		case 0x24: // INR H
+			op24(s, opcode); break;
+		case 0x25: // DCR H
+			op25(s, opcode); break;
+		case 0x26: // MVI H, D8
+			op26(s, opcode); break;
+		case 0x27: // DAA
+			op27(s, opcode); break;
+		case 0x28: // -
+			op28(s, opcode); break;
+		case 0x29: // DAD H
+			op29(s, opcode); break;
+		case 0x2A: // LHLD adr
+			op2A(s, opcode); break;
+		case 0x2B: // DCX H
+			op2B(s, opcode); break;
+		case 0x2C: // INR L
+			op2C(s, opcode); break;
+		case 0x2D: // DCR L
+			op2D(s, opcode); break;
+		case 0x2E: // MVI L, D8
+			op2E(s, opcode); break;
+		case 0x2F: // CMA
+			op2F(s, opcode); break;
+		case 0x30: // -
+			op30(s, opcode); break;
+		case 0x31: // LXI SP, D16
+			op31(s, opcode); break;
+		case 0x32: // STA adr
+			op32(s, opcode); break;
+		case 0x33: // INX SP
+			op33(s, opcode); break;
+		case 0x34: // INR M
+			op34(s, opcode); break;
+		case 0x35: // DCR M
+			op35(s, opcode); break;
+		case 0x36: // MVI M, D8
+			op36(s, opcode); break;
+		case 0x37: // STC
+			op37(s, opcode); break;
+		case 0x38: // -
+			op38(s, opcode); break;
+		case 0x39: // DAD SP
+			op39(s, opcode); break;
+		case 0x3A: // LDA adr
+			op3A(s, opcode); break;
+		case 0x3B: // DCX SP
+			op3B(s, opcode); break;
+		case 0x3C: // INR A
+			op3C(s, opcode); break;
+		case 0x3D: // DCR A
+			op3D(s, opcode); break;
+		case 0x3E: // MVI A, D8
+			op3E(s, opcode); break;
+		case 0x3F: // CMC
+			op3F(s, opcode); break;
+		case 0x40: // MOV B, B
+			op40(s, opcode); break;
+		case 0x41: // MOV B, C
+			op41(s, opcode); break;
+		case 0x42: // MOV B, D
+			op42(s, opcode); break;
+		case 0x43: // MOV B, E
+			op43(s, opcode); break;
+		case 0x44: // MOV B, H
+			op44(s, opcode); break;
+		case 0x45: // MOV B, L
+			op45(s, opcode); break;
+		case 0x46: // MOV B, M
+			op46(s, opcode); break;
+		case 0x47: // MOV B, A
+			op47(s, opcode); break;
+		case 0x48: // MOV C, B
+			op48(s, opcode); break;
+		case 0x49: // MOV C, C
+			op49(s, opcode); break;
+		case 0x4A: // MOV C, D
+			op4A(s, opcode); break;
+		case 0x4B: // MOV C, E
+			op4B(s, opcode); break;
+		case 0x4C: // MOV C, H
+			op4C(s, opcode); break;
+		case 0x4D: // MOV C, L
+			op4D(s, opcode); break;
+		case 0x4E: // MOV C, M
+			op4E(s, opcode); break;
+		case 0x4F: // MOV C, A
+			op4F(s, opcode); break;
+		case 0x50: // MOV D, B
+			op50(s, opcode); break;
+		case 0x51: // MOV D, C
+			op51(s, opcode); break;
+		case 0x52: // MOV D, D
+			op52(s, opcode); break;
+		case 0x53: // MOV D, E
+			op53(s, opcode); break;
+		case 0x54: // MOV D, H
+			op54(s, opcode); break;
+		case 0x55: // MOV D, L
+			op55(s, opcode); break;
+		case 0x56: // MOV D, M
+			op56(s, opcode); break;
+		case 0x57: // MOV D, A
+			op57(s, opcode); break;
+		case 0x58: // MOV E, B
+			op58(s, opcode); break;
+		case 0x59: // MOV E, C
+			op59(s, opcode); break;
+		case 0x5A: // MOV E, D
+			op5A(s, opcode); break;
+		case 0x5B: // MOV E, E
+			op5B(s, opcode); break;
+		case 0x5C: // MOV E, H
+			op5C(s, opcode); break;
+		case 0x5D: // MOV E, L
+			op5D(s, opcode); break;
+		case 0x5E: // MOV E, M
+			op5E(s, opcode); break;
+		case 0x5F: // MOV E, A
+			op5F(s, opcode); break;
+		case 0x60: // MOV H, B
+			op60(s, opcode); break;
+		case 0x61: // MOV H, C
+			op61(s, opcode); break;
+		case 0x62: // MOV H, D
+			op62(s, opcode); break;
+		case 0x63: // MOV H, E
+			op63(s, opcode); break;
+		case 0x64: // MOV H, H
+			op64(s, opcode); break;
+		case 0x65: // MOV H, L
+			op65(s, opcode); break;
+		case 0x66: // MOV H, M
+			op66(s, opcode); break;
+		case 0x67: // MOV H, A
+			op67(s, opcode); break;
+		case 0x68: // MOV L, B
+			op68(s, opcode); break;
+		case 0x69: // MOV L, C
+			op69(s, opcode); break;
+		case 0x6A: // MOV L, D
+			op6A(s, opcode); break;
+		case 0x6B: // MOV L, E
+			op6B(s, opcode); break;
+		case 0x6C: // MOV L, H
+			op6C(s, opcode); break;
+		case 0x6D: // MOV L, L
+			op6D(s, opcode); break;
+		case 0x6E: // MOV L, M
+			op6E(s, opcode); break;
+		case 0x6F: // MOV L, A
+			op6F(s, opcode); break;
+		case 0x70: // MOV M, B
+			op70(s, opcode); break;
+		case 0x71: // MOV M, C
+			op71(s, opcode); break;
+		case 0x72: // MOV M, D
+			op72(s, opcode); break;
+		case 0x73: // MOV M, E
+			op73(s, opcode); break;
+		case 0x74: // MOV M, H
+			op74(s, opcode); break;
+		case 0x75: // MOV M, L
+			op75(s, opcode); break;
+		case 0x76: // HLT - special
+			op76(s, opcode); break;
+		case 0x77: // MOV M, A
+			op77(s, opcode); break;
+		case 0x78: // MOV A, B
+			op78(s, opcode); break;
+		case 0x79: // MOV A, C
+			op79(s, opcode); break;
+		case 0x7A: // MOV A, D
+			op7A(s, opcode); break;
+		case 0x7B: // MOV A, E
+			op7B(s, opcode); break;
+		case 0x7C: // MOV A, H
+			op7C(s, opcode); break;
+		case 0x7D: // MOV A, L
+			op7D(s, opcode); break;
+		case 0x7E: // MOV A, M
+			op7E(s, opcode); break;
+		case 0x7F: // MOV A, A
+			op7F(s, opcode); break;
+		case 0x80: // ADD B
+			op80(s, opcode); break;
+		case 0x81: // ADD C
+			op81(s, opcode); break;
+		case 0x82: // ADD D
+			op82(s, opcode); break;
+		case 0x83: // ADD E
+			op83(s, opcode); break;
+		case 0x84: // ADD H
+			op84(s, opcode); break;
+		case 0x85: // ADD L
+			op85(s, opcode); break;
+		case 0x86: // ADD M
+			op86(s, opcode); break;
+		case 0x87: // ADD A
+			op87(s, opcode); break;
+		case 0x88: // ADC B
+			op88(s, opcode); break;
+		case 0x89: // ADC C
+			op89(s, opcode); break;
+		case 0x8A: // ADC D
+			op8A(s, opcode); break;
+		case 0x8B: // ADC E
+			op8B(s, opcode); break;
+		case 0x8C: // ADC H
+			op8C(s, opcode); break;
+		case 0x8D: // ADC L
+			op8D(s, opcode); break;
+		case 0x8E: // ADC M
+			op8E(s, opcode); break;
+		case 0x8F: // ADC A
+			op8F(s, opcode); break;
+		case 0x90: // SUB B
+			op90(s, opcode); break;
+		case 0x91: // SUB C
+			op91(s, opcode); break;
+		case 0x92: // SUB D
+			op92(s, opcode); break;
+		case 0x93: // SUB E
+			op93(s, opcode); break;
+		case 0x94: // SUB H
+			op94(s, opcode); break;
+		case 0x95: // SUB L
+			op95(s, opcode); break;
+		case 0x96: // SUB M
+			op96(s, opcode); break;
+		case 0x97: // SUB A
+			op97(s, opcode); break;
+		case 0x98: // SBB B
+			op98(s, opcode); break;
+		case 0x99: // SBB C
+			op99(s, opcode); break;
+		case 0x9A: // SBB D
+			op9A(s, opcode); break;
+		case 0x9B: // SBB E
+			op9B(s, opcode); break;
+		case 0x9C: // SBB H
+			op9C(s, opcode); break;
+		case 0x9D: // SBB L
+			op9D(s, opcode); break;
+		case 0x9E: // SBB M
+			op9E(s, opcode); break;
+		case 0x9F: // SBB A
+			op9F(s, opcode); break;
+		case 0xA0: // ANA B
+			opA0(s, opcode); break;
+		case 0xA1: // ANA C
+			opA1(s, opcode); break;
+		case 0xA2: // ANA D
+			opA2(s, opcode); break;
+		case 0xA3: // ANA E
+			opA3(s, opcode); break;
+		case 0xA4: // ANA H
+			opA4(s, opcode); break;
+		case 0xA5: // ANA L
+			opA5(s, opcode); break;
+		case 0xA6: // ANA M
+			opA6(s, opcode); break;
+		case 0xA7: // ANA A
+			opA7(s, opcode); break;
+		case 0xA8: // XRA B
+			opA8(s, opcode); break;
+		case 0xA9: // XRA C
+			opA9(s, opcode); break;
+		case 0xAA: // XRA D
+			opAA(s, opcode); break;
+		case 0xAB: // XRA E
+			opAB(s, opcode); break;
+		case 0xAC: // XRA H
+			opAC(s, opcode); break;
+		case 0xAD: // XRA L
+			opAD(s, opcode); break;
+		case 0xAE: // XRA M
+			opAE(s, opcode); break;
+		case 0xAF: // XRA A
+			opAF(s, opcode); break;
+		case 0xB0: // ORA B
+			opB0(s, opcode); break;
+		case 0xB1: // ORA C
+			opB1(s, opcode); break;
+		case 0xB2: // ORA D
+			opB2(s, opcode); break;
+		case 0xB3: // ORA E
+			opB3(s, opcode); break;
+		case 0xB4: // ORA H
+			opB4(s, opcode); break;
+		case 0xB5: // ORA L
+			opB5(s, opcode); break;
+		case 0xB6: // ORA M
+			opB6(s, opcode); break;
+		case 0xB7: // ORA A
+			opB7(s, opcode); break;
+		case 0xB8: // CMP B
+			opB8(s, opcode); break;
+		case 0xB9: // CMP C
+			opB9(s, opcode); break;
+		case 0xBA: // CMP D
+			opBA(s, opcode); break;
+		case 0xBB: // CMP E
+			opBB(s, opcode); break;
+		case 0xBC: // CMP H
+			opBC(s, opcode); break;
+		case 0xBD: // CMP L
+			opBD(s, opcode); break;
+		case 0xBE: // CMP M
+			opBE(s, opcode); break;
+		case 0xBF: // CMP A
+			opBF(s, opcode); break;
+		case 0xC0: // RNZ
+			opC0(s, opcode); break;
+		case 0xC1: // POP B
+			opC1(s, opcode); break;
+		case 0xC2: // JNZ adr
+			opC2(s, opcode); break;
+		case 0xC3: // JMP adr
+			opC3(s, opcode); break;
+		case 0xC4: // CNZ adr
+			opC4(s, opcode); break;
+		case 0xC5: // PUSH B
+			opC5(s, opcode); break;
+		case 0xC6: // ADI D8
+			opC6(s, opcode); break;
+		case 0xC7: // RST 0
+			opC7(s, opcode); break;
+		case 0xC8: // RZ
+			opC8(s, opcode); break;
+		case 0xC9: // RET
+			opC9(s, opcode); break;
+		case 0xCA: // JZ adr
+			opCA(s, opcode); break;
+		case 0xCB: // JMP adr, undocumented
+			opCB(s, opcode); break;
+		case 0xCC: // CZ adr
+			opCC(s, opcode); break;
+		case 0xCD: // CALL adr
+			opCD(s, opcode); break;
+		case 0xCE: // ACI D8
+			opCE(s, opcode); break;
+		case 0xCF: // RST 1
+			opCF(s, opcode); break;
+		case 0xD0: // RNC
+			opD0(s, opcode); break;
+		case 0xD1: // POP D
+			opD1(s, opcode); break;
+		case 0xD2: // JNC adr
+			opD2(s, opcode); break;
+		case 0xD3: // OUT D8 - special
+			opD3(s, opcode); break;
+		case 0xD4: // CNC adr
+			opD4(s, opcode); break;
+		case 0xD5: // PUSH D
+			opD5(s, opcode); break;
+		case 0xD6: // SUI D8
+			opD6(s, opcode); break;
+		case 0xD7: // RST 2
+			opD7(s, opcode); break;
+		case 0xD8: // RC
+			opD8(s, opcode); break;
+		case 0xD9: // RET, undocumented
+			opD9(s, opcode); break;
+		case 0xDA: // JC adr
+			opDA(s, opcode); break;
+		case 0xDB: // IN D8 - special
+			opDB(s, opcode); break;
+		case 0xDC: // CC adr
+			opDC(s, opcode); break;
+		case 0xDD: // CALL adr, undocumented
+			opDD(s, opcode); break;
+		case 0xDE: // SBI D8
+			opDE(s, opcode); break;
+		case 0xDF: // RST 3
+			opDF(s, opcode); break;
+		case 0xE0: // RPO
+			opE0(s, opcode); break;
+		case 0xE1: // POP H
+			opE1(s, opcode); break;
+		case 0xE2: // JPO adr
+			opE2(s, opcode); break;
+		case 0xE3: // XTHL
+			opE3(s, opcode); break;
+		case 0xE4: // CPO adr
+			opE4(s, opcode); break;
+		case 0xE5: // PUSH H
+			opE5(s, opcode); break;
+		case 0xE6: // ANI D8
+			opE6(s, opcode); break;
+		case 0xE7: // RST 4
+			opE7(s, opcode); break;
+		case 0xE8: // RPE
+			opE8(s, opcode); break;
+		case 0xE9: // PCHL
+			opE9(s, opcode); break;
+		case 0xEA: // JPE adr
+			opEA(s, opcode); break;
+		case 0xEB: // XCHG
+			opEB(s, opcode); break;
+		case 0xEC: // CPE adr
+			opEC(s, opcode); break;
+		case 0xED: // CALL adr, undocumented
+			opED(s, opcode); break;
+		case 0xEE: // XRI D8
+			opEE(s, opcode); break;
+		case 0xEF: // RST 5
+			opEF(s, opcode); break;
+		case 0xF0: // RP
+			opF0(s, opcode); break;
+		case 0xF1: // POP PSW
+			opF1(s, opcode); break;
+		case 0xF2: // JP adr
+			opF2(s, opcode); break;
+		case 0xF3: // DI - special
+			opF3(s, opcode); break;
+		case 0xF4: // CP adr
+			opF4(s, opcode); break;
+		case 0xF5: // PUSH PSW
+			opF5(s, opcode); break;
+		case 0xF6: // ORI D8
+			opF6(s, opcode); break;
+		case 0xF7: // RST 6
+			opF7(s, opcode); break;
+		case 0xF8: // RM
+			opF8(s, opcode); break;
+		case 0xF9: // SPHL
+			opF9(s, opcode); break;
+		case 0xFA: // JM adr
+			opFA(s, opcode); break;
+		case 0xFB: // EI - special
+			opFB(s, opcode); break;
+		case 0xFC: // CM adr
+			opFC(s, opcode); break;
+		case 0xFD: // CALL adr, undocumented
+			opFD(s, opcode); break;
+		case 0xFE: // CPI D8
+			opFE(s, opcode); break;
+		case 0xFF: // RST 7
+			opFF(s, opcode); break;
+		}
+	}
+
+	// Execute instructions until the cycle budget runs out or a stop condition fires
+	runResult run(state *s, uint64_t cycleBudget) {
+		noTrace trace;
+		return runTraced(s, cycleBudget, trace);
+	}
+
+	// Execute count instructions on the engine selected at build time
+	void execute(state *s, uint64_t count) {
+#ifdef EMU8080_THREADED
+		emulateThreaded(s, count);
+#else
+		for (; count > 0; count--) {
+			emulate8080(s);
+		}
+#endif
+	}
+	
+	// Tests
+
+	void testRegisters(state *s) {
+		s->r.c = 0x01;
+		s->r.e = 0xFF;
+	}
+
+	void cpudiagFix(state *s) {
+		//Fix the first instruction to be JMP 0x100    
+		write8(s, 0, 0xc3);
+		write8(s, 1, 0);
+		write8(s, 2, 0x01);
+
+		//Fix the stack pointer from 0x6ad to 0x7ad    
+		// this 0x06 byte 112 in the code, which is    
+		// byte 112 + 0x100 = 368 in memory    
+		s->memory[368] = 0x7;
+	}
+
+	// Check if two CPUs have the same registers, flags and memory
+	bool sameState(state *s1, state *s2) {
+		flags(s1);
+		flags(s2);
+		return s1->r.psw == s2->r.psw && s1->r.bc == s2->r.bc && s1->r.de == s2->r.de && s1->r.hl == s2->r.hl
+			&& s1->r.sp == s2->r.sp && s1->r.pc == s2->r.pc
+			&& s1->enabled == s2->enabled
+			&& s1->memory == s2->memory;
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "cpu.h"
+
+namespace Emu8080 {
+	// Exit program when an unimplemented instruction is encountered
+	void unimplementedInstruction(uint8_t opcode);
+	// Print CPU state
+	void printState(state *s, uint8_t opcode, uint16_t data);
+	// Reading file into memory
+	void readFile(state *s, const std::string &path);
+
+	// Why run returned
+	enum stopReason {
+		STOP_BUDGET, // Cycle budget used up
+		STOP_HALT, // HLT executed or the CPU was already halted, only an interrupt resumes it
+		STOP_BREAKPOINT, // Reached an address flagged in state::breakpoints
+		STOP_UNIMPLEMENTED, // Next instruction is unimplemented, PC is left on it
+		STOP_IO // IN or OUT on a port with no device, the host handles state::port, reading A for OUT and setting it for IN
+	};
+
+	class runResult {
+	public:
+		uint64_t cycles = 0; // Cycles consumed
+		uint64_t instructions = 0; // Instructions executed
+		stopReason reason = STOP_BUDGET;
+		bool input = false; // STOP_IO was on IN rather than OUT, state::port has the port
+	};
+
+	// Engines
+
+	// Parse code and execute instruction through the central switch
+	void emulate8080(state *s);
+	// Execute count instructions through threaded dispatch on the handler table
+	void emulateThreaded(state *s, uint64_t count);
+	// Execute instructions until cycleBudget cycles have run or a stop condition fires
+	// The last instruction may overrun the budget, the cycles it took are still counted
+	runResult run(state *s, uint64_t cycleBudget);
+	// Execute count instructions on the engine selected at build time,
+	// define EMU8080_THREADED to use threaded dispatch instead of the switch
+	void execute(state *s, uint64_t count);
+
+	// Tests
+
+	void testRegisters(state *s);
+	void cpudiagFix(state *s);
+	// Check if two CPUs have the same registers, flags and memory
+	bool sameState(state *s1, state *s2);
+}
@@ -0,0 +1,1088 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include "emulator.h"
+#include "fuzz.h"
+#include "jit.h"
+
+namespace Emu8080 {
+	namespace {
+		// Reference model operations, one per group of the 8080 opcode map
+		enum referenceKind : uint8_t {
+			REF_NOP, REF_LXI, REF_DAD, REF_STAX, REF_LDAX, REF_SHLD, REF_LHLD, REF_STA, REF_LDA,
+			REF_INX, REF_DCX, REF_INR, REF_DCR, REF_MVI, REF_ROTATE, REF_DAA, REF_CMA, REF_STC, REF_CMC,
+			REF_MOV, REF_HLT, REF_ALU, REF_ALUI,
+			REF_RCOND, REF_RET, REF_POP, REF_PCHL, REF_SPHL, REF_JCOND, REF_JMP, REF_OUT, REF_IN,
+			REF_XTHL, REF_XCHG, REF_DI, REF_EI, REF_CCOND, REF_CALL, REF_PUSH, REF_RST
+		};
+
+		class referenceOp {
+		public:
+			referenceKind kind = REF_NOP;
+			uint8_t x = 0; // Bits 5-3, the destination register, pair, ALU operation, condition or restart
+			uint8_t y = 0; // Bits 2-0, the source register
+			uint8_t length = 1;
+		};
+
+		// Decode every opcode from its fields, the undocumented ones as the aliases the 8080 runs them as
+		constexpr std::array<referenceOp, 256> makeReferenceTable() {
+			std::array<referenceOp, 256> t{};
+			for (int op = 0; op < 256; op++) {
+				referenceOp &o = t[op];
+				int ddd = (op >> 3) & 7, sss = op & 7, rp = (op >> 4) & 3;
+				o.x = (uint8_t)ddd;
+				o.y = (uint8_t)sss;
+				if (op < 0x40) {
+					const referenceKind stores[] = { REF_STAX, REF_STAX, REF_SHLD, REF_STA, REF_LDAX, REF_LDAX, REF_LHLD, REF_LDA };
+					const referenceKind singles[] = { REF_ROTATE, REF_ROTATE, REF_ROTATE, REF_ROTATE, REF_DAA, REF_CMA, REF_STC, REF_CMC };
+					switch (sss) {
+					case 0: o.kind = REF_NOP; break;
+					case 1: o.kind = op & 0x08 ? REF_DAD : REF_LXI; break;
+					case 2: o.kind = stores[((op >> 3) & 1) * 4 + rp]; break;
+					case 3: o.kind = op & 0x08 ? REF_DCX : REF_INX; break;
+					case 4: o.kind = REF_INR; break;
+					case 5: o.kind = REF_DCR; break;
+					case 6: o.kind = REF_MVI; break;
+					default: o.kind = singles[ddd]; break;
+					}
+				} else if (op < 0x80) {
+					o.kind = op == 0x76 ? REF_HLT : REF_MOV;
+				} else if (op < 0xC0) {
+					o.kind = REF_ALU;
+				} else {
+					const referenceKind pops[] = { REF_RET, REF_RET, REF_PCHL, REF_SPHL };
+					const referenceKind misc[] = { REF_JMP, REF_JMP, REF_OUT, REF_IN, REF_XTHL, REF_XCHG, REF_DI, REF_EI };
+					switch (sss) {
+					case 0: o.kind = REF_RCOND; break;
+					case 1: o.kind = op & 0x08 ? pops[rp] : REF_POP; break;
+					case 2: o.kind = REF_JCOND; break;
+					case 3: o.kind = misc[ddd]; break;
+					case 4: o.kind = REF_CCOND; break;
+					case 5: o.kind = op & 0x08 ? REF_CALL : REF_PUSH; break;
+					case 6: o.kind = REF_ALUI; break;
+					default: o.kind = REF_RST; break;
+					}
+				}
+				switch (o.kind) {
+				case REF_LXI: case REF_SHLD: case REF_LHLD: case REF_STA: case REF_LDA:
+				case REF_JCOND: case REF_JMP: case REF_CCOND: case REF_CALL:
+					o.length = 3;
+					break;
+				case REF_MVI: case REF_ALUI: case REF_OUT: case REF_IN:
+					o.length = 2;
+					break;
+				default:
+					o.length = 1;
+					break;
+				}
+			}
+			return t;
+		}
+		constexpr std::array<referenceOp, 256> referenceTable = makeReferenceTable();
+
+		// Devices both sides see on every port
+		uint8_t fuzzInput(uint8_t port) {
+			return (uint8_t)(port * 0x9D + 0x5B);
+		}
+		uint64_t fuzzOutput(uint64_t outputs, uint8_t port, uint8_t value) {
+			return (outputs ^ ((port << 8) | value)) * 0x100000001B3;
+		}
+
+		bool evenParity(uint8_t v) {
+			v ^= v >> 4;
+			v ^= v >> 2;
+			v ^= v >> 1;
+			return (v & 1) == 0;
+		}
+
+		// Stores a case can make over the background, its code and two per instruction
+		constexpr int FUZZ_STORES = FUZZ_MAX_LENGTH * 5;
+
+		// The 8080 as the data sheet describes it, with none of the tables or helpers of instructions.h
+		class referenceCpu {
+		public:
+			uint8_t reg[8] = {}; // B, C, D, E, H, L, unused for M, then A, in opcode field order
+			uint8_t f = FLAG_ONE;
+			uint16_t sp = 0, pc = 0;
+			uint8_t enabled = 0, halted = 0;
+			uint64_t outputs = 0;
+			const uint8_t *background = nullptr;
+			uint16_t addresses[FUZZ_STORES];
+			uint8_t values[FUZZ_STORES];
+			int stores = 0;
+
+			uint8_t read(uint16_t address) const {
+				for (int i = 0; i < stores; i++) {
+					if (addresses[i] == address) {
+						return values[i];
+					}
+				}
+				return background[address];
+			}
+			void write(uint16_t address, uint8_t value) {
+				for (int i = 0; i < stores; i++) {
+					if (addresses[i] == address) {
+						values[i] = value;
+						return;
+					}
+				}
+				addresses[stores] = address;
+				values[stores] = value;
+				stores++;
+			}
+
+			uint16_t pair(int rp) const {
+				return rp == 3 ? sp : (uint16_t)((reg[rp * 2] << 8) | reg[rp * 2 + 1]);
+			}
+			void setPair(int rp, uint16_t value) {
+				if (rp == 3) {
+					sp = value;
+				} else {
+					reg[rp * 2] = value >> 8;
+					reg[rp * 2 + 1] = value & 0xFF;
+				}
+			}
+			uint8_t get(int r) const {
+				return r == 6 ? read(pair(2)) : reg[r];
+			}
+			void set(int r, uint8_t value) {
+				if (r == 6) {
+					write(pair(2), value);
+				} else {
+					reg[r] = value;
+				}
+			}
+			void push(uint16_t value) {
+				sp -= 2;
+				write((uint16_t)(sp + 1), value >> 8);
+				write(sp, value & 0xFF);
+			}
+			uint16_t pop() {
+				uint16_t value = read(sp) | (read((uint16_t)(sp + 1)) << 8);
+				sp += 2;
+				return value;
+			}
+			// NZ, Z, NC, C, PO, PE, P, M
+			bool condition(int c) const {
+				const uint8_t bits[] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+				return ((f & bits[c >> 1]) != 0) == ((c & 1) != 0);
+			}
+			void setFlags(uint8_t result, bool ac, bool cy) {
+				f = (result & 0x80 ? FLAG_S : 0) | (result == 0 ? FLAG_Z : 0) | (ac ? FLAG_AC : 0)
+					| (evenParity(result) ? FLAG_P : 0) | FLAG_ONE | (cy ? FLAG_CY : 0);
+			}
+
+			// ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP
+			// Subtraction adds the complement, carry out of it is the inverse of the borrow
+			void alu(int operation, uint8_t value) {
+				uint8_t a = reg[7];
+				int cy = f & FLAG_CY;
+				unsigned result;
+				bool halfCarry, carry;
+				switch (operation) {
+				case 0:
+				case 1: {
+					int in = operation == 1 ? cy : 0;
+					result = a + value + in;
+					halfCarry = (a & 0x0F) + (value & 0x0F) + in > 0x0F;
+					carry = result > 0xFF;
+					break;
+				}
+				case 2:
+				case 3:
+				case 7: {
+					int in = operation == 3 ? !cy : 1;
+					uint8_t complement = ~value;
+					result = a + complement + in;
+					halfCarry = (a & 0x0F) + (complement & 0x0F) + in > 0x0F;
+					carry = result <= 0xFF;
+					break;
+				}
+				case 4:
+					result = a & value;
+					halfCarry = ((a | value) & 0x08) != 0;
+					carry = false;
+					break;
+				case 5:
+					result = a ^ value;
+					halfCarry = carry = false;
+					break;
+				default:
+					result = a | value;
+					halfCarry = carry = false;
+					break;
+				}
+				setFlags(result & 0xFF, halfCarry, carry);
+				if (operation != 7) {
+					reg[7] = result & 0xFF;
+				}
+			}
+
+			void step() {
+				uint8_t op = read(pc);
+				const referenceOp &o = referenceTable[op];
+				uint16_t word = read((uint16_t)(pc + 1)) | (read((uint16_t)(pc + 2)) << 8);
+				uint8_t byte = word & 0xFF;
+				int rp = o.x >> 1;
+				pc += o.length;
+				switch (o.kind) {
+				case REF_NOP:
+					break;
+				case REF_LXI:
+					setPair(rp, word);
+					break;
+				case REF_DAD: {
+					uint32_t result = pair(2) + pair(rp);
+					setPair(2, (uint16_t)result);
+					f = (f & ~FLAG_CY) | (result > 0xFFFF ? FLAG_CY : 0);
+					break;
+				}
+				case REF_STAX:
+					write(pair(rp), reg[7]);
+					break;
+				case REF_LDAX:
+					reg[7] = read(pair(rp));
+					break;
+				case REF_SHLD:
+					write(word, reg[5]);
+					write((uint16_t)(word + 1), reg[4]);
+					break;
+				case REF_LHLD:
+					reg[5] = read(word);
+					reg[4] = read((uint16_t)(word + 1));
+					break;
+				case REF_STA:
+					write(word, reg[7]);
+					break;
+				case REF_LDA:
+					reg[7] = read(word);
+					break;
+				case REF_INX:
+					setPair(rp, pair(rp) + 1);
+					break;
+				case REF_DCX:
+					setPair(rp, pair(rp) - 1);
+					break;
+				case REF_INR: {
+					uint8_t result = get(o.x) + 1;
+					setFlags(result, (result & 0x0F) == 0, (f & FLAG_CY) != 0);
+					set(o.x, result);
+					break;
+				}
+				case REF_DCR: {
+					uint8_t result = get(o.x) - 1;
+					setFlags(result, (result & 0x0F) != 0x0F, (f & FLAG_CY) != 0);
+					set(o.x, result);
+					break;
+				}
+				case REF_MVI:
+					set(o.x, byte);
+					break;
+				case REF_ROTATE: {
+					uint8_t a = reg[7], cy = f & FLAG_CY;
+					switch (o.x) {
+					case 0: // RLC
+						cy = a >> 7;
+						reg[7] = (a << 1) | cy;
+						break;
+					case 1: // RRC
+						cy = a & 1;
+						reg[7] = (a >> 1) | (cy << 7);
+						break;
+					case 2: // RAL
+						reg[7] = (a << 1) | cy;
+						cy = a >> 7;
+						break;
+					default: // RAR
+						reg[7] = (a >> 1) | (cy << 7);
+						cy = a & 1;
+						break;
+					}
+					f = (f & ~FLAG_CY) | cy;
+					break;
+				}
+				case REF_DAA: {
+					uint8_t a = reg[7], correction = 0;
+					bool cy = (f & FLAG_CY) != 0;
+					if ((f & FLAG_AC) || (a & 0x0F) > 9) {
+						correction |= 0x06;
+					}
+					if (cy || (a >> 4) > 9 || ((a >> 4) >= 9 && (a & 0x0F) > 9)) {
+						correction |= 0x60;
+						cy = true;
+					}
+					reg[7] = a + correction;
+					setFlags(reg[7], (a & 0x0F) + (correction & 0x0F) > 0x0F, cy);
+					break;
+				}
+				case REF_CMA:
+					reg[7] = ~reg[7];
+					break;
+				case REF_STC:
+					f |= FLAG_CY;
+					break;
+				case REF_CMC:
+					f ^= FLAG_CY;
+					break;
+				case REF_MOV:
+					set(o.x, get(o.y));
+					break;
+				case REF_HLT:
+					// PC stays on the HLT until an interrupt
+					halted = 1;
+					pc -= 1;
+					break;
+				case REF_ALU:
+					alu(o.x, get(o.y));
+					break;
+				case REF_ALUI:
+					alu(o.x, byte);
+					break;
+				case REF_RCOND:
+					if (condition(o.x)) {
+						pc = pop();
+					}
+					break;
+				case REF_RET:
+					pc = pop();
+					break;
+				case REF_POP: {
+					uint16_t value = pop();
+					if (rp == 3) {
+						reg[7] = value >> 8;
+						f = (value & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_ONE;
+					} else {
+						setPair(rp, value);
+					}
+					break;
+				}
+				case REF_PCHL:
+					pc = pair(2);
+					break;
+				case REF_SPHL:
+					sp = pair(2);
+					break;
+				case REF_JCOND:
+					if (condition(o.x)) {
+						pc = word;
+					}
+					break;
+				case REF_JMP:
+					pc = word;
+					break;
+				case REF_OUT:
+					outputs = fuzzOutput(outputs, byte, reg[7]);
+					break;
+				case REF_IN:
+					reg[7] = fuzzInput(byte);
+					break;
+				case REF_XTHL: {
+					uint8_t l = read(sp), h = read((uint16_t)(sp + 1));
+					write(sp, reg[5]);
+					write((uint16_t)(sp + 1), reg[4]);
+					reg[5] = l;
+					reg[4] = h;
+					break;
+				}
+				case REF_XCHG:
+					std::swap(reg[2], reg[4]);
+					std::swap(reg[3], reg[5]);
+					break;
+				case REF_DI:
+					enabled = 0;
+					break;
+				case REF_EI:
+					enabled = 1;
+					break;
+				case REF_CCOND:
+					if (condition(o.x)) {
+						push(pc);
+						pc = word;
+					}
+					break;
+				case REF_CALL:
+					push(pc);
+					pc = word;
+					break;
+				case REF_PUSH:
+					push(rp == 3 ? (uint16_t)((reg[7] << 8) | f) : pair(rp));
+					break;
+				default: // RST
+					push(pc);
+					pc = o.x * 8;
+					break;
+				}
+			}
+		};
+
+		// splitmix64
+		class fuzzRandom {
+		public:
+			uint64_t seed;
+			fuzzRandom(uint64_t seed) : seed(seed) {}
+			uint64_t next() {
+				uint64_t z = (seed += 0x9E3779B97F4A7C15);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+				return z ^ (z >> 31);
+			}
+			// Register value, a quarter of them from the edges where flags change
+			uint8_t value() {
+				const uint8_t edges[] = { 0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0x99, 0xFF };
+				uint64_t v = next();
+				return (v & 3) == 0 ? edges[(v >> 2) & 7] : (uint8_t)(v >> 8);
+			}
+		};
+
+		fuzzCase makeCase(uint64_t seed, uint64_t index) {
+			fuzzRandom rng(seed ^ (index * 0xD1B54A32D192ED03));
+			fuzzCase c;
+			c.index = index;
+			c.r.a = rng.value();
+			c.r.f = (rng.value() & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_ONE;
+			c.r.b = rng.value();
+			c.r.c = rng.value();
+			c.r.d = rng.value();
+			c.r.e = rng.value();
+			c.r.h = rng.value();
+			c.r.l = rng.value();
+			c.r.sp = (uint16_t)rng.next();
+			c.r.pc = (uint16_t)(FUZZ_CODE_LOW + rng.next() % (FUZZ_CODE_HIGH - FUZZ_CODE_LOW));
+			c.enabled = rng.next() & 1;
+			c.length = 1 + (int)(rng.next() % FUZZ_MAX_LENGTH);
+			uint16_t starts[FUZZ_MAX_LENGTH];
+			uint16_t address = c.r.pc;
+			for (int i = 0; i < c.length; i++) {
+				uint8_t op = (uint8_t)rng.next();
+				starts[i] = address;
+				address += referenceTable[op].length;
+				c.code[i][0] = op;
+			}
+			for (int i = 0; i < c.length; i++) {
+				uint64_t v = rng.next();
+				c.code[i][1] = (uint8_t)v;
+				c.code[i][2] = (uint8_t)(v >> 8);
+				// Half the jumps and calls stay in the case's own code, the rest go out into the background
+				uint8_t kind = referenceTable[c.code[i][0]].kind;
+				if ((kind == REF_JCOND || kind == REF_JMP || kind == REF_CCOND || kind == REF_CALL) && (v >> 16) & 1) {
+					uint16_t target = starts[(v >> 17) % c.length];
+					c.code[i][1] = target & 0xFF;
+					c.code[i][2] = target >> 8;
+				}
+			}
+			return c;
+		}
+
+		// Background memory, the two bytes past the end mirror the first two
+		std::vector<uint8_t> makeBackground(uint64_t seed) {
+			std::vector<uint8_t> background(0x10000 + 2);
+			fuzzRandom rng(seed);
+			for (size_t i = 0; i < 0x10000; i += 8) {
+				uint64_t v = rng.next();
+				std::memcpy(&background[i], &v, 8);
+			}
+			background[0x10000] = background[0];
+			background[0x10001] = background[1];
+			return background;
+		}
+
+		// Case for the tiered engine whose store writes over a flag setter further on in its own block
+		// An ALU operation, MOV M, r with HL on the later flag setter, then instructions that leave Z, S, P and AC
+		// alone, so if the block ran through the first operation's flags would be dead
+		fuzzCase makeRewriteCase(uint64_t seed, uint64_t index) {
+			const uint8_t keepFlags[] = { 0x00, 0x13, 0x2F, 0x37, 0x3F, 0x41, 0x07, 0x0B }; // NOP INX D CMA STC CMC MOV B, C RLC DCX B
+			fuzzCase c = makeCase(seed, index);
+			fuzzRandom rng(~seed ^ (index * 0xD1B54A32D192ED03));
+			c.length = 4 + (int)(rng.next() % (FUZZ_MAX_LENGTH - 3));
+			int setter = 2 + (int)(rng.next() % (c.length - 3));
+			const uint8_t sources[] = { 0, 1, 2, 3, 7 }; // B C D E A
+			for (int i = 0; i < c.length; i++) {
+				c.code[i][0] = keepFlags[rng.next() & 7];
+			}
+			c.code[0][0] = (uint8_t)(0x80 | (rng.next() & 0x3F));
+			c.code[1][0] = 0x70 | sources[rng.next() % 5];
+			c.code[setter][0] = (uint8_t)(0x80 | (rng.next() & 0x3F));
+			c.code[c.length - 1][0] = 0xF5; // PUSH PSW
+			uint16_t target = c.r.pc + setter;
+			c.r.h = target >> 8;
+			c.r.l = target & 0xFF;
+			return c;
+		}
+
+		// Registers, flags and memory that differ, a first and b second
+		std::string describeStates(state *a, state *b) {
+			std::ostringstream out;
+			out << std::uppercase << std::hex << std::setfill('0');
+			const char *names[] = { "A", "F", "B", "C", "D", "E", "H", "L" };
+			const uint8_t first[] = { a->r.a, flags(a), a->r.b, a->r.c, a->r.d, a->r.e, a->r.h, a->r.l };
+			const uint8_t second[] = { b->r.a, flags(b), b->r.b, b->r.c, b->r.d, b->r.e, b->r.h, b->r.l };
+			for (int r = 0; r < 8; r++) {
+				if (first[r] != second[r]) {
+					out << names[r] << " " << std::setw(2) << (int)first[r] << " vs " << std::setw(2) << (int)second[r] << ", ";
+				}
+			}
+			if (a->r.sp != b->r.sp) {
+				out << "SP " << std::setw(4) << a->r.sp << " vs " << std::setw(4) << b->r.sp << ", ";
+			}
+			if (a->r.pc != b->r.pc) {
+				out << "PC " << std::setw(4) << a->r.pc << " vs " << std::setw(4) << b->r.pc << ", ";
+			}
+			if (a->enabled != b->enabled) {
+				out << "interrupts " << (int)a->enabled << " vs " << (int)b->enabled << ", ";
+			}
+			if (a->halted != b->halted) {
+				out << "halted " << (int)a->halted << " vs " << (int)b->halted << ", ";
+			}
+			for (int i = 0; i < 0x10000; i++) {
+				if (a->memory[i] != b->memory[i]) {
+					out << "memory " << std::setw(4) << i << " " << std::setw(2) << (int)a->memory[i]
+						<< " vs " << std::setw(2) << (int)b->memory[i] << ", ";
+				}
+			}
+			std::string text = out.str();
+			return text.empty() ? text : text.substr(0, text.size() - 2);
+		}
+
+		// How a case or its first steps went
+		class fuzzOutcome {
+		public:
+			bool diverged = false;
+			bool registers = false; // Registers differed after a step, otherwise memory or output did at the end
+			uint8_t opcode = 0; // The step they differed after, or the last step run
+			int steps = 0;
+		};
+
+		class fuzzWorker {
+		public:
+			const std::vector<uint8_t> &background;
+			state s;
+			portBus bus;
+			uint64_t outputs = 0;
+			referenceCpu ref;
+			uint64_t cases = 0;
+			uint64_t instructions = 0;
+			uint64_t divergent = 0;
+			fuzzDivergence found[256];
+
+			fuzzWorker(const std::vector<uint8_t> &background) : background(background) {
+				s.memory = background;
+				// Watched pages tell which pages the case stored to, so only those are compared and put back
+				for (int page = 0; page < 256; page++) {
+					s.pageFlags[page] |= PAGE_WATCH;
+				}
+				for (int port = 0; port < 256; port++) {
+					bus.readers[port] = [](state *, uint8_t port, void *) { return fuzzInput(port); };
+					bus.writers[port] = [](state *, uint8_t port, uint8_t value, void *context) {
+						uint64_t *outputs = (uint64_t *)context;
+						*outputs = fuzzOutput(*outputs, port, value);
+					};
+					bus.writerContexts[port] = &outputs;
+				}
+				s.ports = &bus;
+				ref.background = background.data();
+			}
+
+			// Lay a case out on both sides
+			void load(const fuzzCase &c) {
+				ref.reg[0] = c.r.b;
+				ref.reg[1] = c.r.c;
+				ref.reg[2] = c.r.d;
+				ref.reg[3] = c.r.e;
+				ref.reg[4] = c.r.h;
+				ref.reg[5] = c.r.l;
+				ref.reg[7] = c.r.a;
+				ref.f = (c.r.f & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_ONE;
+				ref.sp = c.r.sp;
+				ref.pc = c.r.pc;
+				ref.enabled = c.enabled;
+				ref.halted = 0;
+				ref.outputs = 0;
+				ref.stores = 0;
+				s.r = c.r;
+				setFlags(&s, c.r.f);
+				s.enabled = c.enabled;
+				s.halted = 0;
+				outputs = 0;
+				uint16_t address = c.r.pc;
+				for (int i = 0; i < c.length; i++) {
+					for (int b = 0; b < referenceTable[c.code[i][0]].length; b++, address++) {
+						ref.write(address, c.code[i][b]);
+						s.memory[address] = c.code[i][b];
+					}
+				}
+			}
+
+			bool sameRegisters() {
+				return s.r.a == ref.reg[7] && flags(&s) == ref.f
+					&& s.r.b == ref.reg[0] && s.r.c == ref.reg[1] && s.r.d == ref.reg[2] && s.r.e == ref.reg[3]
+					&& s.r.h == ref.reg[4] && s.r.l == ref.reg[5] && s.r.sp == ref.sp && s.r.pc == ref.pc
+					&& s.enabled == ref.enabled && s.halted == ref.halted;
+			}
+
+			// Expected contents of a page, the background with the reference's stores on top
+			void expectedPage(int page, uint8_t *expected) const {
+				std::memcpy(expected, &background[page << 8], 0x100);
+				for (int i = 0; i < ref.stores; i++) {
+					if (ref.addresses[i] >> 8 == page) {
+						expected[ref.addresses[i] & 0xFF] = ref.values[i];
+					}
+				}
+			}
+
+			// First page from page on the case stored to, 256 if none, a case only stores to a few
+			int nextWritten(int page) const {
+				for (; page < 256 && (page & 7) != 0; page++) {
+					if (s.writtenPages[page]) {
+						return page;
+					}
+				}
+				for (; page < 256; page += 8) {
+					uint64_t word;
+					std::memcpy(&word, &s.writtenPages[page], 8);
+					if (word != 0) {
+						while (!s.writtenPages[page]) {
+							page++;
+						}
+						return page;
+					}
+				}
+				return 256;
+			}
+
+			bool sameMemory() {
+				if (outputs != ref.outputs) {
+					return false;
+				}
+				uint8_t expected[0x100];
+				for (int page = nextWritten(0); page < 256; page = nextWritten(page + 1)) {
+					expectedPage(page, expected);
+					if (std::memcmp(&s.memory[page << 8], expected, 0x100) != 0) {
+						return false;
+					}
+				}
+				// Stores the emulator left out, the case's code is in both
+				for (int i = 0; i < ref.stores; i++) {
+					if (s.memory[ref.addresses[i]] != ref.values[i]) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			// Put memory back to the background for the next case
+			void restore() {
+				for (int page = nextWritten(0); page < 256; page = nextWritten(page + 1)) {
+					std::memcpy(&s.memory[page << 8], &background[page << 8], 0x100);
+					s.writtenPages[page] = 0;
+					s.pageFlags[page] |= PAGE_WATCH;
+				}
+				s.memory[0x10000] = background[0x10000];
+				s.memory[0x10001] = background[0x10001];
+				for (int i = 0; i < ref.stores; i++) {
+					s.memory[ref.addresses[i]] = background[ref.addresses[i]];
+				}
+			}
+
+			// Run a case on both sides for as many steps as it has instructions, or limit steps,
+			// stopping after the first step whose registers differ
+			// A case stops early on HLT
+			// A report gets the instructions that ran and what differs
+			fuzzOutcome run(const fuzzCase &c, int limit = FUZZ_MAX_LENGTH, fuzzDivergence *report = nullptr) {
+				fuzzOutcome o;
+				load(c);
+				limit = std::min(limit, c.length);
+				while (o.steps < limit) {
+					uint8_t op = ref.read(ref.pc);
+					if (ref.halted) {
+						break;
+					}
+					if (report != nullptr) {
+						list(report->ran);
+					}
+					ref.step();
+					emulate8080(&s);
+					o.steps++;
+					o.opcode = op;
+					if (!sameRegisters()) {
+						o.diverged = o.registers = true;
+						break;
+					}
+				}
+				if (!o.diverged) {
+					o.diverged = !sameMemory();
+				}
+				if (report != nullptr) {
+					report->difference = describe();
+				}
+				restore();
+				return o;
+			}
+
+			// The instruction the reference is about to run, as a listing line
+			void list(std::string &out) const {
+				std::ostringstream line;
+				line << std::uppercase << std::hex << std::setfill('0') << std::setw(4) << ref.pc << " ";
+				uint8_t op = ref.read(ref.pc);
+				for (int b = 0; b < 3; b++) {
+					if (b < referenceTable[op].length) {
+						line << " " << std::setw(2) << (int)ref.read((uint16_t)(ref.pc + b));
+					} else {
+						line << "   ";
+					}
+				}
+				line << "  " << fuzzMnemonic(op) << "\n";
+				out += line.str();
+			}
+
+			// What differs, emulate8080 first and the reference second
+			std::string describe() {
+				std::ostringstream out;
+				out << std::uppercase << std::hex << std::setfill('0');
+				const char *names[] = { "B", "C", "D", "E", "H", "L", "", "A" };
+				const uint8_t values[] = { s.r.b, s.r.c, s.r.d, s.r.e, s.r.h, s.r.l, 0, s.r.a };
+				for (int r = 0; r < 8; r++) {
+					if (r != 6 && values[r] != ref.reg[r]) {
+						out << names[r] << " " << std::setw(2) << (int)values[r] << " vs " << std::setw(2) << (int)ref.reg[r] << ", ";
+					}
+				}
+				if (flags(&s) != ref.f) {
+					out << "F " << std::setw(2) << (int)flags(&s) << " vs " << std::setw(2) << (int)ref.f << ", ";
+				}
+				if (s.r.sp != ref.sp) {
+					out << "SP " << std::setw(4) << s.r.sp << " vs " << std::setw(4) << ref.sp << ", ";
+				}
+				if (s.r.pc != ref.pc) {
+					out << "PC " << std::setw(4) << s.r.pc << " vs " << std::setw(4) << ref.pc << ", ";
+				}
+				if (s.enabled != ref.enabled) {
+					out << "interrupts " << (int)s.enabled << " vs " << (int)ref.enabled << ", ";
+				}
+				if (s.halted != ref.halted) {
+					out << "halted " << (int)s.halted << " vs " << (int)ref.halted << ", ";
+				}
+				if (outputs != ref.outputs) {
+					out << "port output, ";
+				}
+				uint8_t expected[0x100];
+				for (int page = 0; page < 256; page++) {
+					expectedPage(page, expected);
+					for (int i = 0; i < 0x100; i++) {
+						if (s.memory[(page << 8) | i] != expected[i]) {
+							out << "memory " << std::setw(4) << ((page << 8) | i) << " " << std::setw(2) << (int)s.memory[(page << 8) | i]
+								<< " vs " << std::setw(2) << (int)expected[i] << ", ";
+						}
+					}
+				}
+				std::string text = out.str();
+				return text.empty() ? text : text.substr(0, text.size() - 2);
+			}
+
+			// Opcode a diverging case went wrong on
+			// Memory and output are only compared at the end, so for them find the first step they differ after
+			uint8_t culprit(const fuzzCase &c, const fuzzOutcome &o) {
+				if (o.registers) {
+					return o.opcode;
+				}
+				for (int limit = 1; limit < o.steps; limit++) {
+					fuzzOutcome shorter = run(c, limit);
+					if (shorter.diverged) {
+						return shorter.opcode;
+					}
+				}
+				return o.opcode;
+			}
+
+			// Whether a case still diverges on the same opcode
+			bool diverges(const fuzzCase &c, uint8_t opcode) {
+				fuzzOutcome o = run(c);
+				return o.diverged && culprit(c, o) == opcode;
+			}
+
+			// Shrink a diverging case while it keeps diverging on the same opcode, fewer instructions first,
+			// then registers cleared
+			fuzzCase minimize(fuzzCase c, uint8_t opcode) {
+				while (c.length > 1) {
+					fuzzCase shorter = c;
+					shorter.length--;
+					if (!diverges(shorter, opcode)) {
+						break;
+					}
+					c = shorter;
+				}
+				for (int i = c.length - 2; i >= 0; i--) {
+					fuzzCase without = c;
+					std::memmove(without.code[i], without.code[i + 1], (c.length - i - 1) * sizeof(c.code[0]));
+					without.length--;
+					if (diverges(without, opcode)) {
+						c = without;
+					}
+				}
+				uint8_t *fields[] = { &c.r.a, &c.r.b, &c.r.c, &c.r.d, &c.r.e, &c.r.h, &c.r.l };
+				for (uint8_t *field : fields) {
+					uint8_t value = *field;
+					*field = 0;
+					if (!diverges(c, opcode)) {
+						*field = value;
+					}
+				}
+				uint8_t f = c.r.f;
+				c.r.f = FLAG_ONE;
+				if (!diverges(c, opcode)) {
+					c.r.f = f;
+				}
+				return c;
+			}
+
+			void test(const fuzzCase &c) {
+				fuzzOutcome o = run(c);
+				cases++;
+				instructions += o.steps;
+				if (!o.diverged) {
+					return;
+				}
+				divergent++;
+				uint8_t opcode = culprit(c, o);
+				fuzzDivergence &d = found[opcode];
+				if (d.cases++ == 0) {
+					d.opcode = opcode;
+					d.input = minimize(c, opcode);
+					run(d.input, FUZZ_MAX_LENGTH, &d);
+				}
+			}
+		};
+	}
+
+	fuzzStats runFuzz(uint64_t cases, uint64_t seed, unsigned threads) {
+		fuzzStats stats;
+		if (threads == 0) {
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		stats.seed = seed;
+		stats.threads = threads;
+		// Background memory, the two bytes past the end mirror the first two
+		std::vector<uint8_t> background = makeBackground(seed);
+
+		std::vector<std::unique_ptr<fuzzWorker>> workers;
+		for (unsigned i = 0; i < threads; i++) {
+			workers.emplace_back(new fuzzWorker(background));
+		}
+		std::atomic<uint64_t> next(0);
+		auto work = [&](fuzzWorker *w) {
+			for (uint64_t first; (first = next.fetch_add(FUZZ_CHUNK)) < cases;) {
+				uint64_t last = std::min(cases, first + FUZZ_CHUNK);
+				for (uint64_t index = first; index < last; index++) {
+					w->test(makeCase(seed, index));
+				}
+			}
+		};
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> running;
+		for (unsigned i = 1; i < threads; i++) {
+			running.emplace_back(work, workers[i].get());
+		}
+		work(workers[0].get());
+		for (std::thread &t : running) {
+			t.join();
+		}
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		stats.seconds = time.count();
+
+		for (int op = 0; op < 256; op++) {
+			fuzzDivergence merged;
+			for (const std::unique_ptr<fuzzWorker> &w : workers) {
+				const fuzzDivergence &d = w->found[op];
+				if (d.cases > 0 && (merged.cases == 0 || d.input.index < merged.input.index)) {
+					uint64_t total = merged.cases;
+					merged = d;
+					merged.cases += total;
+				} else {
+					merged.cases += d.cases;
+				}
+			}
+			if (merged.cases > 0) {
+				stats.divergences.push_back(merged);
+			}
+		}
+		for (const std::unique_ptr<fuzzWorker> &w : workers) {
+			stats.cases += w->cases;
+			stats.instructions += w->instructions;
+			stats.divergent += w->divergent;
+		}
+		return stats;
+	}
+
+	fuzzStats runJitFuzz(uint64_t cases, uint64_t seed) {
+		fuzzStats stats;
+		stats.seed = seed;
+		stats.threads = 1;
+		std::vector<uint8_t> background = makeBackground(seed);
+		state interpreted, translated;
+		jitCache j(&translated);
+		// Ports read and write as for the reference, each side keeping its own output
+		portBus buses[2];
+		uint64_t outputs[2];
+		state *sides[] = { &interpreted, &translated };
+		for (int side = 0; side < 2; side++) {
+			for (int port = 0; port < 256; port++) {
+				buses[side].readers[port] = [](state *, uint8_t port, void *) { return fuzzInput(port); };
+				buses[side].writers[port] = [](state *, uint8_t port, uint8_t value, void *context) {
+					uint64_t *outputs = (uint64_t *)context;
+					*outputs = fuzzOutput(*outputs, port, value);
+				};
+				buses[side].writerContexts[port] = &outputs[side];
+			}
+			sides[side]->ports = &buses[side];
+		}
+		fuzzDivergence found[256];
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t index = 0; index < cases; index++) {
+			fuzzCase c = (index & 1) ? makeRewriteCase(seed, index) : makeCase(seed, index);
+			outputs[0] = outputs[1] = 0;
+			for (state *s : sides) {
+				s->memory = background;
+				s->r = c.r;
+				setFlags(s, c.r.f);
+				s->enabled = c.enabled;
+				s->eiDelay = 0;
+				s->halted = 0;
+				uint16_t address = c.r.pc;
+				for (int i = 0; i < c.length; i++) {
+					for (int b = 0; b < referenceTable[c.code[i][0]].length; b++, address++) {
+						s->memory[address] = c.code[i][b];
+					}
+				}
+			}
+			j.flushAll(&translated);
+			j.compile(&translated, c.r.pc);
+			int steps = 0;
+			while (steps < c.length && !interpreted.halted) {
+				emulate8080(&interpreted);
+				steps++;
+			}
+			emulateJit(&translated, &j, steps);
+			stats.cases++;
+			stats.instructions += steps;
+			if (sameState(&interpreted, &translated) && interpreted.halted == translated.halted && outputs[0] == outputs[1]) {
+				continue;
+			}
+			stats.divergent++;
+			fuzzDivergence &d = found[c.code[0][0]];
+			if (d.cases++ == 0) {
+				d.opcode = c.code[0][0];
+				d.input = c;
+				std::ostringstream ran;
+				ran << std::uppercase << std::hex << std::setfill('0');
+				uint16_t address = c.r.pc;
+				for (int i = 0; i < c.length; i++) {
+					int length = referenceTable[c.code[i][0]].length;
+					ran << std::setw(4) << address << " ";
+					for (int b = 0; b < 3; b++) {
+						if (b < length) {
+							ran << " " << std::setw(2) << (int)c.code[i][b];
+						} else {
+							ran << "   ";
+						}
+					}
+					ran << "  " << fuzzMnemonic(c.code[i][0]) << "\n";
+					address += length;
+				}
+				d.ran = ran.str();
+				d.difference = describeStates(&interpreted, &translated);
+				if (outputs[0] != outputs[1]) {
+					d.difference += d.difference.empty() ? "port output" : ", port output";
+				}
+			}
+		}
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		stats.seconds = time.count();
+		for (int op = 0; op < 256; op++) {
+			if (found[op].cases > 0) {
+				stats.divergences.push_back(found[op]);
+			}
+		}
+		return stats;
+	}
+
+	std::string fuzzMnemonic(uint8_t opcode) {
+		const char *regs[] = { "B", "C", "D", "E", "H", "L", "M", "A" };
+		const char *pairs[] = { "B", "D", "H", "SP" };
+		const char *stackPairs[] = { "B", "D", "H", "PSW" };
+		const char *alu[] = { "ADD", "ADC", "SUB", "SBB", "ANA", "XRA", "ORA", "CMP" };
+		const char *immediates[] = { "ADI", "ACI", "SUI", "SBI", "ANI", "XRI", "ORI", "CPI" };
+		const char *conditions[] = { "NZ", "Z", "NC", "C", "PO", "PE", "P", "M" };
+		const char *rotates[] = { "RLC", "RRC", "RAL", "RAR" };
+		const referenceOp &o = referenceTable[opcode];
+		std::string rp = pairs[o.x >> 1];
+		switch (o.kind) {
+		case REF_NOP: return "NOP";
+		case REF_LXI: return "LXI " + rp + ", D16";
+		case REF_DAD: return "DAD " + rp;
+		case REF_STAX: return "STAX " + rp;
+		case REF_LDAX: return "LDAX " + rp;
+		case REF_SHLD: return "SHLD adr";
+		case REF_LHLD: return "LHLD adr";
+		case REF_STA: return "STA adr";
+		case REF_LDA: return "LDA adr";
+		case REF_INX: return "INX " + rp;
+		case REF_DCX: return "DCX " + rp;
+		case REF_INR: return std::string("INR ") + regs[o.x];
+		case REF_DCR: return std::string("DCR ") + regs[o.x];
+		case REF_MVI: return std::string("MVI ") + regs[o.x] + ", D8";
+		case REF_ROTATE: return rotates[o.x];
+		case REF_DAA: return "DAA";
+		case REF_CMA: return "CMA";
+		case REF_STC: return "STC";
+		case REF_CMC: return "CMC";
+		case REF_MOV: return std::string("MOV ") + regs[o.x] + ", " + regs[o.y];
+		case REF_HLT: return "HLT";
+		case REF_ALU: return std::string(alu[o.x]) + " " + regs[o.y];
+		case REF_ALUI: return std::string(immediates[o.x]) + " D8";
+		case REF_RCOND: return std::string("R") + conditions[o.x];
+		case REF_RET: return "RET";
+		case REF_POP: return std::string("POP ") + stackPairs[o.x >> 1];
+		case REF_PCHL: return "PCHL";
+		case REF_SPHL: return "SPHL";
+		case REF_JCOND: return std::string("J") + conditions[o.x] + " adr";
+		case REF_JMP: return "JMP adr";
+		case REF_OUT: return "OUT D8";
+		case REF_IN: return "IN D8";
+		case REF_XTHL: return "XTHL";
+		case REF_XCHG: return "XCHG";
+		case REF_DI: return "DI";
+		case REF_EI: return "EI";
+		case REF_CCOND: return std::string("C") + conditions[o.x] + " adr";
+		case REF_CALL: return "CALL adr";
+		case REF_PUSH: return std::string("PUSH ") + stackPairs[o.x >> 1];
+		default: return "RST " + std::to_string(o.x);
+		}
+	}
+
+	void writeDivergence(std::ostream &out, const fuzzDivergence &d) {
+		const fuzzCase &c = d.input;
+		out << std::uppercase << std::hex << std::setfill('0')
+			<< std::setw(2) << (int)d.opcode << " " << fuzzMnemonic(d.opcode) << ": " << std::dec << d.cases << " cases, case " << c.index << "\n"
+			<< std::hex << "  A " << std::setw(2) << (int)c.r.a << " F " << std::setw(2) << (int)c.r.f
+			<< " B " << std::setw(2) << (int)c.r.b << " C " << std::setw(2) << (int)c.r.c
+			<< " D " << std::setw(2) << (int)c.r.d << " E " << std::setw(2) << (int)c.r.e
+			<< " H " << std::setw(2) << (int)c.r.h << " L " << std::setw(2) << (int)c.r.l
+			<< " SP " << std::setw(4) << c.r.sp << " interrupts " << (int)c.enabled << "\n"
+			<< "  code at " << std::setw(4) << c.r.pc << ":";
+		for (int i = 0; i < c.length; i++) {
+			for (int b = 0; b < referenceTable[c.code[i][0]].length; b++) {
+				out << " " << std::setw(2) << (int)c.code[i][b];
+			}
+		}
+		out << "\n";
+		std::istringstream ran(d.ran);
+		for (std::string line; std::getline(ran, line);) {
+			out << "    " << line << "\n";
+		}
+		out << "  " << d.difference << "\n" << std::dec << std::setfill(' ');
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "cpu.h"
+
+namespace Emu8080 {
+	// Differential tester
+	// Random register states and short instruction sequences run on emulate8080 and on a reference
+	// model decoded from the opcode bit fields, written apart from instructions.h
+	// Any difference in registers, flags, interrupt enable, halt, port output or memory is a divergence
+	// Memory is a random background made from the seed and shared by every case, with the case's code on top
+
+	constexpr int FUZZ_MAX_LENGTH = 8; // Instructions in a case
+	// Cases start between these, so their code stays clear of page zero and the end of memory
+	constexpr uint16_t FUZZ_CODE_LOW = 0x0100;
+	constexpr uint16_t FUZZ_CODE_HIGH = 0xFF00;
+
+	// Starting state and code of a case, regenerated from the seed and index
+	class fuzzCase {
+	public:
+		uint64_t index = 0;
+		registers r; // F as laid out in the PSW byte
+		uint8_t enabled = 0;
+		uint8_t code[FUZZ_MAX_LENGTH][3] = {}; // Each instruction with its operands, laid out from r.pc
+		int length = 0; // Instructions
+	};
+
+	// Cases that went wrong on one opcode
+	class fuzzDivergence {
+	public:
+		uint8_t opcode = 0; // Instruction after which the two first differ
+		uint64_t cases = 0;
+		fuzzCase input; // Smallest case found, from the lowest index that diverged
+		std::string ran; // Listing of the instructions input ran, some may be in the background
+		std::string difference; // What differs after input, emulate8080 first then the reference
+	};
+
+	class fuzzStats {
+	public:
+		uint64_t seed = 0;
+		unsigned threads = 0;
+		uint64_t cases = 0;
+		uint64_t instructions = 0; // Run on each side
+		uint64_t divergent = 0; // Cases that diverged
+		double seconds = 0;
+		std::vector<fuzzDivergence> divergences; // By opcode
+		double casesPerSecond() const {
+			return seconds > 0 ? cases / seconds : 0;
+		}
+	};
+
+	// Cases per work item handed to a thread
+	constexpr uint64_t FUZZ_CHUNK = 0x1000;
+
+	// Run cases on every core, 0 threads uses every core
+	// The result doesn't depend on the thread count, each divergence keeps the case with the lowest index
+	fuzzStats runFuzz(uint64_t cases, uint64_t seed, unsigned threads = 0);
+
+	// Differential test the tiered engine against emulate8080, each case translated as one block from its start
+	// Half the cases store over a flag setter further on in their own block, so the block leaves on the store
+	// and the interpreter runs the new code
+	// Divergences are by the case's first opcode, with the difference emulate8080 first then emulateJit
+	fuzzStats runJitFuzz(uint64_t cases, uint64_t seed);
+
+	// Mnemonic of an opcode as the reference model decodes it
+	std::string fuzzMnemonic(uint8_t opcode);
+	// A divergence as a reproducer, the starting registers and code, what ran and what differs
+	void writeDivergence(std::ostream &out, const fuzzDivergence &d);
+}
@@ -0,0 +1,1195 @@
+#pragma once
+
+#include <cstdint>
+#include "cpu.h"
+#include "emulator.h"
+
+namespace Emu8080 {
+	// Instruction handler, executes a single instruction
+	// PC has already been stepped past the instruction and its operands when a handler runs,
+	// so handlers only touch PC for control flow
+	typedef void (*instruction)(state *s, uint8_t *opcode);
+
+	// Handler table indexed by opcode
+	extern const instruction instructionTable[256];
+
+	// Size of each instruction in bytes, including operands
+	constexpr uint8_t instructionLength[256] = {
+		1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 0x00
+		1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 0x10
+		1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 0x20
+		1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 0x30
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x90
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xA0
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xB0
+		1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1, // 0xC0
+		1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, // 0xD0
+		1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1, // 0xE0
+		1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1  // 0xF0
+	};
+
+	// States taken by each instruction, conditional calls and returns at their not taken cost
+	constexpr uint8_t instructionCycles[256] = {
+		4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4, // 0x00
+		4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4, // 0x10
+		4, 10, 16,  5,  5,  5,  7,  4,  4, 10, 16,  5,  5,  5,  7,  4, // 0x20
+		4, 10, 13,  5, 10, 10, 10,  4,  4, 10, 13,  5,  5,  5,  7,  4, // 0x30
+		5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, // 0x40
+		5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, // 0x50
+		5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, // 0x60
+		7,  7,  7,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7,  5, // 0x70
+		4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, // 0x80
+		4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, // 0x90
+		4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, // 0xA0
+		4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, // 0xB0
+		5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10, 10, 11, 17,  7, 11, // 0xC0
+		5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10, 10, 11, 17,  7, 11, // 0xD0
+		5, 10, 10, 18, 11, 11,  7, 11,  5,  5, 10,  4, 11, 17,  7, 11, // 0xE0
+		5, 10, 10,  4, 11, 11,  7, 11,  5,  5, 10,  4, 11, 17,  7, 11  // 0xF0
+	};
+
+	// Extra states when a conditional call or return is taken
+	constexpr uint8_t branchCycles[256] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x00
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x20
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x30
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x40
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x50
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x60
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x70
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x80
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x90
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xA0
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xB0
+		6, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0, // 0xC0
+		6, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0, // 0xD0
+		6, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0, // 0xE0
+		6, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0  // 0xF0
+	};
+
+	// Instructions
+
+	// NOP
+	inline void op00(state *s, uint8_t *opcode) {
+	}
+	// LXI B, D16
+	inline void op01(state *s, uint8_t *opcode) {
+		s->r.bc = opcode[1] | (opcode[2] << 8);
+	}
+	// STAX B
+	inline void op02(state *s, uint8_t *opcode) {
+		write8(s, s->r.bc, s->r.a);
+	}
+	// INX B
+	inline void op03(state *s, uint8_t *opcode) {
+		s->r.bc++;
+	}
+	// INR B
+	inline void op04(state *s, uint8_t *opcode) {
+		add8(s, s->r.b, (uint8_t)1, false);
+	}
+	// DCR B
+	inline void op05(state *s, uint8_t *opcode) {
+		sub8(s, s->r.b, (uint8_t)1, false);
+	}
+	// MVI B, D8
+	inline void op06(state *s, uint8_t *opcode) {
+		s->r.b = opcode[1];
+	}
+	// RLC
+	inline void op07(state *s, uint8_t *opcode) {
+		setCarry(s, (s->r.a >> 7) & 1);
+		s->r.a = (s->r.a << 1) | (s->r.a >> 7);
+	}
+	// -
+	inline void op08(state *s, uint8_t *opcode) {
+	}
+	// DAD B
+	inline void op09(state *s, uint8_t *opcode) {
+		dad(s, s->r.bc);
+	}
+	// LDAX B
+	inline void op0A(state *s, uint8_t *opcode) {
+		s->r.a = s->memory[s->r.bc];
+	}
+	// DCX B
+	inline void op0B(state *s, uint8_t *opcode) {
+		s->r.bc--;
+	}
+	// INR C
+	inline void op0C(state *s, uint8_t *opcode) {
+		add8(s, s->r.c, (uint8_t)1, false);
+	}
+	// DCR C
+	inline void op0D(state *s, uint8_t *opcode) {
+		sub8(s, s->r.c, (uint8_t)1, false);
+	}
+	// MVI C, D8
+	inline void op0E(state *s, uint8_t *opcode) {
+		s->r.c = opcode[1];
+	}
+	// RRC
+	inline void op0F(state *s, uint8_t *opcode) {
+		setCarry(s, s->r.a & 1);
+		s->r.a = (s->r.a >> 1) | (s->r.a << 7);
+	}
+	// -
+	inline void op10(state *s, uint8_t *opcode) {
+	}
+	// LXI D, D16
+	inline void op11(state *s, uint8_t *opcode) {
+		s->r.de = opcode[1] | (opcode[2] << 8);
+	}
+	// STAX D
+	inline void op12(state *s, uint8_t *opcode) {
+		write8(s, s->r.de, s->r.a);
+	}
+	// INX D
+	inline void op13(state *s, uint8_t *opcode) {
+		s->r.de++;
+	}
+	// INR D
+	inline void op14(state *s, uint8_t *opcode) {
+		add8(s, s->r.d, (uint8_t)1, false);
+	}
+	// DCR D
+	inline void op15(state *s, uint8_t *opcode) {
+		sub8(s, s->r.d, (uint8_t)1, false);
+	}
+	// MVI D, D8
+	inline void op16(state *s, uint8_t *opcode) {
+		s->r.d = opcode[1];
+	}
+	// RAL
+	inline void op17(state *s, uint8_t *opcode) {
+		uint8_t cy = carry(s);
+		setCarry(s, (s->r.a >> 7) & 1);
+		s->r.a = (s->r.a << 1) | cy;
+	}
+	// -
+	inline void op18(state *s, uint8_t *opcode) {
+	}
+	// DAD D
+	inline void op19(state *s, uint8_t *opcode) {
+		dad(s, s->r.de);
+	}
+	// LDAX D
+	inline void op1A(state *s, uint8_t *opcode) {
+		s->r.a = s->memory[s->r.de];
+	}
+	// DCX D
+	inline void op1B(state *s, uint8_t *opcode) {
+		s->r.de--;
+	}
+	// INR E
+	inline void op1C(state *s, uint8_t *opcode) {
+		add8(s, s->r.e, (uint8_t)1, false);
+	}
+	// DCR E
+	inline void op1D(state *s, uint8_t *opcode) {
+		sub8(s, s->r.e, (uint8_t)1, false);
+	}
+	// MVI E, D8
+	inline void op1E(state *s, uint8_t *opcode) {
+		s->r.e = opcode[1];
+	}
+	// RAR
+	inline void op1F(state *s, uint8_t *opcode) {
+		uint8_t cy = carry(s);
+		setCarry(s, s->r.a & 1);
+		s->r.a = (s->r.a >> 1) | (cy << 7);
+	}
+	// -
+	inline void op20(state *s, uint8_t *opcode) {
+	}
+	// LXI H, D16
+	inline void op21(state *s, uint8_t *opcode) {
+		s->r.hl = opcode[1] | (opcode[2] << 8);
+	}
+	// SHLD adr
+	inline void op22(state *s, uint8_t *opcode) {
+		uint16_t address = (opcode[2] << 8) | opcode[1];
+		write8(s, address, s->r.l);
+		write8(s, address + 1, s->r.h);
+	}
+	// INX H
+	inline void op23(state *s, uint8_t *opcode) {
+		s->r.hl++;
+	}
+	// INR H
+	inline void op24(state *s, uint8_t *opcode) {
+		add8(s, s->r.h, (uint8_t)1, false);
+	}
+	// DCR H
+	inline void op25(state *s, uint8_t *opcode) {
+		sub8(s, s->r.h, (uint8_t)1, false);
+	}
+	// MVI H, D8
+	inline void op26(state *s, uint8_t *opcode) {
+		s->r.h = opcode[1];
+	}
+	// DAA
+	// Adjusts A to two BCD digits after an addition, the low digit by AC and the high one by CY
+	inline void op27(state *s, uint8_t *opcode) {
+		uint8_t f = flags(s);
+		uint8_t cy = f & FLAG_CY;
+		uint8_t correction = 0;
+		if ((f & FLAG_AC) || (s->r.a & 0x0F) > 9) {
+			correction |= 0x06;
+		}
+		if (cy || s->r.a > 0x99) {
+			correction |= 0x60;
+			cy = FLAG_CY;
+		}
+		// CY is only ever set, never cleared, by the adjustment
+		add8(s, s->r.a, correction, false);
+		setCarry(s, cy);
+	}
+	// -
+	inline void op28(state *s, uint8_t *opcode) {
+	}
+	// DAD H
+	inline void op29(state *s, uint8_t *opcode) {
+		dad(s, s->r.hl);
+	}
+	// LHLD adr
+	inline void op2A(state *s, uint8_t *opcode) {
+		uint16_t address = (opcode[2] << 8) | opcode[1];
+		s->r.l = s->memory[address];
+		s->r.h = s->memory[address + 1]; // The wrap mirror covers 0xFFFF
+	}
+	// DCX H
+	inline void op2B(state *s, uint8_t *opcode) {
+		s->r.hl--;
+	}
+	// INR L
+	inline void op2C(state *s, uint8_t *opcode) {
+		add8(s, s->r.l, (uint8_t)1, false);
+	}
+	// DCR L
+	inline void op2D(state *s, uint8_t *opcode) {
+		sub8(s, s->r.l, (uint8_t)1, false);
+	}
+	// MVI L, D8
+	inline void op2E(state *s, uint8_t *opcode) {
+		s->r.l = opcode[1];
+	}
+	// CMA
+	inline void op2F(state *s, uint8_t *opcode) {
+		s->r.a = ~s->r.a;
+	}
+	// -
+	inline void op30(state *s, uint8_t *opcode) {
+	}
+	// LXI SP, D16
+	inline void op31(state *s, uint8_t *opcode) {
+		s->r.sp = (opcode[2] << 8) | opcode[1];
+	}
+	// STA adr
+	inline void op32(state *s, uint8_t *opcode) {
+		write8(s, (opcode[2] << 8) | opcode[1], s->r.a);
+	}
+	// INX SP
+	inline void op33(state *s, uint8_t *opcode) {
+		s->r.sp++;
+	}
+	// INR M
+	inline void op34(state *s, uint8_t *opcode) {
+		uint8_t value = s->memory[s->r.hl];
+		add8(s, value, (uint8_t)1, false);
+		write8(s, s->r.hl, value);
+	}
+	// DCR M
+	inline void op35(state *s, uint8_t *opcode) {
+		uint8_t value = s->memory[s->r.hl];
+		sub8(s, value, (uint8_t)1, false);
+		write8(s, s->r.hl, value);
+	}
+	// MVI M, D8
+	inline void op36(state *s, uint8_t *opcode) {
+		write8(s, s->r.hl, opcode[1]);
+	}
+	// STC
+	inline void op37(state *s, uint8_t *opcode) {
+		setCarry(s, 1);
+	}
+	// -
+	inline void op38(state *s, uint8_t *opcode) {
+	}
+	// DAD SP
+	inline void op39(state *s, uint8_t *opcode) {
+		dad(s, s->r.sp);
+	}
+	// LDA adr
+	inline void op3A(state *s, uint8_t *opcode) {
+		s->r.a = s->memory[(opcode[2] << 8) | opcode[1]];
+	}
+	// DCX SP
+	inline void op3B(state *s, uint8_t *opcode) {
+		s->r.sp--;
+	}
+	// INR A
+	inline void op3C(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, (uint8_t)1, false);
+	}
+	// DCR A
+	inline void op3D(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, (uint8_t)1, false);
+	}
+	// MVI A, D8
+	inline void op3E(state *s, uint8_t *opcode) {
+		s->r.a = opcode[1];
+	}
+	// CMC
+	inline void op3F(state *s, uint8_t *opcode) {
+		setCarry(s, !carry(s));
+	}
+	// MOV B, B
+	inline void op40(state *s, uint8_t *opcode) {
+		mov8(s->r.b, s->r.b);
+	}
+	// MOV B, C
+	inline void op41(state *s, uint8_t *opcode) {
+		mov8(s->r.b, s->r.c);
+	}
+	// MOV B, D
+	inline void op42(state *s, uint8_t *opcode) {
+		mov8(s->r.b, s->r.d);
+	}
+	// MOV B, E
+	inline void op43(state *s, uint8_t *opcode) {
+		mov8(s->r.b, s->r.e);
+	}
+	// MOV B, H
+	inline void op44(state *s, uint8_t *opcode) {
+		mov8(s->r.b, s->r.h);
+	}
+	// MOV B, L
+	inline void op45(state *s, uint8_t *opcode) {
+		mov8(s->r.b, s->r.l);
+	}
+	// MOV B, M
+	inline void op46(state *s, uint8_t *opcode) {
+		movHL(s, s->r.b, false);
+	}
+	// MOV B, A
+	inline void op47(state *s, uint8_t *opcode) {
+		mov8(s->r.b, s->r.a);
+	}
+	// MOV C, B
+	inline void op48(state *s, uint8_t *opcode) {
+		mov8(s->r.c, s->r.b);
+	}
+	// MOV C, C
+	inline void op49(state *s, uint8_t *opcode) {
+		mov8(s->r.c, s->r.c);
+	}
+	// MOV C, D
+	inline void op4A(state *s, uint8_t *opcode) {
+		mov8(s->r.c, s->r.d);
+	}
+	// MOV C, E
+	inline void op4B(state *s, uint8_t *opcode) {
+		mov8(s->r.c, s->r.e);
+	}
+	// MOV C, H
+	inline void op4C(state *s, uint8_t *opcode) {
+		mov8(s->r.c, s->r.h);
+	}
+	// MOV C, L
+	inline void op4D(state *s, uint8_t *opcode) {
+		mov8(s->r.c, s->r.l);
+	}
+	// MOV C, M
+	inline void op4E(state *s, uint8_t *opcode) {
+		movHL(s, s->r.c, false);
+	}
+	// MOV C, A
+	inline void op4F(state *s, uint8_t *opcode) {
+		mov8(s->r.c, s->r.a);
+	}
+	// MOV D, B
+	inline void op50(state *s, uint8_t *opcode) {
+		mov8(s->r.d, s->r.b);
+	}
+	// MOV D, C
+	inline void op51(state *s, uint8_t *opcode) {
+		mov8(s->r.d, s->r.c);
+	}
+	// MOV D, D
+	inline void op52(state *s, uint8_t *opcode) {
+		mov8(s->r.d, s->r.d);
+	}
+	// MOV D, E
+	inline void op53(state *s, uint8_t *opcode) {
+		mov8(s->r.d, s->r.e);
+	}
+	// MOV D, H
+	inline void op54(state *s, uint8_t *opcode) {
+		mov8(s->r.d, s->r.h);
+	}
+	// MOV D, L
+	inline void op55(state *s, uint8_t *opcode) {
+		mov8(s->r.d, s->r.l);
+	}
+	// MOV D, M
+	inline void op56(state *s, uint8_t *opcode) {
+		movHL(s, s->r.d, false);
+	}
+	// MOV D, A
+	inline void op57(state *s, uint8_t *opcode) {
+		mov8(s->r.d, s->r.a);
+	}
+	// MOV E, B
+	inline void op58(state *s, uint8_t *opcode) {
+		mov8(s->r.e, s->r.b);
+	}
+	// MOV E, C
+	inline void op59(state *s, uint8_t *opcode) {
+		mov8(s->r.e, s->r.c);
+	}
+	// MOV E, D
+	inline void op5A(state *s, uint8_t *opcode) {
+		mov8(s->r.e, s->r.d);
+	}
+	// MOV E, E
+	inline void op5B(state *s, uint8_t *opcode) {
+		mov8(s->r.e, s->r.e);
+	}
+	// MOV E, H
+	inline void op5C(state *s, uint8_t *opcode) {
+		mov8(s->r.e, s->r.h);
+	}
+	// MOV E, L
+	inline void op5D(state *s, uint8_t *opcode) {
+		mov8(s->r.e, s->r.l);
+	}
+	// MOV E, M
+	inline void op5E(state *s, uint8_t *opcode) {
+		movHL(s, s->r.e, false);
+	}
+	// MOV E, A
+	inline void op5F(state *s, uint8_t *opcode) {
+		mov8(s->r.e, s->r.a);
+	}
+	// MOV H, B
+	inline void op60(state *s, uint8_t *opcode) {
+		mov8(s->r.h, s->r.b);
+	}
+	// MOV H, C
+	inline void op61(state *s, uint8_t *opcode) {
+		mov8(s->r.h, s->r.c);
+	}
+	// MOV H, D
+	inline void op62(state *s, uint8_t *opcode) {
+		mov8(s->r.h, s->r.d);
+	}
+	// MOV H, E
+	inline void op63(state *s, uint8_t *opcode) {
+		mov8(s->r.h, s->r.e);
+	}
+	// MOV H, H
+	inline void op64(state *s, uint8_t *opcode) {
+		mov8(s->r.h, s->r.h);
+	}
+	// MOV H, L
+	inline void op65(state *s, uint8_t *opcode) {
+		mov8(s->r.h, s->r.l);
+	}
+	// MOV H, M
+	inline void op66(state *s, uint8_t *opcode) {
+		movHL(s, s->r.h, false);
+	}
+	// MOV H, A
+	inline void op67(state *s, uint8_t *opcode) {
+		mov8(s->r.h, s->r.a);
+	}
+	// MOV L, B
+	inline void op68(state *s, uint8_t *opcode) {
+		mov8(s->r.l, s->r.b);
+	}
+	// MOV L, C
+	inline void op69(state *s, uint8_t *opcode) {
+		mov8(s->r.l, s->r.c);
+	}
+	// MOV L, D
+	inline void op6A(state *s, uint8_t *opcode) {
+		mov8(s->r.l, s->r.d);
+	}
+	// MOV L, E
+	inline void op6B(state *s, uint8_t *opcode) {
+		mov8(s->r.l, s->r.e);
+	}
+	// MOV L, H
+	inline void op6C(state *s, uint8_t *opcode) {
+		mov8(s->r.l, s->r.h);
+	}
+	// MOV L, L
+	inline void op6D(state *s, uint8_t *opcode) {
+		mov8(s->r.l, s->r.l);
+	}
+	// MOV L, M
+	inline void op6E(state *s, uint8_t *opcode) {
+		movHL(s, s->r.l, false);
+	}
+	// MOV L, A
+	inline void op6F(state *s, uint8_t *opcode) {
+		mov8(s->r.l, s->r.a);
+	}
+	// MOV M, B
+	inline void op70(state *s, uint8_t *opcode) {
+		movHL(s, s->r.b, true);
+	}
+	// MOV M, C
+	inline void op71(state *s, uint8_t *opcode) {
+		movHL(s, s->r.c, true);
+	}
+	// MOV M, D
+	inline void op72(state *s, uint8_t *opcode) {
+		movHL(s, s->r.d, true);
+	}
+	// MOV M, E
+	inline void op73(state *s, uint8_t *opcode) {
+		movHL(s, s->r.e, true);
+	}
+	// MOV M, H
+	inline void op74(state *s, uint8_t *opcode) {
+		movHL(s, s->r.h, true);
+	}
+	// MOV M, L
+	inline void op75(state *s, uint8_t *opcode) {
+		movHL(s, s->r.l, true);
+	}
+	// HLT - special
+	// PC stays on the HLT, so engines that don't keep time spin on it until an interrupt steps past
+	inline void op76(state *s, uint8_t *opcode) {
+		s->halted = 1;
+		s->r.pc -= 1;
+	}
+	// MOV M, A
+	inline void op77(state *s, uint8_t *opcode) {
+		movHL(s, s->r.a, true);
+	}
+	// MOV A, B
+	inline void op78(state *s, uint8_t *opcode) {
+		mov8(s->r.a, s->r.b);
+	}
+	// MOV A, C
+	inline void op79(state *s, uint8_t *opcode) {
+		mov8(s->r.a, s->r.c);
+	}
+	// MOV A, D
+	inline void op7A(state *s, uint8_t *opcode) {
+		mov8(s->r.a, s->r.d);
+	}
+	// MOV A, E
+	inline void op7B(state *s, uint8_t *opcode) {
+		mov8(s->r.a, s->r.e);
+	}
+	// MOV A, H
+	inline void op7C(state *s, uint8_t *opcode) {
+		mov8(s->r.a, s->r.h);
+	}
+	// MOV A, L
+	inline void op7D(state *s, uint8_t *opcode) {
+		mov8(s->r.a, s->r.l);
+	}
+	// MOV A, M
+	inline void op7E(state *s, uint8_t *opcode) {
+		movHL(s, s->r.a, false);
+	}
+	// MOV A, A
+	inline void op7F(state *s, uint8_t *opcode) {
+		mov8(s->r.a, s->r.a);
+	}
+	// ADD B
+	inline void op80(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, s->r.b, true);
+	}
+	// ADD C
+	inline void op81(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, s->r.c, true);
+	}
+	// ADD D
+	inline void op82(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, s->r.d, true);
+	}
+	// ADD E
+	inline void op83(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, s->r.e, true);
+	}
+	// ADD H
+	inline void op84(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, s->r.h, true);
+	}
+	// ADD L
+	inline void op85(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, s->r.l, true);
+	}
+	// ADD M
+	inline void op86(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, s->memory[s->r.hl], true);
+	}
+	// ADD A
+	inline void op87(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, s->r.a, true);
+	}
+	// ADC B
+	inline void op88(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, s->r.b, true);
+	}
+	// ADC C
+	inline void op89(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, s->r.c, true);
+	}
+	// ADC D
+	inline void op8A(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, s->r.d, true);
+	}
+	// ADC E
+	inline void op8B(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, s->r.e, true);
+	}
+	// ADC H
+	inline void op8C(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, s->r.h, true);
+	}
+	// ADC L
+	inline void op8D(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, s->r.l, true);
+	}
+	// ADC M
+	inline void op8E(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, s->memory[s->r.hl], true);
+	}
+	// ADC A
+	inline void op8F(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, s->r.a, true);
+	}
+	// SUB B
+	inline void op90(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, s->r.b, true);
+	}
+	// SUB C
+	inline void op91(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, s->r.c, true);
+	}
+	// SUB D
+	inline void op92(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, s->r.d, true);
+	}
+	// SUB E
+	inline void op93(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, s->r.e, true);
+	}
+	// SUB H
+	inline void op94(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, s->r.h, true);
+	}
+	// SUB L
+	inline void op95(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, s->r.l, true);
+	}
+	// SUB M
+	inline void op96(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, s->memory[s->r.hl], true);
+	}
+	// SUB A
+	inline void op97(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, s->r.a, true);
+	}
+	// SBB B
+	inline void op98(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, s->r.b, true);
+	}
+	// SBB C
+	inline void op99(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, s->r.c, true);
+	}
+	// SBB D
+	inline void op9A(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, s->r.d, true);
+	}
+	// SBB E
+	inline void op9B(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, s->r.e, true);
+	}
+	// SBB H
+	inline void op9C(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, s->r.h, true);
+	}
+	// SBB L
+	inline void op9D(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, s->r.l, true);
+	}
+	// SBB M
+	inline void op9E(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, s->memory[s->r.hl], true);
+	}
+	// SBB A
+	inline void op9F(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, s->r.a, true);
+	}
+	// ANA B
+	inline void opA0(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, s->r.b);
+	}
+	// ANA C
+	inline void opA1(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, s->r.c);
+	}
+	// ANA D
+	inline void opA2(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, s->r.d);
+	}
+	// ANA E
+	inline void opA3(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, s->r.e);
+	}
+	// ANA H
+	inline void opA4(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, s->r.h);
+	}
+	// ANA L
+	inline void opA5(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, s->r.l);
+	}
+	// ANA M
+	inline void opA6(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, s->memory[s->r.hl]);
+	}
+	// ANA A
+	inline void opA7(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, s->r.a);
+	}
+	// XRA B
+	inline void opA8(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, s->r.b);
+	}
+	// XRA C
+	inline void opA9(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, s->r.c);
+	}
+	// XRA D
+	inline void opAA(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, s->r.d);
+	}
+	// XRA E
+	inline void opAB(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, s->r.e);
+	}
+	// XRA H
+	inline void opAC(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, s->r.h);
+	}
+	// XRA L
+	inline void opAD(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, s->r.l);
+	}
+	// XRA M
+	inline void opAE(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, s->memory[s->r.hl]);
+	}
+	// XRA A
+	inline void opAF(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, s->r.a);
+	}
+	// ORA B
+	inline void opB0(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, s->r.b);
+	}
+	// ORA C
+	inline void opB1(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, s->r.c);
+	}
+	// ORA D
+	inline void opB2(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, s->r.d);
+	}
+	// ORA E
+	inline void opB3(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, s->r.e);
+	}
+	// ORA H
+	inline void opB4(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, s->r.h);
+	}
+	// ORA L
+	inline void opB5(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, s->r.l);
+	}
+	// ORA M
+	inline void opB6(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, s->memory[s->r.hl]);
+	}
+	// ORA A
+	inline void opB7(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, s->r.a);
+	}
+	// CMP B
+	inline void opB8(state *s, uint8_t *opcode) {
+		cmp(s, s->r.b);
+	}
+	// CMP C
+	inline void opB9(state *s, uint8_t *opcode) {
+		cmp(s, s->r.c);
+	}
+	// CMP D
+	inline void opBA(state *s, uint8_t *opcode) {
+		cmp(s, s->r.d);
+	}
+	// CMP E
+	inline void opBB(state *s, uint8_t *opcode) {
+		cmp(s, s->r.e);
+	}
+	// CMP H
+	inline void opBC(state *s, uint8_t *opcode) {
+		cmp(s, s->r.h);
+	}
+	// CMP L
+	inline void opBD(state *s, uint8_t *opcode) {
+		cmp(s, s->r.l);
+	}
+	// CMP M
+	inline void opBE(state *s, uint8_t *opcode) {
+		cmp(s, s->memory[s->r.hl]);
+	}
+	// CMP A
+	inline void opBF(state *s, uint8_t *opcode) {
+		cmp(s, s->r.a);
+	}
+	// RNZ
+	inline void opC0(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_Z)) {
+			ret(s);
+		}
+	}
+	// POP B
+	inline void opC1(state *s, uint8_t *opcode) {
+		pop(s, s->r.bc);
+	}
+	// JNZ adr
+	inline void opC2(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_Z)) {
+			jump(s, opcode);
+		}
+	}
+	// JMP adr
+	inline void opC3(state *s, uint8_t *opcode) {
+		jump(s, opcode);
+	}
+	// CNZ adr
+	inline void opC4(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_Z)) {
+			call(s, opcode);
+		}
+	}
+	// PUSH B
+	inline void opC5(state *s, uint8_t *opcode) {
+		push(s, s->r.bc);
+	}
+	// ADI D8
+	inline void opC6(state *s, uint8_t *opcode) {
+		add8(s, s->r.a, opcode[1], true);
+	}
+	// RST 0
+	inline void opC7(state *s, uint8_t *opcode) {
+		rst(s, 0x00);
+	}
+	// RZ
+	inline void opC8(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_Z) {
+			ret(s);
+		}
+	}
+	// RET
+	inline void opC9(state *s, uint8_t *opcode) {
+		ret(s);
+	}
+	// JZ adr
+	inline void opCA(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_Z) {
+			jump(s, opcode);
+		}
+	}
+	// JMP adr, undocumented
+	inline void opCB(state *s, uint8_t *opcode) {
+		jump(s, opcode);
+	}
+	// CZ adr
+	inline void opCC(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_Z) {
+			call(s, opcode);
+		}
+	}
+	// CALL adr
+	inline void opCD(state *s, uint8_t *opcode) {
+		call(s, opcode);
+	}
+	// ACI D8
+	inline void opCE(state *s, uint8_t *opcode) {
+		adc(s, s->r.a, opcode[1], true);
+	}
+	// RST 1
+	inline void opCF(state *s, uint8_t *opcode) {
+		rst(s, 0x08);
+	}
+	// RNC
+	inline void opD0(state *s, uint8_t *opcode) {
+		if (!carry(s)) {
+			ret(s);
+		}
+	}
+	// POP D
+	inline void opD1(state *s, uint8_t *opcode) {
+		pop(s, s->r.de);
+	}
+	// JNC adr
+	inline void opD2(state *s, uint8_t *opcode) {
+		if (!carry(s)) {
+			jump(s, opcode);
+		}
+	}
+	// OUT D8, to the device on the port
+	inline void opD3(state *s, uint8_t *opcode) {
+		uint8_t port = opcode[1];
+		if (s->ports == nullptr || s->ports->writers[port] == nullptr) {
+			unimplementedInstruction(*opcode);
+			return;
+		}
+		s->ports->writers[port](s, port, s->r.a, s->ports->writerContexts[port]);
+	}
+	// CNC adr
+	inline void opD4(state *s, uint8_t *opcode) {
+		if (!carry(s)) {
+			call(s, opcode);
+		}
+	}
+	// PUSH D
+	inline void opD5(state *s, uint8_t *opcode) {
+		push(s, s->r.de);
+	}
+	// SUI D8
+	inline void opD6(state *s, uint8_t *opcode) {
+		sub8(s, s->r.a, opcode[1], true);
+	}
+	// RST 2
+	inline void opD7(state *s, uint8_t *opcode) {
+		rst(s, 0x10);
+	}
+	// RC
+	inline void opD8(state *s, uint8_t *opcode) {
+		if (carry(s)) {
+			ret(s);
+		}
+	}
+	// RET, undocumented
+	inline void opD9(state *s, uint8_t *opcode) {
+		ret(s);
+	}
+	// JC adr
+	inline void opDA(state *s, uint8_t *opcode) {
+		if (carry(s)) {
+			jump(s, opcode);
+		}
+	}
+	// IN D8, from the device on the port
+	inline void opDB(state *s, uint8_t *opcode) {
+		uint8_t port = opcode[1];
+		if (s->ports == nullptr || s->ports->readers[port] == nullptr) {
+			unimplementedInstruction(*opcode);
+			return;
+		}
+		s->r.a = s->ports->readers[port](s, port, s->ports->readerContexts[port]);
+	}
+	// CC adr
+	inline void opDC(state *s, uint8_t *opcode) {
+		if (carry(s)) {
+			call(s, opcode);
+		}
+	}
+	// CALL adr, undocumented
+	inline void opDD(state *s, uint8_t *opcode) {
+		call(s, opcode);
+	}
+	// SBI D8
+	inline void opDE(state *s, uint8_t *opcode) {
+		sbb(s, s->r.a, opcode[1], true);
+	}
+	// RST 3
+	inline void opDF(state *s, uint8_t *opcode) {
+		rst(s, 0x18);
+	}
+	// RPO
+	inline void opE0(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_P)) {
+			ret(s);
+		}
+	}
+	// POP H
+	inline void opE1(state *s, uint8_t *opcode) {
+		pop(s, s->r.hl);
+	}
+	// JPO adr
+	inline void opE2(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_P)) {
+			jump(s, opcode);
+		}
+	}
+	// XTHL
+	inline void opE3(state *s, uint8_t *opcode) {
+		// Swap L and SP
+		uint8_t top = s->memory[s->r.sp]; // Save SP
+		write8(s, s->r.sp, s->r.l); // Move L to SP
+		s->r.l = top; // Move prev SP to L
+		// Swap H and SP + 1
+		top = s->memory[s->r.sp + 1]; // Save SP + 1
+		write8(s, s->r.sp + 1, s->r.h); // Move H to SP + 1
+		s->r.h = top; // Move prev SP + 1 to H
+	}
+	// CPO adr
+	inline void opE4(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_P)) {
+			call(s, opcode);
+		}
+	}
+	// PUSH H
+	inline void opE5(state *s, uint8_t *opcode) {
+		push(s, s->r.hl);
+	}
+	// ANI D8
+	inline void opE6(state *s, uint8_t *opcode) {
+		ana(s, s->r.a, opcode[1]);
+	}
+	// RST 4
+	inline void opE7(state *s, uint8_t *opcode) {
+		rst(s, 0x20);
+	}
+	// RPE
+	inline void opE8(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_P) {
+			ret(s);
+		}
+	}
+	// PCHL
+	inline void opE9(state *s, uint8_t *opcode) {
+		s->r.pc = s->r.hl;
+	}
+	// JPE adr
+	inline void opEA(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_P) {
+			jump(s, opcode);
+		}
+	}
+	// XCHG
+	inline void opEB(state *s, uint8_t *opcode) {
+		uint16_t de = s->r.de;
+		s->r.de = s->r.hl;
+		s->r.hl = de;
+	}
+	// CPE adr
+	inline void opEC(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_P) {
+			call(s, opcode);
+		}
+	}
+	// CALL adr, undocumented
+	inline void opED(state *s, uint8_t *opcode) {
+		call(s, opcode);
+	}
+	// XRI D8
+	inline void opEE(state *s, uint8_t *opcode) {
+		xra(s, s->r.a, opcode[1]);
+	}
+	// RST 5
+	inline void opEF(state *s, uint8_t *opcode) {
+		rst(s, 0x28);
+	}
+	// RP
+	inline void opF0(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_S)) {
+			ret(s);
+		}
+	}
+	// POP PSW
+	inline void opF1(state *s, uint8_t *opcode) {
+		s->r.a = s->memory[s->r.sp + 1];
+		setFlags(s, s->memory[s->r.sp]);
+		s->r.sp += 2;
+	}
+	// JP adr
+	inline void opF2(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_S)) {
+			jump(s, opcode);
+		}
+	}
+	// DI - special
+	inline void opF3(state *s, uint8_t *opcode) {
+		s->enabled = 0;
+	}
+	// CP adr
+	inline void opF4(state *s, uint8_t *opcode) {
+		if (!(flags(s) & FLAG_S)) {
+			call(s, opcode);
+		}
+	}
+	// PUSH PSW
+	inline void opF5(state *s, uint8_t *opcode) {
+		flags(s); // Compute any pending flags
+		push(s, s->r.psw);
+	}
+	// ORI D8
+	inline void opF6(state *s, uint8_t *opcode) {
+		ora(s, s->r.a, opcode[1]);
+	}
+	// RST 6
+	inline void opF7(state *s, uint8_t *opcode) {
+		rst(s, 0x30);
+	}
+	// RM
+	inline void opF8(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_S) {
+			ret(s);
+		}
+	}
+	// SPHL
+	inline void opF9(state *s, uint8_t *opcode) {
+		s->r.sp = s->r.hl;
+	}
+	// JM adr
+	inline void opFA(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_S) {
+			jump(s, opcode);
+		}
+	}
+	// EI - special
+	// Takes effect after the next instruction, whichever engine runs that one clears eiDelay
+	inline void opFB(state *s, uint8_t *opcode) {
+		s->enabled = 1;
+		s->eiDelay = 1;
+	}
+	// CM adr
+	inline void opFC(state *s, uint8_t *opcode) {
+		if (flags(s) & FLAG_S) {
+			call(s, opcode);
+		}
+	}
+	// CALL adr, undocumented
+	inline void opFD(state *s, uint8_t *opcode) {
+		call(s, opcode);
+	}
+	// CPI D8
+	inline void opFE(state *s, uint8_t *opcode) {
+		cmp(s, opcode[1]);
+	}
+	// RST 7
+	inline void opFF(state *s, uint8_t *opcode) {
+		rst(s, 0x38);
+	}
+}
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <cstring>
+#include "iolog.h"
+
+namespace Emu8080 {
+	ioRecorder::ioRecorder(const std::string &path) : name(path) {
+		file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			return;
+		}
+		filling.reserve(IO_LOG_BLOCK + 16);
+		full.reserve(IO_LOG_BLOCK + 16);
+		filling.insert(filling.end(), IO_LOG_MAGIC, IO_LOG_MAGIC + sizeof(IO_LOG_MAGIC));
+		writer = std::thread(&ioRecorder::write, this);
+	}
+
+	ioRecorder::~ioRecorder() {
+		if (file == nullptr) {
+			return;
+		}
+		handOff();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			closing = true;
+		}
+		changed.notify_all();
+		writer.join();
+		if (std::fclose(file) != 0 || failed) {
+			std::cout << "Error: Could not write " << name << "\n";
+		}
+	}
+
+	void ioRecorder::handOff() {
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [this] { return full.empty(); });
+		std::swap(filling, full);
+		guard.unlock();
+		changed.notify_all();
+	}
+
+	void ioRecorder::write() {
+		std::vector<uint8_t> writing;
+		writing.reserve(IO_LOG_BLOCK + 16);
+		while (true) {
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [this] { return !full.empty() || closing; });
+				if (full.empty()) {
+					return;
+				}
+				// Leave full empty, with the capacity of the buffer just written
+				std::swap(full, writing);
+			}
+			changed.notify_all();
+			if (std::fwrite(writing.data(), 1, writing.size(), file) != writing.size()) {
+				failed = true;
+			}
+			writing.clear();
+		}
+	}
+
+	ioReplay::ioReplay(const std::string &path) : log(path) {
+		if (!log.valid()) {
+			std::cout << "Error: Could not open " << path << "\n";
+			return;
+		}
+		if (log.size() < sizeof(IO_LOG_MAGIC) || std::memcmp(log.data(), IO_LOG_MAGIC, sizeof(IO_LOG_MAGIC)) != 0) {
+			std::cout << "Error: " << path << " is not an I/O log\n";
+			return;
+		}
+		good = true;
+		at = sizeof(IO_LOG_MAGIC);
+		read();
+	}
+
+	void ioReplay::read() {
+		const uint8_t *bytes = log.data();
+		uint64_t v = 0;
+		int shift = 0;
+		pending = false;
+		while (at < log.size() && shift < 64) {
+			uint8_t b = bytes[at++];
+			v |= (uint64_t)(b & 0x7F) << shift;
+			shift += 7;
+			if (!(b & 0x80)) {
+				kind = v & 1;
+				time += v >> 1;
+				size_t length = kind == IO_LOG_IN ? 2 : 1;
+				if (at + length > log.size()) {
+					break;
+				}
+				std::memcpy(operand, &bytes[at], length);
+				at += length;
+				pending = true;
+				return;
+			}
+		}
+		// Cut short, anything after the last whole record is dropped
+		at = log.size();
+	}
+
+	void ioReplay::scheduleNext() {
+		if (pending && kind == IO_LOG_INTERRUPT && events != nullptr) {
+			events->schedule(time, deliver, this);
+		}
+	}
+
+	void ioReplay::start(scheduler *q) {
+		events = q;
+		scheduleNext();
+	}
+
+	void ioReplay::diverged(uint64_t when, const char *what) {
+		std::cout << "Error: Replay diverged at cycle " << when << ", " << what;
+		if (pending) {
+			std::cout << ", the log has " << (kind == IO_LOG_IN ? "IN" : "an interrupt") << " at cycle " << time << "\n";
+		} else {
+			std::cout << ", the log has ended\n";
+		}
+	}
+
+	bool ioReplay::input(uint64_t when, uint8_t port, uint8_t &value) {
+		if (!pending || kind != IO_LOG_IN || time != when || operand[0] != port) {
+			diverged(when, "IN");
+			return false;
+		}
+		value = operand[1];
+		read();
+		scheduleNext();
+		return true;
+	}
+
+	void ioReplay::deliver(state *s, scheduler *q, uint64_t when, void *context) {
+		ioReplay *r = static_cast<ioReplay *>(context);
+		if (q->now != r->time) {
+			r->diverged(q->now, "an interrupt was due");
+		} else if (!interrupt(s, r->operand[0])) {
+			r->diverged(q->now, "interrupts are disabled");
+		}
+		r->read();
+		r->scheduleNext();
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cpu.h"
+#include "rom.h"
+#include "scheduler.h"
+
+namespace Emu8080 {
+	// I/O log, everything a run takes from outside the guest, so it can be run again without the host
+	// A header, then one record per IN or accepted interrupt in the order they happened:
+	//   varint (cycles since the previous record << 1 | kind), then the port and value for IN or n for RST n
+	// Times are scheduler cycles, the cycle an IN stopped run at or the one an interrupt was dispatched at
+	constexpr char IO_LOG_MAGIC[8] = { '8', '0', '8', '0', 'I', 'O', 'L', '1' };
+	constexpr uint8_t IO_LOG_IN = 0;
+	constexpr uint8_t IO_LOG_INTERRUPT = 1;
+	// Bytes the recorder fills before handing them to its writer thread
+	constexpr size_t IO_LOG_BLOCK = 0x10000;
+
+	// Writes an I/O log while the guest runs
+	// Records are encoded into a buffer, a writer thread streams full buffers to disk
+	class ioRecorder {
+	public:
+		uint64_t records = 0;
+
+		ioRecorder(const std::string &path);
+		// Writes what is left and closes the log
+		~ioRecorder();
+		ioRecorder(const ioRecorder &) = delete;
+		ioRecorder &operator=(const ioRecorder &) = delete;
+
+		// False if the log couldn't be created
+		bool valid() const {
+			return file != nullptr;
+		}
+		// IN from port read value at cycle time
+		void input(uint64_t time, uint8_t port, uint8_t value) {
+			put(time, IO_LOG_IN);
+			filling.push_back(port);
+			filling.push_back(value);
+		}
+		// RST n was accepted at cycle time
+		void interrupt(uint64_t time, uint8_t n) {
+			put(time, IO_LOG_INTERRUPT);
+			filling.push_back(n);
+		}
+
+	private:
+		std::string name;
+		std::FILE *file = nullptr;
+		uint64_t last = 0; // Time of the previous record
+		std::vector<uint8_t> filling; // Being recorded into
+		std::vector<uint8_t> full; // Waiting for the writer, empty once it has taken it
+		std::mutex lock;
+		std::condition_variable changed;
+		bool closing = false;
+		bool failed = false;
+		std::thread writer;
+
+		void put(uint64_t time, uint8_t kind) {
+			if (filling.size() >= IO_LOG_BLOCK) {
+				handOff();
+			}
+			uint64_t v = ((time - last) << 1) | kind;
+			last = time;
+			while (v >= 0x80) {
+				filling.push_back((uint8_t)(v | 0x80));
+				v >>= 7;
+			}
+			filling.push_back((uint8_t)v);
+			records++;
+		}
+		// Give the filled buffer to the writer, only waits if the writer is still on the last one
+		void handOff();
+		void write();
+	};
+
+	// Plays an I/O log back into a run started from the same state as the recorded one
+	// Interrupts are delivered from the log, so the host schedules none of its own
+	class ioReplay {
+	public:
+		ioReplay(const std::string &path);
+
+		// False if the log couldn't be opened or isn't an I/O log
+		bool valid() const {
+			return good;
+		}
+		// Schedule the recorded interrupts on q, one at a time as the run reaches them
+		void start(scheduler *q);
+		// Value the recorded run read from port at cycle time
+		// Returns false if the log holds something else there, the run has gone off the recording
+		bool input(uint64_t time, uint8_t port, uint8_t &value);
+		// Every record has been played
+		bool finished() const {
+			return at >= log.size() && !pending;
+		}
+
+	private:
+		romImage log;
+		bool good = false;
+		scheduler *events = nullptr; // Given to start
+		size_t at = 0; // Offset of the record after next
+		// Next record
+		bool pending = false;
+		uint8_t kind = 0;
+		uint64_t time = 0;
+		uint8_t operand[2] = {};
+
+		// Decode the next record, pending is false at the end of the log
+		void read();
+		// Schedule the next record if it is an interrupt
+		void scheduleNext();
+		// Report where the run left the recording
+		void diverged(uint64_t when, const char *what);
+		static void deliver(state *s, scheduler *q, uint64_t time, void *context);
+	};
+}
@@ -0,0 +1,1239 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "jit.h"
+#include "emulator.h"
+#include "instructions.h"
+
+namespace Emu8080 {
+	// Times a branch target is reached before its block is translated
+	constexpr uint16_t JIT_THRESHOLD = 32;
+	// Longest block in instructions
+	constexpr int JIT_MAX_BLOCK = 32;
+	// Size of the code cache, and the space that must be left before translating another block
+	constexpr size_t JIT_CACHE_SIZE = 16 * 1024 * 1024;
+	constexpr size_t JIT_BLOCK_SPACE = 16 * 1024;
+	// Most cycles one instruction takes, XTHL, translated code is held to as many instructions
+	// as can't run past the cycles left
+	constexpr uint64_t JIT_MAX_CYCLES = 18;
+
+#ifdef EMU8080_JIT_X64
+	namespace {
+		// Host registers
+		enum hostReg : int {
+			RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15
+		};
+		// Guest registers stay in host registers while translated code runs
+		// RAX, RCX and RDX are scratch
+		constexpr int REG_A = RBX;
+		constexpr int REG_B = RBP;
+		constexpr int REG_C = RSI;
+		constexpr int REG_D = RDI;
+		constexpr int REG_E = R8;
+		constexpr int REG_H = R9;
+		constexpr int REG_L = R10;
+		constexpr int REG_SP = R11;
+		constexpr int REG_F = R12; // Z, S, P and AC as laid out in the PSW
+		constexpr int REG_CY = R13; // Carry, 0 or 1, kept apart so it can be set without masking
+		constexpr int REG_STATE = R14;
+		constexpr int REG_MEM = R15;
+		// Host register of each register field of an opcode, M has none
+		constexpr int guestReg[8] = { REG_B, REG_C, REG_D, REG_E, REG_H, REG_L, -1, REG_A };
+
+		// Condition codes
+		constexpr uint8_t CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5;
+		// Opcodes of the r/m32, r32 form of ALU instructions
+		constexpr uint8_t OP_ADD = 0x01, OP_OR = 0x09, OP_AND = 0x21, OP_SUB = 0x29, OP_XOR = 0x31;
+		// Extensions of the immediate forms
+		constexpr int EXT_ADD = 0, EXT_OR = 1, EXT_AND = 4, EXT_SUB = 5, EXT_XOR = 6, EXT_CMP = 7;
+		constexpr int EXT_SHL = 4, EXT_SHR = 5;
+
+		// Offsets of the state fields used by translated code
+		class stateLayout {
+		public:
+			int32_t reg[8]; // By opcode register field, M unused
+			int32_t sp, pc, f;
+			int32_t pageFlags, dirtyPages, codeDirty, budget, cycles;
+		};
+		stateLayout layout;
+
+		int32_t offset(state *s, const void *field) {
+			return (int32_t)((const uint8_t *)field - (const uint8_t *)s);
+		}
+
+		// Minimal x86-64 encoder, writes straight into the code cache
+		class assembler {
+		public:
+			uint8_t *p;
+			assembler(uint8_t *at) : p(at) {}
+
+			void byte(uint8_t b) {
+				*p++ = b;
+			}
+			void dword(uint32_t d) {
+				std::memcpy(p, &d, 4);
+				p += 4;
+			}
+			void qword(uint64_t q) {
+				std::memcpy(p, &q, 8);
+				p += 8;
+			}
+
+			// REX prefix, byteReg forces one so SPL, BPL, SIL and DIL can be used as byte registers
+			void rex(bool w, int reg, int index, int base, bool byteReg = false) {
+				uint8_t r = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+				if (r != 0x40 || byteReg) {
+					byte(r);
+				}
+			}
+			static bool byteReg(int reg) {
+				return reg >= RSP && reg <= RDI;
+			}
+			void modrm(int mod, int reg, int rm) {
+				byte((uint8_t)((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+			}
+			// ModRM, SIB and displacement for [base + index * (1 << scale) + disp], index < 0 for none
+			void mem(int reg, int base, int index, int scale, int32_t disp) {
+				int mod = (disp == 0 && (base & 7) != RBP) ? 0 : (disp >= -128 && disp <= 127 ? 1 : 2);
+				if (index < 0 && (base & 7) != RSP) {
+					modrm(mod, reg, base);
+				} else {
+					modrm(mod, reg, RSP);
+					byte((uint8_t)((scale << 6) | (((index < 0 ? RSP : index) & 7) << 3) | (base & 7)));
+				}
+				if (mod == 1) {
+					byte((uint8_t)disp);
+				} else if (mod == 2) {
+					dword((uint32_t)disp);
+				}
+			}
+
+			// mov dst, src
+			void mov(int dst, int src) {
+				rex(false, src, 0, dst);
+				byte(0x89);
+				modrm(3, src, dst);
+			}
+			void mov64(int dst, int src) {
+				rex(true, src, 0, dst);
+				byte(0x89);
+				modrm(3, src, dst);
+			}
+			// mov dst, imm
+			void movImm(int dst, uint32_t imm) {
+				rex(false, 0, 0, dst);
+				byte(0xB8 + (dst & 7));
+				dword(imm);
+			}
+			void movImm64(int dst, const void *imm) {
+				rex(true, 0, 0, dst);
+				byte(0xB8 + (dst & 7));
+				qword((uint64_t)(uintptr_t)imm);
+			}
+			// op dst, src
+			void alu(uint8_t op, int dst, int src) {
+				rex(false, src, 0, dst);
+				byte(op);
+				modrm(3, src, dst);
+			}
+			// op dst, imm
+			void aluImm(int ext, int dst, int32_t imm) {
+				rex(false, 0, 0, dst);
+				if (imm >= -128 && imm <= 127) {
+					byte(0x83);
+					modrm(3, ext, dst);
+					byte((uint8_t)imm);
+				} else {
+					byte(0x81);
+					modrm(3, ext, dst);
+					dword((uint32_t)imm);
+				}
+			}
+			// shl/shr dst, n
+			void shift(int ext, int dst, uint8_t n) {
+				rex(false, 0, 0, dst);
+				byte(0xC1);
+				modrm(3, ext, dst);
+				byte(n);
+			}
+			void notReg(int dst) {
+				rex(false, 0, 0, dst);
+				byte(0xF7);
+				modrm(3, 2, dst);
+			}
+			// test dst, imm
+			void testImm(int dst, uint32_t imm) {
+				rex(false, 0, 0, dst);
+				byte(0xF7);
+				modrm(3, 0, dst);
+				dword(imm);
+			}
+			void test64(int a, int b) {
+				rex(true, b, 0, a);
+				byte(0x85);
+				modrm(3, b, a);
+			}
+			// movzx dst, src8
+			void movzx8(int dst, int src) {
+				rex(false, dst, 0, src, byteReg(src));
+				byte(0x0F);
+				byte(0xB6);
+				modrm(3, dst, src);
+			}
+			// setcc dst8
+			void setcc(uint8_t cc, int dst) {
+				rex(false, 0, 0, dst, byteReg(dst));
+				byte(0x0F);
+				byte(0x90 + cc);
+				modrm(3, 0, dst);
+			}
+			// movzx dst, byte [base + index + disp]
+			void load8(int dst, int base, int index, int32_t disp) {
+				rex(false, dst, index < 0 ? 0 : index, base);
+				byte(0x0F);
+				byte(0xB6);
+				mem(dst, base, index, 0, disp);
+			}
+			// movzx dst, word [base + disp]
+			void load16(int dst, int base, int32_t disp) {
+				rex(false, dst, 0, base);
+				byte(0x0F);
+				byte(0xB7);
+				mem(dst, base, -1, 0, disp);
+			}
+			// mov dst, qword [base + index * 8]
+			void load64(int dst, int base, int index) {
+				rex(true, dst, index, base);
+				byte(0x8B);
+				mem(dst, base, index, 3, 0);
+			}
+			// mov byte [base + index + disp], src8
+			void store8(int base, int index, int32_t disp, int src) {
+				rex(false, src, index < 0 ? 0 : index, base, byteReg(src));
+				byte(0x88);
+				mem(src, base, index, 0, disp);
+			}
+			// mov word [base + disp], src16
+			void store16(int base, int32_t disp, int src) {
+				byte(0x66);
+				rex(false, src, 0, base);
+				byte(0x89);
+				mem(src, base, -1, 0, disp);
+			}
+			// mov byte [base + index + disp], imm
+			void store8Imm(int base, int index, int32_t disp, uint8_t imm) {
+				rex(false, 0, index < 0 ? 0 : index, base);
+				byte(0xC6);
+				mem(0, base, index, 0, disp);
+				byte(imm);
+			}
+			// test byte [base + index + disp], imm
+			void test8Imm(int base, int index, int32_t disp, uint8_t imm) {
+				rex(false, 0, index < 0 ? 0 : index, base);
+				byte(0xF6);
+				mem(0, base, index, 0, disp);
+				byte(imm);
+			}
+			// cmp byte [base + index + disp], imm
+			void cmp8Imm(int base, int index, int32_t disp, uint8_t imm) {
+				rex(false, 0, index < 0 ? 0 : index, base);
+				byte(0x80);
+				mem(EXT_CMP, base, index, 0, disp);
+				byte(imm);
+			}
+			// op dword [base + disp], imm
+			void alu32MemImm(int ext, int base, int32_t disp, uint32_t imm) {
+				rex(false, 0, 0, base);
+				byte(0x81);
+				mem(ext, base, -1, 0, disp);
+				dword(imm);
+			}
+			void push(int reg) {
+				rex(false, 0, 0, reg);
+				byte(0x50 + (reg & 7));
+			}
+			void pop(int reg) {
+				rex(false, 0, 0, reg);
+				byte(0x58 + (reg & 7));
+			}
+			void jmpReg(int reg) {
+				rex(false, 0, 0, reg);
+				byte(0xFF);
+				modrm(3, 4, reg);
+			}
+			void ret() {
+				byte(0xC3);
+			}
+			void jmp(const uint8_t *target) {
+				byte(0xE9);
+				rel(target);
+			}
+			void jcc(uint8_t cc, const uint8_t *target) {
+				byte(0x0F);
+				byte(0x80 + cc);
+				rel(target);
+			}
+			void rel(const uint8_t *target) {
+				dword((uint32_t)(target - (p + 4)));
+			}
+			// Forward jumps, the returned fixup is resolved with bind
+			uint8_t *jmpForward() {
+				byte(0xE9);
+				dword(0);
+				return p - 4;
+			}
+			uint8_t *jccForward(uint8_t cc) {
+				byte(0x0F);
+				byte(0x80 + cc);
+				dword(0);
+				return p - 4;
+			}
+			void bind(uint8_t *fixup) {
+				uint32_t d = (uint32_t)(p - (fixup + 4));
+				std::memcpy(fixup, &d, 4);
+			}
+		};
+
+		// ALU operations as translated
+		enum aluKind { K_ADD, K_ADC, K_SUB, K_SBB, K_ANA, K_XRA, K_ORA, K_CMP };
+
+		// Instructions the translator handles, the rest end the block and run on the interpreter
+		bool translatable(uint8_t op) {
+			switch (op) {
+			case 0x27: // DAA
+			case 0x76: // HLT
+			case 0xD3: // OUT
+			case 0xDB: // IN
+			case 0xE3: // XTHL
+			case 0xF1: // POP PSW
+			case 0xF3: // DI
+			case 0xF5: // PUSH PSW
+			case 0xFB: // EI
+				return false;
+			default:
+				return true;
+			}
+		}
+		// Jumps, calls, returns and restarts end a block
+		bool endsBlock(uint8_t op) {
+			if (op < 0xC0) {
+				return false;
+			}
+			switch (op & 0x07) {
+			case 0x0: // Rcc
+			case 0x2: // Jcc
+			case 0x4: // Ccc
+			case 0x7: // RST
+				return true;
+			default:
+				// JMP, RET, CALL, PCHL and the undocumented aliases of the first three
+				return op == 0xC3 || op == 0xCB || op == 0xC9 || op == 0xD9 || (op & 0xCF) == 0xCD || op == 0xE9;
+			}
+		}
+		// Writes Z, S, P and AC
+		bool writesFlags(uint8_t op) {
+			return (op >= 0x80 && op < 0xC0)
+				|| (op < 0x40 && ((op & 0x07) == 0x04 || (op & 0x07) == 0x05))
+				|| (op >= 0xC0 && (op & 0x07) == 0x06);
+		}
+		// Stores to memory, so a block can leave at it through a store stub or a self-modifying code exit
+		bool storesMemory(uint8_t op) {
+			switch (op) {
+			case 0x02: // STAX B
+			case 0x12: // STAX D
+			case 0x22: // SHLD
+			case 0x32: // STA
+			case 0x34: // INR M
+			case 0x35: // DCR M
+			case 0x36: // MVI M
+			case 0xE3: // XTHL
+				return true;
+			}
+			if (op >= 0x70 && op < 0x78) {
+				return op != 0x76; // MOV M, r
+			}
+			// Ccc, RST, PUSH and CALL with its aliases
+			return op >= 0xC0 && ((op & 0x07) == 0x4 || (op & 0x07) == 0x7 || (op & 0xCF) == 0xC5 || (op & 0xCF) == 0xCD);
+		}
+		// Reads Z, S or P
+		bool readsFlags(uint8_t op) {
+			if (op < 0xC0) {
+				return false;
+			}
+			int kind = op & 0x07;
+			int cond = (op >> 3) & 0x07;
+			return (kind == 0x0 || kind == 0x2 || kind == 0x4) && cond != 2 && cond != 3;
+		}
+
+		// One decoded instruction of a block
+		class decodedInstruction {
+		public:
+			uint16_t pc;
+			uint8_t bytes[3];
+			uint8_t length;
+			bool flagsLive; // Z, S, P and AC it writes are read before being overwritten
+		};
+
+		// Translates one block
+		class blockCompiler {
+		public:
+			assembler a;
+			const uint8_t *exitRoutine;
+			const uint8_t *dispatchRoutine;
+			// Stores to a page with attributes
+			// The stub marks a code page dirty and resumes, anything else leaves before the store for the interpreter's busWrite
+			class storeStub {
+			public:
+				uint8_t *fixup;
+				uint8_t *resume;
+				uint16_t pc; // Instruction doing the store, run again by the interpreter
+				uint32_t refund;
+				uint32_t cycleRefund;
+			};
+			std::vector<storeStub> storeStubs;
+			// Instruction being translated
+			uint16_t instructionPc = 0;
+			uint32_t instructionRefund = 0;
+			uint32_t instructionCycleRefund = 0;
+			// Leave after an instruction that dirtied translated code
+			class smcExit {
+			public:
+				uint8_t *fixup;
+				uint16_t pc;
+				uint32_t refund;
+				uint32_t cycleRefund;
+			};
+			std::vector<smcExit> smcExits;
+			bool stored = false;
+
+			blockCompiler(uint8_t *at, const uint8_t *exit, const uint8_t *dispatch)
+				: a(at), exitRoutine(exit), dispatchRoutine(dispatch) {}
+
+			// dst = hi << 8 | lo
+			void pairTo(int dst, int hi, int lo) {
+				a.mov(dst, hi);
+				a.shift(EXT_SHL, dst, 8);
+				a.alu(OP_OR, dst, lo);
+			}
+			// hi = (v >> 8) & 0xFF, lo = v & 0xFF
+			void pairFrom(int hi, int lo, int v) {
+				a.movzx8(lo, v);
+				a.mov(hi, v);
+				a.shift(EXT_SHR, hi, 8);
+				a.aluImm(EXT_AND, hi, 0xFF);
+			}
+			// Store src8 at the address in ECX, pages with attributes go through a stub first
+			// Stores come before any register update of an instruction, so leaving at one and running the whole
+			// instruction again on the interpreter is safe
+			void store(int src) {
+				checkPage();
+				a.store8(REG_MEM, RCX, 0, src);
+			}
+			void storeImm(uint8_t imm) {
+				checkPage();
+				a.store8Imm(REG_MEM, RCX, 0, imm);
+			}
+			void checkPage() {
+				a.mov(RDX, RCX);
+				a.shift(EXT_SHR, RDX, 8);
+				a.cmp8Imm(REG_STATE, RDX, layout.pageFlags, 0);
+				storeStub stub;
+				stub.fixup = a.jccForward(CC_NE);
+				stub.resume = a.p;
+				stub.pc = instructionPc;
+				stub.refund = instructionRefund;
+				stub.cycleRefund = instructionCycleRefund;
+				storeStubs.push_back(stub);
+				stored = true;
+			}
+			// Leave the block if a store of this instruction dirtied translated code
+			// refund and cycleRefund are the instructions and cycles of the block left unrun
+			void checkDirty(uint16_t nextPc, uint32_t refund, uint32_t cycleRefund) {
+				if (!stored) {
+					return;
+				}
+				stored = false;
+				a.cmp8Imm(REG_STATE, -1, layout.codeDirty, 0);
+				smcExit e;
+				e.fixup = a.jccForward(CC_NE);
+				e.pc = nextPc;
+				e.refund = refund;
+				e.cycleRefund = cycleRefund;
+				smcExits.push_back(e);
+			}
+			// Continue at a known guest address
+			void exitTo(uint16_t pc) {
+				a.movImm(RAX, pc);
+				a.jmp(dispatchRoutine);
+			}
+			// ECX = SP - n, wrapped to 16 bits
+			void stackAddress(int n) {
+				a.mov(RCX, REG_SP);
+				a.aluImm(EXT_SUB, RCX, n);
+				a.aluImm(EXT_AND, RCX, 0xFFFF);
+			}
+			void pushPair(int hi, int lo) {
+				stackAddress(1);
+				store(hi);
+				stackAddress(2);
+				store(lo);
+				a.aluImm(EXT_SUB, REG_SP, 2);
+				a.aluImm(EXT_AND, REG_SP, 0xFFFF);
+			}
+			void pushConst(uint16_t v) {
+				stackAddress(1);
+				storeImm(v >> 8);
+				stackAddress(2);
+				storeImm(v & 0xFF);
+				a.aluImm(EXT_SUB, REG_SP, 2);
+				a.aluImm(EXT_AND, REG_SP, 0xFFFF);
+			}
+			// EAX = return address popped from the stack
+			void popPc() {
+				a.load8(RAX, REG_MEM, REG_SP, 0);
+				a.load8(RCX, REG_MEM, REG_SP, 1);
+				a.shift(EXT_SHL, RCX, 8);
+				a.alu(OP_OR, RAX, RCX);
+				a.aluImm(EXT_ADD, REG_SP, 2);
+				a.aluImm(EXT_AND, REG_SP, 0xFFFF);
+			}
+			// Test the condition of a conditional instruction, returns the host condition code that is set when it holds
+			uint8_t condition(uint8_t op) {
+				int cond = (op >> 3) & 0x07;
+				switch (cond) {
+				case 0: // NZ
+				case 1: // Z
+					a.testImm(REG_F, FLAG_Z);
+					return cond == 0 ? CC_E : CC_NE;
+				case 2: // NC
+				case 3: // C
+					a.alu(0x85, REG_CY, REG_CY);
+					return cond == 2 ? CC_E : CC_NE;
+				case 4: // PO
+				case 5: // PE
+					a.testImm(REG_F, FLAG_P);
+					return cond == 4 ? CC_E : CC_NE;
+				default: // P, M
+					a.testImm(REG_F, FLAG_S);
+					return cond == 6 ? CC_E : CC_NE;
+				}
+			}
+
+			// ALU operation of lhs with ECX, result in EAX
+			void alu(int kind, int lhs, bool storeResult, bool checkCY, bool flagsLive) {
+				a.mov(RAX, lhs);
+				switch (kind) {
+				case K_ADC:
+					a.alu(OP_ADD, RAX, REG_CY);
+					// fallthrough
+				case K_ADD:
+					a.alu(OP_ADD, RAX, RCX);
+					break;
+				case K_SBB:
+					a.alu(OP_SUB, RAX, REG_CY);
+					// fallthrough
+				case K_SUB:
+				case K_CMP:
+					a.alu(OP_SUB, RAX, RCX);
+					break;
+				case K_ANA:
+					a.alu(OP_AND, RAX, RCX);
+					break;
+				case K_XRA:
+					a.alu(OP_XOR, RAX, RCX);
+					break;
+				case K_ORA:
+					a.alu(OP_OR, RAX, RCX);
+					break;
+				}
+				if (flagsLive) {
+					int op = (kind == K_ADD || kind == K_ADC) ? ALU_ADD
+						: (kind == K_ANA ? ALU_AND : (kind == K_XRA || kind == K_ORA ? ALU_LOGIC : ALU_SUB));
+					if (op != ALU_LOGIC) {
+						// Half carry table index from bit 3 of lhs, rhs and result
+						a.mov(RDX, lhs);
+						a.aluImm(EXT_AND, RDX, 0x08);
+						a.shift(EXT_SHR, RDX, 1);
+						a.aluImm(EXT_AND, RCX, 0x08);
+						a.shift(EXT_SHR, RCX, 2);
+						a.alu(OP_OR, RDX, RCX);
+						a.mov(RCX, RAX);
+						a.aluImm(EXT_AND, RCX, 0x08);
+						a.shift(EXT_SHR, RCX, 3);
+						a.alu(OP_OR, RDX, RCX);
+						a.movImm64(RCX, flagTables.halfCarry[op]);
+						a.load8(RDX, RCX, RDX, 0);
+					}
+					a.movImm64(RCX, flagTables.szp);
+					a.movzx8(REG_F, RAX);
+					a.load8(REG_F, RCX, REG_F, 0);
+					if (op != ALU_LOGIC) {
+						a.alu(OP_OR, REG_F, RDX);
+					}
+				}
+				if (checkCY) {
+					a.testImm(RAX, 0xFF00);
+					a.setcc(CC_NE, REG_CY);
+					a.movzx8(REG_CY, REG_CY);
+				}
+				if (storeResult) {
+					a.movzx8(lhs, RAX);
+				}
+			}
+
+			// Translate one instruction, remaining is how many instructions of the block follow it
+			// and remainingCycles their cycles
+			void instruction(const decodedInstruction &in, uint32_t remaining, uint32_t remainingCycles) {
+				uint8_t op = in.bytes[0];
+				uint16_t next = in.pc + in.length;
+				instructionPc = in.pc;
+				instructionRefund = remaining + 1;
+				instructionCycleRefund = remainingCycles + instructionCycles[op];
+				uint16_t adr = (in.bytes[2] << 8) | in.bytes[1];
+				int dst = guestReg[(op >> 3) & 0x07];
+				int src = guestReg[op & 0x07];
+
+				// MOV
+				if (op >= 0x40 && op < 0x80) {
+					if ((op & 0x07) == 0x06) { // MOV r, M
+						pairTo(RCX, REG_H, REG_L);
+						a.load8(dst, REG_MEM, RCX, 0);
+					} else if (((op >> 3) & 0x07) == 0x06) { // MOV M, r
+						pairTo(RCX, REG_H, REG_L);
+						store(src);
+					} else if (dst != src) {
+						a.mov(dst, src);
+					}
+					checkDirty(next, remaining, remainingCycles);
+					return;
+				}
+				// ALU A, r / M
+				if (op >= 0x80 && op < 0xC0) {
+					if ((op & 0x07) == 0x06) {
+						pairTo(RCX, REG_H, REG_L);
+						a.load8(RCX, REG_MEM, RCX, 0);
+					} else {
+						a.mov(RCX, src);
+					}
+					int kind = (op >> 3) & 0x07;
+					alu(kind, REG_A, kind != K_CMP, true, in.flagsLive);
+					return;
+				}
+
+				switch (op) {
+				case 0x01: // LXI B, D16
+					a.movImm(REG_C, in.bytes[1]);
+					a.movImm(REG_B, in.bytes[2]);
+					break;
+				case 0x11: // LXI D, D16
+					a.movImm(REG_E, in.bytes[1]);
+					a.movImm(REG_D, in.bytes[2]);
+					break;
+				case 0x21: // LXI H, D16
+					a.movImm(REG_L, in.bytes[1]);
+					a.movImm(REG_H, in.bytes[2]);
+					break;
+				case 0x31: // LXI SP, D16
+					a.movImm(REG_SP, adr);
+					break;
+				case 0x02: // STAX B
+				case 0x12: // STAX D
+					pairTo(RCX, op == 0x02 ? REG_B : REG_D, op == 0x02 ? REG_C : REG_E);
+					store(REG_A);
+					break;
+				case 0x0A: // LDAX B
+				case 0x1A: // LDAX D
+					pairTo(RCX, op == 0x0A ? REG_B : REG_D, op == 0x0A ? REG_C : REG_E);
+					a.load8(REG_A, REG_MEM, RCX, 0);
+					break;
+				case 0x03: // INX B
+				case 0x13: // INX D
+				case 0x23: // INX H
+				case 0x0B: // DCX B
+				case 0x1B: // DCX D
+				case 0x2B: { // DCX H
+					int hi = guestReg[(op >> 3) & 0x06];
+					int lo = guestReg[((op >> 3) & 0x06) + 1];
+					pairTo(RCX, hi, lo);
+					a.aluImm((op & 0x08) ? EXT_SUB : EXT_ADD, RCX, 1);
+					pairFrom(hi, lo, RCX);
+					break;
+				}
+				case 0x33: // INX SP
+				case 0x3B: // DCX SP
+					a.aluImm(op == 0x33 ? EXT_ADD : EXT_SUB, REG_SP, 1);
+					a.aluImm(EXT_AND, REG_SP, 0xFFFF);
+					break;
+				case 0x09: // DAD B
+				case 0x19: // DAD D
+				case 0x29: // DAD H
+				case 0x39: // DAD SP
+					pairTo(RAX, REG_H, REG_L);
+					if (op == 0x39) {
+						a.mov(RCX, REG_SP);
+					} else {
+						pairTo(RCX, guestReg[(op >> 3) & 0x06], guestReg[((op >> 3) & 0x06) + 1]);
+					}
+					a.alu(OP_ADD, RAX, RCX);
+					a.testImm(RAX, 0xFFFF0000);
+					a.setcc(CC_NE, REG_CY);
+					a.movzx8(REG_CY, REG_CY);
+					pairFrom(REG_H, REG_L, RAX);
+					break;
+				case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: // INR r
+				case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: // DCR r
+					a.movImm(RCX, 1);
+					alu((op & 0x01) ? K_SUB : K_ADD, dst, true, false, in.flagsLive);
+					break;
+				case 0x34: // INR M
+				case 0x35: // DCR M
+					pairTo(RCX, REG_H, REG_L);
+					a.load8(RDX, REG_MEM, RCX, 0);
+					a.movImm(RCX, 1);
+					alu(op == 0x35 ? K_SUB : K_ADD, RDX, false, false, in.flagsLive);
+					pairTo(RCX, REG_H, REG_L);
+					store(RAX);
+					break;
+				case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // MVI r, D8
+					a.movImm(dst, in.bytes[1]);
+					break;
+				case 0x36: // MVI M, D8
+					pairTo(RCX, REG_H, REG_L);
+					storeImm(in.bytes[1]);
+					break;
+				case 0x07: // RLC
+					a.mov(REG_CY, REG_A);
+					a.shift(EXT_SHR, REG_CY, 7);
+					a.shift(EXT_SHL, REG_A, 1);
+					a.alu(OP_OR, REG_A, REG_CY);
+					a.aluImm(EXT_AND, REG_A, 0xFF);
+					break;
+				case 0x0F: // RRC
+					a.mov(REG_CY, REG_A);
+					a.aluImm(EXT_AND, REG_CY, 1);
+					a.shift(EXT_SHR, REG_A, 1);
+					a.mov(RCX, REG_CY);
+					a.shift(EXT_SHL, RCX, 7);
+					a.alu(OP_OR, REG_A, RCX);
+					break;
+				case 0x17: // RAL
+					a.mov(RAX, REG_CY);
+					a.mov(REG_CY, REG_A);
+					a.shift(EXT_SHR, REG_CY, 7);
+					a.shift(EXT_SHL, REG_A, 1);
+					a.alu(OP_OR, REG_A, RAX);
+					a.aluImm(EXT_AND, REG_A, 0xFF);
+					break;
+				case 0x1F: // RAR
+					a.mov(RCX, REG_CY);
+					a.shift(EXT_SHL, RCX, 7);
+					a.mov(REG_CY, REG_A);
+					a.aluImm(EXT_AND, REG_CY, 1);
+					a.shift(EXT_SHR, REG_A, 1);
+					a.alu(OP_OR, REG_A, RCX);
+					break;
+				case 0x22: // SHLD adr
+					a.movImm(RCX, adr);
+					store(REG_L);
+					a.movImm(RCX, (uint16_t)(adr + 1));
+					store(REG_H);
+					break;
+				case 0x2A: // LHLD adr, the wrap mirror covers 0xFFFF
+					a.movImm(RCX, adr);
+					a.load8(REG_L, REG_MEM, RCX, 0);
+					a.load8(REG_H, REG_MEM, RCX, 1);
+					break;
+				case 0x2F: // CMA
+					a.notReg(REG_A);
+					a.aluImm(EXT_AND, REG_A, 0xFF);
+					break;
+				case 0x32: // STA adr
+					a.movImm(RCX, adr);
+					store(REG_A);
+					break;
+				case 0x3A: // LDA adr
+					a.load8(REG_A, REG_MEM, -1, adr);
+					break;
+				case 0x37: // STC
+					a.movImm(REG_CY, 1);
+					break;
+				case 0x3F: // CMC
+					a.aluImm(EXT_XOR, REG_CY, 1);
+					break;
+				case 0xC6: // ADI D8
+				case 0xD6: // SUI D8
+				case 0xE6: // ANI D8
+				case 0xEE: // XRI D8
+				case 0xF6: // ORI D8
+				case 0xFE: // CPI D8
+					a.movImm(RCX, in.bytes[1]);
+					alu((op >> 3) & 0x07, REG_A, op != 0xFE, true, in.flagsLive);
+					break;
+				case 0xCE: // ACI D8
+				case 0xDE: // SBI D8
+					a.movImm(RCX, in.bytes[1]);
+					alu(op == 0xCE ? K_ADC : K_SBB, REG_A, true, true, in.flagsLive);
+					break;
+				case 0xC1: // POP B
+				case 0xD1: // POP D
+				case 0xE1: { // POP H
+					int hi = guestReg[(op >> 3) & 0x06];
+					int lo = guestReg[((op >> 3) & 0x06) + 1];
+					a.load8(lo, REG_MEM, REG_SP, 0);
+					a.load8(hi, REG_MEM, REG_SP, 1);
+					a.aluImm(EXT_ADD, REG_SP, 2);
+					a.aluImm(EXT_AND, REG_SP, 0xFFFF);
+					break;
+				}
+				case 0xC5: // PUSH B
+				case 0xD5: // PUSH D
+				case 0xE5: // PUSH H
+					pushPair(guestReg[(op >> 3) & 0x06], guestReg[((op >> 3) & 0x06) + 1]);
+					break;
+				case 0xEB: // XCHG
+					a.mov(RAX, REG_D);
+					a.mov(REG_D, REG_H);
+					a.mov(REG_H, RAX);
+					a.mov(RAX, REG_E);
+					a.mov(REG_E, REG_L);
+					a.mov(REG_L, RAX);
+					break;
+				case 0xF9: // SPHL
+					pairTo(REG_SP, REG_H, REG_L);
+					break;
+				case 0xC3: // JMP adr
+				case 0xCB:
+					exitTo(adr);
+					return;
+				case 0xC9: // RET
+				case 0xD9:
+					popPc();
+					a.jmp(dispatchRoutine);
+					return;
+				case 0xCD: // CALL adr
+				case 0xDD: case 0xED: case 0xFD:
+					pushConst(next);
+					checkDirty(adr, 0, 0);
+					exitTo(adr);
+					return;
+				case 0xE9: // PCHL
+					pairTo(RAX, REG_H, REG_L);
+					a.jmp(dispatchRoutine);
+					return;
+				default:
+					if (op >= 0xC0) {
+						switch (op & 0x07) {
+						case 0x0: { // Rcc
+							uint8_t *skip = a.jccForward(condition(op) ^ 1);
+							popPc();
+							a.alu32MemImm(EXT_ADD, REG_STATE, layout.cycles, branchCycles[op]);
+							a.jmp(dispatchRoutine);
+							a.bind(skip);
+							exitTo(next);
+							return;
+						}
+						case 0x2: { // Jcc
+							uint8_t *skip = a.jccForward(condition(op) ^ 1);
+							exitTo(adr);
+							a.bind(skip);
+							exitTo(next);
+							return;
+						}
+						case 0x4: { // Ccc
+							uint8_t *skip = a.jccForward(condition(op) ^ 1);
+							pushConst(next);
+							a.alu32MemImm(EXT_ADD, REG_STATE, layout.cycles, branchCycles[op]);
+							checkDirty(adr, 0, 0);
+							exitTo(adr);
+							a.bind(skip);
+							exitTo(next);
+							return;
+						}
+						case 0x7: // RST
+							pushConst(next);
+							checkDirty(op & 0x38, 0, 0);
+							exitTo(op & 0x38);
+							return;
+						}
+					}
+					// NOP and unused opcodes
+					break;
+				}
+				checkDirty(next, remaining, remainingCycles);
+			}
+
+			// Out of line code for the stores and exits collected while translating
+			void stubs() {
+				for (auto &stub : storeStubs) {
+					a.bind(stub.fixup);
+					a.test8Imm(REG_STATE, RDX, layout.pageFlags, (uint8_t)~PAGE_CODE);
+					uint8_t *leave = a.jccForward(CC_NE);
+					a.store8Imm(REG_STATE, RDX, layout.dirtyPages, 1);
+					a.store8Imm(REG_STATE, -1, layout.codeDirty, 1);
+					a.jmp(stub.resume);
+					a.bind(leave);
+					a.alu32MemImm(EXT_ADD, REG_STATE, layout.budget, stub.refund);
+					a.alu32MemImm(EXT_SUB, REG_STATE, layout.cycles, stub.cycleRefund);
+					a.movImm(RAX, stub.pc);
+					a.jmp(exitRoutine);
+				}
+				for (auto &e : smcExits) {
+					a.bind(e.fixup);
+					if (e.refund > 0) {
+						a.alu32MemImm(EXT_ADD, REG_STATE, layout.budget, e.refund);
+						a.alu32MemImm(EXT_SUB, REG_STATE, layout.cycles, e.cycleRefund);
+					}
+					a.movImm(RAX, e.pc);
+					a.jmp(exitRoutine);
+				}
+			}
+		};
+	}
+
+	jitCache::jitCache(state *s) : entries(0x10000, nullptr), heat(0x10000, 0) {
+		for (int r = 0; r < 8; r++) {
+			layout.reg[r] = 0;
+		}
+		layout.reg[0] = offset(s, &s->r.b);
+		layout.reg[1] = offset(s, &s->r.c);
+		layout.reg[2] = offset(s, &s->r.d);
+		layout.reg[3] = offset(s, &s->r.e);
+		layout.reg[4] = offset(s, &s->r.h);
+		layout.reg[5] = offset(s, &s->r.l);
+		layout.reg[7] = offset(s, &s->r.a);
+		layout.sp = offset(s, &s->r.sp);
+		layout.pc = offset(s, &s->r.pc);
+		layout.f = offset(s, &s->r.f);
+		layout.pageFlags = offset(s, s->pageFlags);
+		layout.dirtyPages = offset(s, s->dirtyPages);
+		layout.codeDirty = offset(s, &s->codeDirty);
+		layout.budget = offset(s, &s->jitBudget);
+		layout.cycles = offset(s, &s->jitCycles);
+#ifdef _WIN32
+		code = (uint8_t *)VirtualAlloc(nullptr, JIT_CACHE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+		void *m = mmap(nullptr, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		code = m == MAP_FAILED ? nullptr : (uint8_t *)m;
+#endif
+		if (code == nullptr) {
+			std::cout << "Error: Could not allocate the JIT code cache, interpreting only\n";
+			return;
+		}
+		codeSize = JIT_CACHE_SIZE;
+		emitRoutines(s);
+	}
+
+	jitCache::~jitCache() {
+		if (code != nullptr) {
+#ifdef _WIN32
+			VirtualFree(code, 0, MEM_RELEASE);
+#else
+			munmap(code, codeSize);
+#endif
+		}
+	}
+
+	// Routines shared by every block
+	// enter loads the guest registers and jumps into a block, exit stores them back,
+	// dispatch looks up the block for the guest address in EAX and leaves if there is none
+	void jitCache::emitRoutines(state *s) {
+		const int saved[] = { RBX, RBP, RSI, RDI, R12, R13, R14, R15 };
+		assembler a(code);
+
+		// exit, EAX holds the next guest PC
+		exitRoutine = a.p;
+		a.store16(REG_STATE, layout.pc, RAX);
+		for (int r = 0; r < 8; r++) {
+			if (guestReg[r] >= 0) {
+				a.store8(REG_STATE, -1, layout.reg[r], guestReg[r]);
+			}
+		}
+		a.store16(REG_STATE, layout.sp, REG_SP);
+		a.mov(RCX, REG_F);
+		a.alu(OP_OR, RCX, REG_CY);
+		a.aluImm(EXT_OR, RCX, FLAG_ONE);
+		a.store8(REG_STATE, -1, layout.f, RCX);
+		for (int i = 7; i >= 0; i--) {
+			a.pop(saved[i]);
+		}
+		a.ret();
+
+		// dispatch, EAX holds the guest PC
+		dispatchRoutine = a.p;
+		a.movImm64(RDX, entries.data());
+		a.load64(RDX, RDX, RAX);
+		a.test64(RDX, RDX);
+		a.jcc(CC_E, exitRoutine);
+		a.jmpReg(RDX);
+
+		// enter(state, memory, target)
+		enterRoutine = (entryRoutine)a.p;
+		for (int i = 0; i < 8; i++) {
+			a.push(saved[i]);
+		}
+#ifdef _WIN32
+		a.mov64(REG_STATE, RCX);
+		a.mov64(REG_MEM, RDX);
+		a.mov64(RAX, R8);
+#else
+		a.mov64(REG_STATE, RDI);
+		a.mov64(REG_MEM, RSI);
+		a.mov64(RAX, RDX);
+#endif
+		for (int r = 0; r < 8; r++) {
+			if (guestReg[r] >= 0) {
+				a.load8(guestReg[r], REG_STATE, -1, layout.reg[r]);
+			}
+		}
+		a.load16(REG_SP, REG_STATE, layout.sp);
+		a.load8(REG_F, REG_STATE, -1, layout.f);
+		a.mov(REG_CY, REG_F);
+		a.aluImm(EXT_AND, REG_CY, FLAG_CY);
+		a.aluImm(EXT_AND, REG_F, FLAG_S | FLAG_Z | FLAG_AC | FLAG_P);
+		a.jmpReg(RAX);
+
+		routinesSize = codeUsed = a.p - code;
+	}
+
+	bool jitCache::compile(state *s, uint16_t pc) {
+		if (code == nullptr) {
+			return false;
+		}
+		// Decode up to the first instruction that ends the block or can't be translated
+		decodedInstruction decoded[JIT_MAX_BLOCK];
+		int n = 0;
+		uint32_t at = pc;
+		while (n < JIT_MAX_BLOCK) {
+			uint8_t op = s->memory[at];
+			uint8_t length = instructionLength[op];
+			if (!translatable(op) || at + length > 0x10000) {
+				break;
+			}
+			decodedInstruction &in = decoded[n++];
+			in.pc = (uint16_t)at;
+			in.length = length;
+			in.bytes[0] = op;
+			in.bytes[1] = length > 1 ? s->memory[at + 1] : 0;
+			in.bytes[2] = length > 2 ? s->memory[at + 2] : 0;
+			at += length;
+			if (endsBlock(op)) {
+				break;
+			}
+		}
+		if (n == 0) {
+			return false;
+		}
+		// Only compute flags that a later instruction reads, flags are assumed read after the block
+		// A store can leave the block before or after its instruction, and the interpreter then runs memory as it
+		// is now, so the flag setters past it may never run and everything up to it computes its flags
+		bool live = true;
+		for (int i = n - 1; i >= 0; i--) {
+			uint8_t op = decoded[i].bytes[0];
+			if (storesMemory(op)) {
+				live = true;
+			}
+			decoded[i].flagsLive = live;
+			if (writesFlags(op)) {
+				live = false;
+			}
+			if (readsFlags(op) || storesMemory(op)) {
+				live = true;
+			}
+		}
+
+		if (codeSize - codeUsed < JIT_BLOCK_SPACE) {
+			flushAll(s);
+		}
+		uint8_t *start = code + codeUsed;
+		blockCompiler c(start, exitRoutine, dispatchRoutine);
+		// Cycles of the instructions after each one, taken calls and returns add their extra cycles themselves
+		uint32_t after[JIT_MAX_BLOCK];
+		uint32_t blockCycles = 0;
+		for (int i = n - 1; i >= 0; i--) {
+			after[i] = blockCycles;
+			blockCycles += instructionCycles[decoded[i].bytes[0]];
+		}
+		// Leave without running anything if the budget can't cover the whole block
+		c.a.alu32MemImm(EXT_CMP, REG_STATE, layout.budget, n);
+		uint8_t *bail = c.a.jccForward(CC_B);
+		c.a.alu32MemImm(EXT_SUB, REG_STATE, layout.budget, n);
+		c.a.alu32MemImm(EXT_ADD, REG_STATE, layout.cycles, blockCycles);
+		for (int i = 0; i < n; i++) {
+			c.instruction(decoded[i], n - i - 1, after[i]);
+		}
+		if (!endsBlock(decoded[n - 1].bytes[0])) {
+			c.exitTo((uint16_t)at);
+		}
+		c.a.bind(bail);
+		c.a.movImm(RAX, pc);
+		c.a.jmp(exitRoutine);
+		c.stubs();
+		codeUsed = c.a.p - code;
+
+		// Register the block and watch the pages it was decoded from
+		uint32_t index = (uint32_t)blocks.size();
+		block b;
+		b.start = pc;
+		b.end = at;
+		b.valid = true;
+		blocks.push_back(b);
+		for (uint32_t page = pc >> 8; page <= ((at - 1) >> 8); page++) {
+			pageBlocks[page].push_back(index);
+			s->pageFlags[page] |= PAGE_CODE;
+		}
+		entries[pc] = start;
+		compiled++;
+		return true;
+	}
+
+	void jitCache::invalidatePage(state *s, int page) {
+		for (uint32_t index : pageBlocks[page]) {
+			block &b = blocks[index];
+			if (b.valid) {
+				b.valid = false;
+				entries[b.start] = nullptr;
+				heat[b.start] = 0;
+				invalidated++;
+			}
+		}
+		pageBlocks[page].clear();
+		s->pageFlags[page] &= ~PAGE_CODE;
+	}
+
+	void jitCache::flushDirty(state *s) {
+		for (int page = 0; page < 256; page++) {
+			if (s->dirtyPages[page]) {
+				invalidatePage(s, page);
+				s->dirtyPages[page] = 0;
+			}
+		}
+		s->codeDirty = 0;
+	}
+
+	void jitCache::flushAll(state *s) {
+		for (int page = 0; page < 256; page++) {
+			invalidatePage(s, page);
+			s->dirtyPages[page] = 0;
+		}
+		s->codeDirty = 0;
+		blocks.clear();
+		std::fill(heat.begin(), heat.end(), 0);
+		codeUsed = routinesSize;
+	}
+
+	void jitCache::enter(state *s) {
+		enterRoutine(s, s->memory.data(), entries[s->r.pc]);
+	}
+
+	// Count an arrival at a branch target, translating its block once it is hot
+	static void reached(state *s, jitCache *j) {
+		uint16_t pc = s->r.pc;
+		if (j->entries[pc] == nullptr && ++j->heat[pc] >= JIT_THRESHOLD) {
+			if (!j->compile(s, pc)) {
+				j->heat[pc] = 0;
+			}
+		}
+	}
+
+	void emulateJit(state *s, jitCache *j, uint64_t count) {
+		while (count > 0) {
+			if (s->codeDirty) {
+				j->flushDirty(s);
+			}
+			if (j->entries[s->r.pc] != nullptr) {
+				uint32_t budget = count < 0x40000000 ? (uint32_t)count : 0x40000000;
+				s->jitBudget = budget;
+				flags(s); // Translated code reads the F byte directly
+				j->enter(s);
+				uint32_t ran = budget - s->jitBudget;
+				count -= ran;
+				if (ran > 0) {
+					s->eiDelay = 0; // EI is never translated, so it wasn't the last instruction
+					reached(s, j);
+					continue;
+				}
+			}
+			// Interpret one instruction
+			uint8_t *opcode = &s->memory[s->r.pc];
+			uint16_t next = s->r.pc + instructionLength[*opcode];
+			s->r.pc = next;
+			s->eiDelay = 0;
+			instructionTable[*opcode](s, opcode);
+			count--;
+			if (s->r.pc != next) {
+				reached(s, j);
+			}
+		}
+	}
+
+	runResult runJit(state *s, jitCache *j, uint64_t cycleBudget) {
+		runResult result;
+		if (s->halted) {
+			result.reason = STOP_HALT;
+			return result;
+		}
+		while (result.cycles < cycleBudget) {
+			if (s->codeDirty) {
+				j->flushDirty(s);
+			}
+			uint64_t count = std::min<uint64_t>((cycleBudget - result.cycles) / JIT_MAX_CYCLES, 0x4000000);
+			if (count > 0 && j->entries[s->r.pc] != nullptr) {
+				s->jitBudget = (uint32_t)count;
+				s->jitCycles = 0;
+				flags(s); // Translated code reads the F byte directly
+				j->enter(s);
+				uint32_t ran = (uint32_t)count - s->jitBudget;
+				if (ran > 0) {
+					result.cycles += s->jitCycles;
+					result.instructions += ran;
+					s->eiDelay = 0; // EI is never translated, so it wasn't the last instruction
+					reached(s, j);
+					continue;
+				}
+			}
+			// Run one instruction, which stops on I/O and HLT as run does
+			uint16_t next = s->r.pc + instructionLength[s->memory[s->r.pc]];
+			runResult step = run(s, 1);
+			result.cycles += step.cycles;
+			result.instructions += step.instructions;
+			if (step.reason != STOP_BUDGET) {
+				result.reason = step.reason;
+				result.input = step.input;
+				return result;
+			}
+			if (s->r.pc != next) {
+				reached(s, j);
+			}
+		}
+		return result;
+	}
+#else
+	// No translator for this host, the tiered engine only interprets
+	jitCache::jitCache(state *s) : entries(0x10000, nullptr), heat(0x10000, 0) {}
+	jitCache::~jitCache() {}
+	bool jitCache::compile(state *s, uint16_t pc) {
+		return false;
+	}
+	void jitCache::flushDirty(state *s) {
+		s->codeDirty = 0;
+	}
+	void jitCache::flushAll(state *s) {}
+	void jitCache::enter(state *s) {}
+	void jitCache::emitRoutines(state *s) {}
+	void jitCache::invalidatePage(state *s, int page) {}
+
+	void emulateJit(state *s, jitCache *j, uint64_t count) {
+		emulateThreaded(s, count);
+	}
+	runResult runJit(state *s, jitCache *j, uint64_t cycleBudget) {
+		return run(s, cycleBudget);
+	}
+#endif
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "cpu.h"
+#include "emulator.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define EMU8080_JIT_X64
+#endif
+
+namespace Emu8080 {
+	// Translation cache for the tiered engine
+	// Holds the native code of the hot blocks of one CPU, so each state needs its own cache
+	class jitCache {
+	public:
+		// A translated block, covers guest bytes [start, end)
+		class block {
+		public:
+			uint16_t start;
+			uint32_t end;
+			bool valid;
+		};
+
+		// Entry point called from C++, runs translated code starting at target
+		typedef void (*entryRoutine)(state *s, uint8_t *memory, const uint8_t *target);
+
+		std::vector<const uint8_t *> entries; // Native code of the block starting at each guest address
+		std::vector<uint16_t> heat; // Times each branch target has been reached
+		std::vector<block> blocks;
+		std::vector<uint32_t> pageBlocks[256]; // Blocks touching each guest page
+		uint64_t compiled = 0; // Blocks translated so far
+		uint64_t invalidated = 0; // Blocks dropped because their code was written
+
+		jitCache(state *s);
+		~jitCache();
+		jitCache(const jitCache &) = delete;
+		jitCache &operator=(const jitCache &) = delete;
+
+		// Translate the block starting at pc, returns false if its first instruction can't be translated
+		bool compile(state *s, uint16_t pc);
+		// Drop translations of every dirty page
+		void flushDirty(state *s);
+		// Drop every translation
+		void flushAll(state *s);
+		// Run translated code from the block at s->r.pc for at most s->jitBudget instructions
+		void enter(state *s);
+
+	private:
+		uint8_t *code = nullptr; // Executable memory
+		size_t codeSize = 0;
+		size_t codeUsed = 0;
+		size_t routinesSize = 0; // Shared routines at the start of the cache, kept across flushes
+		entryRoutine enterRoutine = nullptr;
+		const uint8_t *exitRoutine = nullptr;
+		const uint8_t *dispatchRoutine = nullptr;
+
+		void emitRoutines(state *s);
+		void invalidatePage(state *s, int page);
+	};
+
+	// Execute count instructions on the tiered engine
+	// Cold code is interpreted, blocks whose entry is reached often enough are translated to native code
+	void emulateJit(state *s, jitCache *j, uint64_t count);
+	// Execute instructions on the tiered engine until the cycle budget runs out or run would stop
+	// Counts cycles and stops like run, cold code runs on run itself, breakpoints are only checked there
+	runResult runJit(state *s, jitCache *j, uint64_t cycleBudget);
+}
@@ -0,0 +1,620 @@
+#include <algorithm>
+#include <cstring>
+#include "lockstep.h"
+#include "instructions.h"
+
+namespace Emu8080 {
+	namespace {
+		constexpr int N = LOCKSTEP_LANES;
+
+		// codePages states
+		constexpr uint8_t CODE_UNKNOWN = 0;
+		constexpr uint8_t CODE_SHARED = 1;
+		constexpr uint8_t CODE_DIFFERS = 2;
+
+		// stepTogether results
+		constexpr int STEP_NONE = 0; // Not run, each lane needs its own handler call
+		constexpr int STEP_SAME = 1; // Run, every lane is still at the same PC
+		constexpr int STEP_SPLIT = 2; // Run, PCs may differ
+
+		// S, Z and P of a result byte, worked out rather than looked up so loops over lanes vectorize
+		constexpr uint8_t szp(uint8_t x) {
+			uint8_t p = x ^ (x >> 4);
+			p ^= p >> 2;
+			p ^= p >> 1;
+			return (x & FLAG_S) | (x == 0 ? FLAG_Z : 0) | ((p & 1) ? 0 : FLAG_P);
+		}
+		constexpr bool szpMatchesTable() {
+			for (int i = 0; i < 256; i++) {
+				if (szp((uint8_t)i) != flagTables.szp[i]) {
+					return false;
+				}
+			}
+			return true;
+		}
+		static_assert(szpMatchesTable(), "szp must agree with the flag tables");
+
+		// ADD to CMP on every lane, operand holds each lane's operand
+		// Half carry is the carry into bit 4, which is what the flag tables work out from bit 3
+		void aluLanes(lockstepPool *p, int kind, const uint8_t *operand) {
+			// Work on a copy, so the compiler needs no alias checks to vectorize the loops
+			uint8_t v[N];
+			std::memcpy(v, operand, N);
+			switch (kind) {
+			case 0: // ADD
+				for (int i = 0; i < N; i++) {
+					uint16_t r = p->a[i] + v[i];
+					p->f[i] = szp((uint8_t)r) | ((p->a[i] ^ v[i] ^ r) & FLAG_AC) | (r >> 8) | FLAG_ONE;
+					p->a[i] = (uint8_t)r;
+				}
+				break;
+			case 1: // ADC
+				for (int i = 0; i < N; i++) {
+					uint16_t r = p->a[i] + v[i] + (p->f[i] & FLAG_CY);
+					p->f[i] = szp((uint8_t)r) | ((p->a[i] ^ v[i] ^ r) & FLAG_AC) | (r >> 8) | FLAG_ONE;
+					p->a[i] = (uint8_t)r;
+				}
+				break;
+			case 2: // SUB
+				for (int i = 0; i < N; i++) {
+					uint16_t r = p->a[i] - v[i];
+					p->f[i] = szp((uint8_t)r) | ((p->a[i] ^ ~v[i] ^ r) & FLAG_AC) | ((r >> 8) & FLAG_CY) | FLAG_ONE;
+					p->a[i] = (uint8_t)r;
+				}
+				break;
+			case 3: // SBB
+				for (int i = 0; i < N; i++) {
+					uint16_t r = p->a[i] - v[i] - (p->f[i] & FLAG_CY);
+					p->f[i] = szp((uint8_t)r) | ((p->a[i] ^ ~v[i] ^ r) & FLAG_AC) | ((r >> 8) & FLAG_CY) | FLAG_ONE;
+					p->a[i] = (uint8_t)r;
+				}
+				break;
+			case 4: // ANA
+				for (int i = 0; i < N; i++) {
+					uint8_t r = p->a[i] & v[i];
+					p->f[i] = szp(r) | (((p->a[i] | v[i]) & 0x08) << 1) | FLAG_ONE;
+					p->a[i] = r;
+				}
+				break;
+			case 5: // XRA
+				for (int i = 0; i < N; i++) {
+					p->a[i] ^= v[i];
+					p->f[i] = szp(p->a[i]) | FLAG_ONE;
+				}
+				break;
+			case 6: // ORA
+				for (int i = 0; i < N; i++) {
+					p->a[i] |= v[i];
+					p->f[i] = szp(p->a[i]) | FLAG_ONE;
+				}
+				break;
+			default: // CMP
+				for (int i = 0; i < N; i++) {
+					uint16_t r = p->a[i] - v[i];
+					p->f[i] = szp((uint8_t)r) | ((p->a[i] ^ ~v[i] ^ r) & FLAG_AC) | ((r >> 8) & FLAG_CY) | FLAG_ONE;
+				}
+				break;
+			}
+		}
+
+		// INR or DCR on every lane, carry is kept
+		void stepLanes(lockstepPool *p, uint8_t *x, bool increment) {
+			uint8_t v[N];
+			std::memcpy(v, x, N);
+			if (increment) {
+				for (int i = 0; i < N; i++) {
+					uint8_t r = v[i] + 1;
+					p->f[i] = szp(r) | ((v[i] ^ r) & FLAG_AC) | (p->f[i] & FLAG_CY) | FLAG_ONE;
+					v[i] = r;
+				}
+			} else {
+				for (int i = 0; i < N; i++) {
+					uint8_t r = v[i] - 1;
+					p->f[i] = szp(r) | ((v[i] ^ r ^ FLAG_AC) & FLAG_AC) | (p->f[i] & FLAG_CY) | FLAG_ONE;
+					v[i] = r;
+				}
+			}
+			std::memcpy(x, v, N);
+		}
+
+		// Flag bit a conditional instruction tests and the value it needs
+		void condition(uint8_t op, uint8_t &bit, uint8_t &want) {
+			const uint8_t flagBits[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+			int cond = (op >> 3) & 0x07;
+			bit = flagBits[cond >> 1];
+			want = cond & 1 ? bit : 0;
+		}
+
+		// Push a return address and jump on one lane
+		void callLane(lockstepPool *p, int lane, uint16_t target, uint16_t next) {
+			state *s = &p->cpus[lane];
+			write8(s, p->sp[lane] - 1, next >> 8);
+			write8(s, p->sp[lane] - 2, next & 0xFF);
+			p->sp[lane] -= 2;
+			p->pc[lane] = target;
+		}
+
+		// Forget whether the pages a lane wrote since the last check are shared
+		void dropWritten(lockstepPool *p, int lane) {
+			state &s = p->cpus[lane];
+			if (!s.codeDirty) {
+				return;
+			}
+			for (int page = 0; page < 256; page++) {
+				if (s.dirtyPages[page]) {
+					s.dirtyPages[page] = 0;
+					p->codePages[page] = CODE_UNKNOWN;
+				}
+			}
+			s.codeDirty = 0;
+		}
+
+		// Check that a page holds the same bytes in every lane, and have stores to it reported
+		bool sharedPage(lockstepPool *p, int page) {
+			if (p->codePages[page] == CODE_UNKNOWN) {
+				const uint8_t *first = &p->cpus[0].memory[page << 8];
+				bool same = true;
+				for (int i = 0; i < N; i++) {
+					p->cpus[i].pageFlags[page] |= PAGE_CODE;
+					if (same && i > 0 && std::memcmp(first, &p->cpus[i].memory[page << 8], 0x100) != 0) {
+						same = false;
+					}
+				}
+				p->codePages[page] = same ? CODE_SHARED : CODE_DIFFERS;
+			}
+			return p->codePages[page] == CODE_SHARED;
+		}
+
+		// Run one instruction for every lane at once, all lanes are at the same PC and see the same bytes there
+		// Register instructions run as loops over the register arrays, loads, stores and stack operations as loops over each lane's memory
+		int stepTogether(lockstepPool *p, uint8_t op, const uint8_t *bytes) {
+			uint8_t *regs[8] = { p->b, p->c, p->d, p->e, p->h, p->l, nullptr, p->a };
+			uint8_t *dst = regs[(op >> 3) & 0x07];
+			uint8_t *src = regs[op & 0x07];
+			uint16_t next = p->pc[0] + instructionLength[op];
+			uint16_t adr = (bytes[2] << 8) | bytes[1];
+			uint8_t v[N];
+			bool stored = false;
+			bool branched = false; // PC is set per lane
+			switch (op) {
+			case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // NOP
+				break;
+			case 0x01: // LXI B, D16
+				std::fill(p->b, p->b + N, bytes[2]);
+				std::fill(p->c, p->c + N, bytes[1]);
+				break;
+			case 0x11: // LXI D, D16
+				std::fill(p->d, p->d + N, bytes[2]);
+				std::fill(p->e, p->e + N, bytes[1]);
+				break;
+			case 0x21: // LXI H, D16
+				std::fill(p->h, p->h + N, bytes[2]);
+				std::fill(p->l, p->l + N, bytes[1]);
+				break;
+			case 0x31: // LXI SP, D16
+				std::fill(p->sp, p->sp + N, adr);
+				break;
+			case 0x03: case 0x13: case 0x23: // INX rp
+			case 0x0B: case 0x1B: case 0x2B: { // DCX rp
+				uint8_t *hi = regs[(op >> 3) & 0x06], *lo = regs[((op >> 3) & 0x06) + 1];
+				uint16_t delta = op & 0x08 ? 0xFFFF : 1;
+				for (int i = 0; i < N; i++) {
+					uint16_t pair = ((hi[i] << 8) | lo[i]) + delta;
+					hi[i] = pair >> 8;
+					lo[i] = pair & 0xFF;
+				}
+				break;
+			}
+			case 0x33: // INX SP
+			case 0x3B: { // DCX SP
+				uint16_t delta = op & 0x08 ? 0xFFFF : 1;
+				for (int i = 0; i < N; i++) {
+					p->sp[i] += delta;
+				}
+				break;
+			}
+			case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: // INR r
+				stepLanes(p, dst, true);
+				break;
+			case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: // DCR r
+				stepLanes(p, dst, false);
+				break;
+			case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // MVI r, D8
+				std::fill(dst, dst + N, bytes[1]);
+				break;
+			case 0x07: // RLC
+				for (int i = 0; i < N; i++) {
+					p->f[i] = (p->f[i] & ~FLAG_CY) | (p->a[i] >> 7);
+					p->a[i] = (p->a[i] << 1) | (p->a[i] >> 7);
+				}
+				break;
+			case 0x0F: // RRC
+				for (int i = 0; i < N; i++) {
+					p->f[i] = (p->f[i] & ~FLAG_CY) | (p->a[i] & 1);
+					p->a[i] = (p->a[i] >> 1) | (p->a[i] << 7);
+				}
+				break;
+			case 0x1F: // RAR
+				for (int i = 0; i < N; i++) {
+					uint8_t cy = p->f[i] & FLAG_CY;
+					p->f[i] = (p->f[i] & ~FLAG_CY) | (p->a[i] & 1);
+					p->a[i] = (p->a[i] >> 1) | (cy << 7);
+				}
+				break;
+			case 0x17: // RAL
+				for (int i = 0; i < N; i++) {
+					uint8_t cy = p->f[i] & FLAG_CY;
+					p->f[i] = (p->f[i] & ~FLAG_CY) | (p->a[i] >> 7);
+					p->a[i] = (p->a[i] << 1) | cy;
+				}
+				break;
+			case 0x09: case 0x19: case 0x29: case 0x39: // DAD rp
+				for (int i = 0; i < N; i++) {
+					uint16_t pair = op == 0x39 ? p->sp[i] : (regs[(op >> 3) & 0x06][i] << 8) | regs[((op >> 3) & 0x06) + 1][i];
+					uint32_t r = (uint32_t)((p->h[i] << 8) | p->l[i]) + pair;
+					p->h[i] = (r >> 8) & 0xFF;
+					p->l[i] = r & 0xFF;
+					p->f[i] = (p->f[i] & ~FLAG_CY) | (r >> 16);
+				}
+				break;
+			case 0x2F: // CMA
+				for (int i = 0; i < N; i++) {
+					p->a[i] = ~p->a[i];
+				}
+				break;
+			case 0x37: // STC
+				for (int i = 0; i < N; i++) {
+					p->f[i] |= FLAG_CY;
+				}
+				break;
+			case 0x3F: // CMC
+				for (int i = 0; i < N; i++) {
+					p->f[i] ^= FLAG_CY;
+				}
+				break;
+			case 0x0A: // LDAX B
+			case 0x1A: // LDAX D
+				for (int i = 0; i < N; i++) {
+					uint8_t *hi = regs[(op >> 3) & 0x06], *lo = regs[((op >> 3) & 0x06) + 1];
+					p->a[i] = p->cpus[i].memory[(hi[i] << 8) | lo[i]];
+				}
+				break;
+			case 0x02: // STAX B
+			case 0x12: // STAX D
+				for (int i = 0; i < N; i++) {
+					uint8_t *hi = regs[(op >> 3) & 0x06], *lo = regs[((op >> 3) & 0x06) + 1];
+					write8(&p->cpus[i], (hi[i] << 8) | lo[i], p->a[i]);
+				}
+				stored = true;
+				break;
+			case 0x3A: // LDA adr
+				for (int i = 0; i < N; i++) {
+					p->a[i] = p->cpus[i].memory[adr];
+				}
+				break;
+			case 0x32: // STA adr
+				for (int i = 0; i < N; i++) {
+					write8(&p->cpus[i], adr, p->a[i]);
+				}
+				stored = true;
+				break;
+			case 0x34: // INR M
+			case 0x35: // DCR M
+				for (int i = 0; i < N; i++) {
+					v[i] = p->cpus[i].memory[(p->h[i] << 8) | p->l[i]];
+				}
+				stepLanes(p, v, op == 0x34);
+				for (int i = 0; i < N; i++) {
+					write8(&p->cpus[i], (p->h[i] << 8) | p->l[i], v[i]);
+				}
+				stored = true;
+				break;
+			case 0x36: // MVI M, D8
+				for (int i = 0; i < N; i++) {
+					write8(&p->cpus[i], (p->h[i] << 8) | p->l[i], bytes[1]);
+				}
+				stored = true;
+				break;
+			case 0xC6: case 0xD6: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // ALU D8
+				std::fill(v, v + N, bytes[1]);
+				aluLanes(p, (op >> 3) & 0x07, v);
+				break;
+			case 0xCE: // ACI D8
+			case 0xDE: // SBI D8
+				std::fill(v, v + N, bytes[1]);
+				aluLanes(p, (op >> 3) & 0x07, v);
+				break;
+			case 0xC3: // JMP adr
+			case 0xCB:
+				std::fill(p->pc, p->pc + N, adr);
+				return STEP_SAME;
+			case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xE2: case 0xEA: case 0xF2: case 0xFA: { // Jcc adr
+				uint8_t bit, want;
+				condition(op, bit, want);
+				for (int i = 0; i < N; i++) {
+					p->pc[i] = (p->f[i] & bit) == want ? adr : next;
+				}
+				return STEP_SPLIT;
+			}
+			case 0xCD: // CALL adr
+			case 0xDD: case 0xED: case 0xFD:
+				for (int i = 0; i < N; i++) {
+					callLane(p, i, adr, next);
+				}
+				stored = true;
+				branched = true;
+				break;
+			case 0xC4: case 0xCC: case 0xD4: case 0xDC: case 0xE4: case 0xEC: case 0xF4: case 0xFC: { // Ccc adr
+				uint8_t bit, want;
+				condition(op, bit, want);
+				for (int i = 0; i < N; i++) {
+					if ((p->f[i] & bit) == want) {
+						callLane(p, i, adr, next);
+					} else {
+						p->pc[i] = next;
+					}
+				}
+				stored = true;
+				branched = true;
+				break;
+			}
+			case 0xC9: // RET
+			case 0xD9:
+				for (int i = 0; i < N; i++) {
+					const uint8_t *m = p->cpus[i].memory.data();
+					p->pc[i] = m[p->sp[i]] | (m[p->sp[i] + 1] << 8);
+					p->sp[i] += 2;
+				}
+				branched = true;
+				break;
+			case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xE0: case 0xE8: case 0xF0: case 0xF8: { // Rcc
+				uint8_t bit, want;
+				condition(op, bit, want);
+				for (int i = 0; i < N; i++) {
+					if ((p->f[i] & bit) == want) {
+						const uint8_t *m = p->cpus[i].memory.data();
+						p->pc[i] = m[p->sp[i]] | (m[p->sp[i] + 1] << 8);
+						p->sp[i] += 2;
+					} else {
+						p->pc[i] = next;
+					}
+				}
+				branched = true;
+				break;
+			}
+			case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST n
+				for (int i = 0; i < N; i++) {
+					write8(&p->cpus[i], p->sp[i] - 1, next >> 8);
+					write8(&p->cpus[i], p->sp[i] - 2, next & 0xFF);
+					p->sp[i] -= 2;
+					p->pc[i] = op & 0x38;
+				}
+				stored = true;
+				branched = true;
+				break;
+			case 0xC5: case 0xD5: case 0xE5: case 0xF5: { // PUSH rp, PUSH PSW
+				uint8_t *hi = op == 0xF5 ? p->a : regs[(op >> 3) & 0x06];
+				uint8_t *lo = op == 0xF5 ? p->f : regs[((op >> 3) & 0x06) + 1];
+				for (int i = 0; i < N; i++) {
+					write8(&p->cpus[i], p->sp[i] - 1, hi[i]);
+					write8(&p->cpus[i], p->sp[i] - 2, lo[i]);
+					p->sp[i] -= 2;
+				}
+				stored = true;
+				break;
+			}
+			case 0xC1: case 0xD1: case 0xE1: { // POP rp
+				uint8_t *hi = regs[(op >> 3) & 0x06], *lo = regs[((op >> 3) & 0x06) + 1];
+				for (int i = 0; i < N; i++) {
+					const uint8_t *m = p->cpus[i].memory.data();
+					lo[i] = m[p->sp[i]];
+					hi[i] = m[p->sp[i] + 1];
+					p->sp[i] += 2;
+				}
+				break;
+			}
+			case 0xF1: // POP PSW
+				for (int i = 0; i < N; i++) {
+					const uint8_t *m = p->cpus[i].memory.data();
+					p->f[i] = (m[p->sp[i]] & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_ONE;
+					p->a[i] = m[p->sp[i] + 1];
+					p->sp[i] += 2;
+				}
+				break;
+			case 0xE9: // PCHL
+				for (int i = 0; i < N; i++) {
+					p->pc[i] = (p->h[i] << 8) | p->l[i];
+				}
+				return STEP_SPLIT;
+			case 0xF9: // SPHL
+				for (int i = 0; i < N; i++) {
+					p->sp[i] = (p->h[i] << 8) | p->l[i];
+				}
+				break;
+			case 0xEB: // XCHG
+				for (int i = 0; i < N; i++) {
+					std::swap(p->d[i], p->h[i]);
+					std::swap(p->e[i], p->l[i]);
+				}
+				break;
+			default:
+				if (op >= 0x40 && op < 0x80 && op != 0x76) { // MOV
+					if (src == nullptr) { // MOV r, M
+						for (int i = 0; i < N; i++) {
+							dst[i] = p->cpus[i].memory[(p->h[i] << 8) | p->l[i]];
+						}
+					} else if (dst == nullptr) { // MOV M, r
+						for (int i = 0; i < N; i++) {
+							write8(&p->cpus[i], (p->h[i] << 8) | p->l[i], src[i]);
+						}
+						stored = true;
+					} else if (dst != src) {
+						std::memcpy(dst, src, N);
+					}
+				} else if (op >= 0x80 && op < 0xC0) { // ALU r, ALU M
+					if (src == nullptr) {
+						for (int i = 0; i < N; i++) {
+							v[i] = p->cpus[i].memory[(p->h[i] << 8) | p->l[i]];
+						}
+						src = v;
+					}
+					aluLanes(p, (op >> 3) & 0x07, src);
+				} else {
+					return STEP_NONE;
+				}
+				break;
+			}
+			if (!branched) {
+				std::fill(p->pc, p->pc + N, next);
+			}
+			if (stored) {
+				for (int i = 0; i < N; i++) {
+					dropWritten(p, i);
+				}
+			}
+			return branched ? STEP_SPLIT : STEP_SAME;
+		}
+
+		// Run instructions for every lane at once until budget is used, the PCs split
+		// or an instruction needs each lane's own handler call, returns the instructions run
+		uint64_t runTogether(lockstepPool *p, uint64_t budget) {
+			uint64_t ran = 0;
+			while (ran < budget) {
+				uint16_t pc = p->pc[0];
+				if (!sharedPage(p, pc >> 8) || !sharedPage(p, ((pc + 2) >> 8) & 0xFF)) {
+					break;
+				}
+				const uint8_t *bytes = &p->cpus[0].memory[pc];
+				int result = stepTogether(p, bytes[0], bytes);
+				if (result == STEP_NONE) {
+					break;
+				}
+				ran++;
+				if (result == STEP_SPLIT) {
+					for (int i = 1; i < N; i++) {
+						if (p->pc[i] != p->pc[0]) {
+							return ran;
+						}
+					}
+				}
+			}
+			return ran;
+		}
+
+		// Run one instruction on a single lane through the handlers every engine shares
+		void stepAlone(lockstepPool *p, int lane) {
+			p->storeLane(lane);
+			state *s = &p->cpus[lane];
+			uint8_t *opcode = &s->memory[s->r.pc];
+			uint8_t op = *opcode;
+			s->eiDelay = 0; // Any instruction ends the delay of an EI before it
+			switch (op) {
+			case 0x76: // HLT
+				s->r.pc += 1;
+				op76(s, opcode);
+				p->stopped[lane] = 1;
+				p->reasons[lane] = STOP_HALT;
+				break;
+			case 0xD3: // OUT D8
+				p->outputs[lane][opcode[1]] = s->r.a;
+				s->r.pc += 2;
+				break;
+			case 0xDB: // IN D8
+				s->r.a = p->inputs[lane][opcode[1]];
+				s->r.pc += 2;
+				break;
+			default:
+				s->r.pc += instructionLength[op];
+				instructionTable[op](s, opcode);
+				break;
+			}
+			p->loadLane(lane);
+			dropWritten(p, lane);
+		}
+	}
+
+	lockstepPool::lockstepPool(const state &init) : cpus(LOCKSTEP_LANES, init) {
+		for (int i = 0; i < LOCKSTEP_LANES; i++) {
+			loadLane(i);
+		}
+	}
+
+	void lockstepPool::storeLane(int lane) {
+		registers &r = cpus[lane].r;
+		r.a = a[lane];
+		r.f = f[lane];
+		r.b = b[lane];
+		r.c = c[lane];
+		r.d = d[lane];
+		r.e = e[lane];
+		r.h = h[lane];
+		r.l = l[lane];
+		r.sp = sp[lane];
+		r.pc = pc[lane];
+		cpus[lane].lazy.pending = 0; // F is current
+	}
+
+	void lockstepPool::loadLane(int lane) {
+		state *s = &cpus[lane];
+		f[lane] = flags(s);
+		a[lane] = s->r.a;
+		b[lane] = s->r.b;
+		c[lane] = s->r.c;
+		d[lane] = s->r.d;
+		e[lane] = s->r.e;
+		h[lane] = s->r.h;
+		l[lane] = s->r.l;
+		sp[lane] = s->r.sp;
+		pc[lane] = s->r.pc;
+	}
+
+	void emulateLockstep(lockstepPool *p, uint64_t count) {
+		uint64_t left[N];
+		for (int i = 0; i < N; i++) {
+			left[i] = p->stopped[i] ? 0 : count;
+		}
+		while (true) {
+			int running = 0;
+			bool together = true;
+			uint16_t lowest = 0xFFFF;
+			uint64_t fewest = UINT64_MAX;
+			for (int i = 0; i < N; i++) {
+				if (left[i] == 0) {
+					together = false;
+					continue;
+				}
+				if (running > 0 && p->pc[i] != p->pc[0]) {
+					together = false;
+				}
+				lowest = std::min(lowest, p->pc[i]);
+				fewest = std::min(fewest, left[i]);
+				running++;
+			}
+			if (running == 0) {
+				break;
+			}
+			if (together) {
+				uint64_t ran = runTogether(p, fewest);
+				p->together += ran;
+				for (int i = 0; i < N; i++) {
+					left[i] -= ran;
+				}
+				if (ran > 0) {
+					// EI only runs alone, so it wasn't the last instruction
+					for (int i = 0; i < N; i++) {
+						p->cpus[i].eiDelay = 0;
+					}
+					continue;
+				}
+			}
+			// Step the lanes furthest behind, which lets lanes that split at a branch meet up again
+			for (int i = 0; i < N; i++) {
+				if (left[i] > 0 && p->pc[i] == lowest) {
+					stepAlone(p, i);
+					p->alone++;
+					left[i] = p->stopped[i] ? 0 : left[i] - 1;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "cpu.h"
+#include "emulator.h"
+
+namespace Emu8080 {
+	// Lanes in a lockstep pool, 32 byte registers fill an AVX2 vector
+	constexpr int LOCKSTEP_LANES = 32;
+
+	// Many CPUs running the same program, with their registers kept one array per register
+	// so an instruction runs for every lane at once while their PCs agree
+	class lockstepPool {
+	public:
+		// Registers, indexed by lane
+		uint8_t a[LOCKSTEP_LANES], f[LOCKSTEP_LANES];
+		uint8_t b[LOCKSTEP_LANES], c[LOCKSTEP_LANES];
+		uint8_t d[LOCKSTEP_LANES], e[LOCKSTEP_LANES];
+		uint8_t h[LOCKSTEP_LANES], l[LOCKSTEP_LANES];
+		uint16_t sp[LOCKSTEP_LANES], pc[LOCKSTEP_LANES];
+		// Memory and bus of each lane, their registers are only current after storeLane
+		std::vector<state> cpus;
+		// Value IN reads from each port, and the last value OUT wrote to it
+		uint8_t inputs[LOCKSTEP_LANES][256] = {};
+		uint8_t outputs[LOCKSTEP_LANES][256] = {};
+		// Lanes stopped by HLT, skipped from then on
+		uint8_t stopped[LOCKSTEP_LANES] = {};
+		stopReason reasons[LOCKSTEP_LANES] = {};
+		uint64_t together = 0; // Instructions run for every lane at once
+		uint64_t alone = 0; // Instructions run for a single lane
+		// Whether each page holds the same bytes in every lane, PAGE_CODE tells when a lane writes one
+		uint8_t codePages[256] = {};
+
+		// Every lane starts as a copy of init
+		lockstepPool(const state &init);
+
+		// Copy a lane's registers to its CPU, and back
+		void storeLane(int lane);
+		void loadLane(int lane);
+	};
+
+	// Execute count instructions on every lane that hasn't stopped
+	// Runs all lanes together while their PCs agree, and the lanes with the lowest PC one by one when they don't
+	void emulateLockstep(lockstepPool *p, uint64_t count);
+}
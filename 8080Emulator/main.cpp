@@ -1,1176 +1,1139 @@
 #include <iostream>
-#include <iomanip>
-#include <bitset>
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
-#include <vector>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include "emulator.h"
+#include "batch.h"
+#include "bench.h"
+#include "coroutine.h"
+#include "cpm.h"
+#include "decode.h"
+#include "fuzz.h"
+#include "iolog.h"
+#include "jit.h"
+#include "lockstep.h"
+#include "pacer.h"
+#include "ports.h"
+#include "profile.h"
+#include "rom.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "video.h"
 
-namespace Emu8080 {
-	// CPU
-	class conditionCodes {
-	public:
-		uint8_t z, s, p, cy, ac;
-		conditionCodes() : z(1), s(1), p(1), cy(0), ac(1) {}
-	};
+// Run a ROM on each engine and report guest MIPS
+void benchmark(const std::string &path, uint64_t count) {
+	Emu8080::state switchState, threadedState, decodedState, jitState;
+	Emu8080::readFile(&switchState, path);
+	Emu8080::readFile(&threadedState, path);
+	Emu8080::readFile(&decodedState, path);
+	Emu8080::readFile(&jitState, path);
+	// Switch
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < count; i++) {
+		Emu8080::emulate8080(&switchState);
+	}
+	std::chrono::duration<double> switchTime = std::chrono::steady_clock::now() - start;
+	// Threaded
+	start = std::chrono::steady_clock::now();
+	Emu8080::emulateThreaded(&threadedState, count);
+	std::chrono::duration<double> threadedTime = std::chrono::steady_clock::now() - start;
+	// Decode cache
+	Emu8080::decodeCache decoder;
+	start = std::chrono::steady_clock::now();
+	Emu8080::emulateDecoded(&decodedState, &decoder, count);
+	std::chrono::duration<double> decodedTime = std::chrono::steady_clock::now() - start;
+	// JIT
+	Emu8080::jitCache cache(&jitState);
+	start = std::chrono::steady_clock::now();
+	Emu8080::emulateJit(&jitState, &cache, count);
+	std::chrono::duration<double> jitTime = std::chrono::steady_clock::now() - start;
 
-	class registers {
-	public:
-		uint8_t a, b, c, d, e, h, l;
-		uint16_t sp, pc;
-		registers() : a(0), b(0), c(0), d(0), e(0), h(0), l(0), sp(0), pc(0) {}
-	};
+	std::cout << path << "\n"
+		<< "  switch:   " << count / switchTime.count() / 1e6 << " MIPS\n"
+		<< "  threaded: " << count / threadedTime.count() / 1e6 << " MIPS, "
+		<< switchTime.count() / threadedTime.count() << "x, state "
+		<< (Emu8080::sameState(&switchState, &threadedState) ? "match" : "MISMATCH") << "\n"
+		<< "  decoded:  " << count / decodedTime.count() / 1e6 << " MIPS, "
+		<< switchTime.count() / decodedTime.count() << "x, state "
+		<< (Emu8080::sameState(&switchState, &decodedState) ? "match" : "MISMATCH")
+		<< ", " << decoder.decoded << " decoded, " << decoder.invalidated << " pages invalidated\n"
+		<< "  jit:      " << count / jitTime.count() / 1e6 << " MIPS, "
+		<< switchTime.count() / jitTime.count() << "x, state "
+		<< (Emu8080::sameState(&switchState, &jitState) ? "match" : "MISMATCH")
+		<< ", " << cache.compiled << " blocks, " << cache.invalidated << " invalidated\n";
+}
 
-	class state {
-	public:
-		conditionCodes cc;
-		registers r;
-		uint8_t enabled = 0;
-		std::vector<uint8_t> memory;
-		uint16_t temp16 = 0; // Catch-all holder for any 16 bit number needed in operations
-		uint8_t temp8 = 0;
-		state() {
-			memory = std::vector<uint8_t>(0x10000, 0); // Reserve 16KB
+// Run a ROM on every lane of a lockstep pool and on as many separate CPUs, reports lane MIPS
+// Lanes either all start the same, or with B set to the lane number so their paths can split
+void lockstepBenchmark(const std::string &path, uint64_t count, bool varied) {
+	Emu8080::state init;
+	Emu8080::readFile(&init, path);
+	std::vector<Emu8080::state> scalar(Emu8080::LOCKSTEP_LANES, init);
+	Emu8080::lockstepPool pool(init);
+	for (int i = 0; i < Emu8080::LOCKSTEP_LANES; i++) {
+		if (varied) {
+			scalar[i].r.b = pool.b[i] = (uint8_t)i;
 		}
-	};
+	}
+	// Separate CPUs
+	auto start = std::chrono::steady_clock::now();
+	for (Emu8080::state &s : scalar) {
+		Emu8080::emulateThreaded(&s, count);
+	}
+	std::chrono::duration<double> scalarTime = std::chrono::steady_clock::now() - start;
+	// Lockstep
+	start = std::chrono::steady_clock::now();
+	Emu8080::emulateLockstep(&pool, count);
+	std::chrono::duration<double> lockstepTime = std::chrono::steady_clock::now() - start;
+	bool match = true;
+	for (int i = 0; i < Emu8080::LOCKSTEP_LANES; i++) {
+		pool.storeLane(i);
+		match = match && Emu8080::sameState(&scalar[i], &pool.cpus[i]);
+	}
+
+	uint64_t lanes = count * Emu8080::LOCKSTEP_LANES;
+	std::cout << path << (varied ? ", varied lanes\n" : ", identical lanes\n")
+		<< "  threaded: " << lanes / scalarTime.count() / 1e6 << " MIPS\n"
+		<< "  lockstep: " << lanes / lockstepTime.count() / 1e6 << " MIPS, "
+		<< scalarTime.count() / lockstepTime.count() << "x, state " << (match ? "match" : "MISMATCH") << ", "
+		<< pool.together << " together, " << pool.alone << " alone\n";
+}
 
-	// Exit program when an unimplemented instruction is encountered
-	void unimplementedInstruction(uint8_t opcode) {
-		std::cout << "Error: Instruction "
-			<< std::uppercase << std::hex << std::setw(2) << std::setfill('0')
-			<< (int)opcode << " is unimplemented\n";
+// Flags computed bit by bit, as checkFlags did before the flag tables
+// Kept as the baseline for the flag microbenchmark, parity was counted over 255 shifts
+void bitLoopFlags(Emu8080::state *s, uint16_t result) {
+	int p = 0;
+	uint16_t x = result;
+	for (int i = 0; i < 0xFF; i++) {
+		if (x & 0x01) {
+			p++;
+		}
+		x = x >> 1;
 	}
+	s->r.f = ((result & 0xFF) == 0 ? Emu8080::FLAG_Z : 0)
+		| ((result & 0x80) == 0x80 ? Emu8080::FLAG_S : 0)
+		| ((p & 0x01) == 0 ? Emu8080::FLAG_P : 0)
+		| ((result & 0xFF00) > 0 ? Emu8080::FLAG_CY : 0)
+		| (result >= 0x0F ? Emu8080::FLAG_AC : 0)
+		| Emu8080::FLAG_ONE;
+}
+
+// Time flag computation for an 8 bit add, reports ns per operation
+void flagsBenchmark(uint64_t count) {
+	Emu8080::state s;
+	uint8_t a = 0;
+	// Bit loop
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < count; i++) {
+		uint16_t result = (uint16_t)a + (uint16_t)(i & 0xFF);
+		a = result & 0xFF;
+		bitLoopFlags(&s, result);
+		a ^= (s.r.f & (Emu8080::FLAG_P | Emu8080::FLAG_AC)) >> 2;
+	}
+	std::chrono::duration<double, std::nano> loopTime = std::chrono::steady_clock::now() - start;
+	// Tables
+	start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < count; i++) {
+		uint16_t result = (uint16_t)a + (uint16_t)(i & 0xFF);
+		Emu8080::checkFlags(&s, Emu8080::ALU_ADD, a, (uint8_t)i, result, true);
+		a = result & 0xFF;
+		a ^= (s.r.f & (Emu8080::FLAG_P | Emu8080::FLAG_AC)) >> 2;
+	}
+	std::chrono::duration<double, std::nano> tableTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << "flags, checksum " << (int)a << "\n"
+		<< "  bit loop: " << loopTime.count() / count << " ns/op\n"
+		<< "  tables:   " << tableTime.count() / count << " ns/op\n";
+}
+
+// Screen converted a pixel at a time, kept as the baseline for the video benchmark
+void pixelVideo(Emu8080::state *s, std::vector<uint8_t> &rgba) {
+	for (int y = 0; y < Emu8080::VIDEO_HEIGHT; y++) {
+		for (int x = 0; x < Emu8080::VIDEO_WIDTH; x++) {
+			int bit = Emu8080::VIDEO_HEIGHT - 1 - y;
+			bool lit = (s->memory[Emu8080::VIDEO_RAM + x * 32 + bit / 8] >> (bit % 8)) & 1;
+			uint8_t *p = &rgba[(y * Emu8080::VIDEO_WIDTH + x) * 4];
+			p[0] = p[1] = p[2] = lit ? 0xFF : 0x00;
+			p[3] = 0xFF;
+		}
+	}
+}
+
+// Convert a screen of noise count times, reports frames per second a pixel at a time, whole frames in each format,
+// and frames where a single store lands in video RAM between updates
+void videoBenchmark(int count) {
+	Emu8080::state s;
+	uint32_t seed = 1;
+	for (int i = Emu8080::VIDEO_RAM; i < 0x4000; i++) {
+		seed = seed * 1103515245 + 12345;
+		s.memory[i] = seed >> 24;
+	}
+	// Pixel at a time
+	std::vector<uint8_t> reference(Emu8080::VIDEO_WIDTH * Emu8080::VIDEO_HEIGHT * 4);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		pixelVideo(&s, reference);
+	}
+	std::chrono::duration<double> pixelTime = std::chrono::steady_clock::now() - start;
+	// Whole frames
+	Emu8080::invadersVideo rgba(Emu8080::VIDEO_RGBA), gray(Emu8080::VIDEO_GRAY);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		rgba.update(&s, true);
+	}
+	std::chrono::duration<double> rgbaTime = std::chrono::steady_clock::now() - start;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		gray.update(&s, true);
+	}
+	std::chrono::duration<double> grayTime = std::chrono::steady_clock::now() - start;
+	// One store per frame
+	uint64_t columns = rgba.converted;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		seed = seed * 1103515245 + 12345;
+		Emu8080::write8(&s, Emu8080::VIDEO_RAM + (seed >> 8) % (0x4000 - Emu8080::VIDEO_RAM), seed >> 24);
+		rgba.update(&s);
+	}
+	std::chrono::duration<double> dirtyTime = std::chrono::steady_clock::now() - start;
+	pixelVideo(&s, reference);
+
+	std::cout << "video, " << count << " frames\n"
+		<< "  pixel: " << count / pixelTime.count() << " frames/s\n"
+		<< "  rgba:  " << count / rgbaTime.count() << " frames/s, " << pixelTime.count() / rgbaTime.count() << "x\n"
+		<< "  gray:  " << count / grayTime.count() << " frames/s, " << pixelTime.count() / grayTime.count() << "x\n"
+		<< "  dirty: " << count / dirtyTime.count() << " frames/s, "
+		<< (double)(rgba.converted - columns) / count << " columns per frame, frame "
+		<< (rgba.pixels == reference ? "match" : "MISMATCH") << "\n";
+}
+
+// Shift register sprite loop, OUT 4, OUT 2 and IN 3 on every pass
+const uint8_t SHIFT_LOOP[] = {
+	0x04, // INR B
+	0x78, // MOV A, B
+	0xD3, 0x04, // OUT 4
+	0xD3, 0x02, // OUT 2
+	0xDB, 0x03, // IN 3
+	0x80, // ADD B
+	0x47, // MOV B, A
+	0xC3, 0x00, 0x00 // JMP 0
+};
 
-	// Print CPU state
-	void printState(state *s, uint8_t opcode, uint16_t data) {
-		std::cout << "PC: " <<  s->r.pc << " Opcode: "
-			<< std::uppercase << std::hex << std::setw(2) << std::setfill('0') << (int)opcode
-			<< " Data: " << data 
-			<< "\n"
-			<< "SP:" << std::uppercase << std::hex << std::setw(2) << std::setfill('0') << (s->r.sp) << "\n"
-			<< "Z:" << std::bitset<1>(s->cc.z)
-			<< " S:" << std::bitset<1>(s->cc.s)
-			<< " P:" << std::bitset<1>(s->cc.p)
-			<< " CY:" << std::bitset<1>(s->cc.cy)
-			<< " AC:" << std::bitset<1>(s->cc.ac) 
-			<< "\n"
-			<< "A:" << std::bitset<8>(s->r.a)
-			<< " B:" << std::bitset<8>(s->r.b)
-			<< " C:" << std::bitset<8>(s->r.c)
-			<< "\nD:" << std::bitset<8>(s->r.d)
-			<< " E:" << std::bitset<8>(s->r.e)
-			<< " H:" << std::bitset<8>(s->r.h)
-			<< " L:" << std::bitset<8>(s->r.l) 
-			<< "\n\n";
+// Run the shift register loop for cycles, with the host answering every IN and OUT and with the
+// shift register on the port bus, reports guest MIPS
+void portsBenchmark(uint64_t cycles) {
+	Emu8080::state hostState, busState;
+	std::memcpy(hostState.memory.data(), SHIFT_LOOP, sizeof(SHIFT_LOOP));
+	std::memcpy(busState.memory.data(), SHIFT_LOOP, sizeof(SHIFT_LOOP));
+	// Host
+	Emu8080::shiftRegister hostShifter;
+	uint64_t hostInstructions = 0, hostCycles = 0;
+	auto start = std::chrono::steady_clock::now();
+	while (hostCycles < cycles) {
+		Emu8080::runResult result = Emu8080::run(&hostState, cycles - hostCycles);
+		hostCycles += result.cycles;
+		hostInstructions += result.instructions;
+		if (result.reason != Emu8080::STOP_IO) {
+			break;
+		}
+		if (result.input) {
+			hostState.r.a = hostState.port == 3 ? hostShifter.result() : 0;
+		} else if (hostState.port == 2) {
+			hostShifter.offset = hostState.r.a & 0x07;
+		} else if (hostState.port == 4) {
+			hostShifter.shift(hostState.r.a);
+		}
 	}
+	std::chrono::duration<double> hostTime = std::chrono::steady_clock::now() - start;
+	// Bus
+	Emu8080::invadersPorts ports;
+	busState.ports = &ports.bus;
+	start = std::chrono::steady_clock::now();
+	Emu8080::runResult bus = Emu8080::run(&busState, cycles);
+	std::chrono::duration<double> busTime = std::chrono::steady_clock::now() - start;
+	busState.ports = nullptr;
+
+	std::cout << "ports, " << cycles << " cycles\n"
+		<< "  host: " << hostInstructions / hostTime.count() / 1e6 << " MIPS\n"
+		<< "  bus:  " << bus.instructions / busTime.count() / 1e6 << " MIPS, "
+		<< hostTime.count() / busTime.count() << "x, state "
+		<< (Emu8080::sameState(&hostState, &busState) && hostShifter.value == ports.shifter.value ? "match" : "MISMATCH") << "\n";
+}
+
+// Space Invaders runs at 2 MHz with a 60 Hz screen
+const uint64_t INVADERS_FRAME = 2000000 / 60;
 
-	// Reading file into memory
-	void readFile(state *s, const std::string &path) {
-		// Get file
-		std::ifstream file(path, std::ios::binary);
-		file.unsetf(std::ios::skipws); // Skip whitespace
-		// Fill data
-		s->memory.insert(s->memory.begin(), std::istream_iterator<uint8_t>(file), std::istream_iterator<uint8_t>());
+// Screen interrupt, context is the ioRecorder accepted interrupts are logged to, if any
+void screenInterrupt(Emu8080::state *s, Emu8080::scheduler *q, uint8_t n, void *context) {
+	if (Emu8080::interrupt(s, n) && context != nullptr) {
+		static_cast<Emu8080::ioRecorder *>(context)->interrupt(q->now, n);
 	}
+}
 
-	// Operations
+// RST 1 when the beam reaches mid-screen
+void midScreen(Emu8080::state *s, Emu8080::scheduler *q, uint64_t time, void *context) {
+	screenInterrupt(s, q, 1, context);
+	q->schedule(time + INVADERS_FRAME, midScreen, context);
+}
 
-	// Check parity
-	uint8_t parity(uint16_t x, uint16_t size) {
-		int i;
-		int p = 0;
-		x = x & ((1 << size) - 1);
-		for (i = 0; i < size; i++) {
-			if (x & 0x01) {
-				p++;
+// RST 2 at VBlank
+void vblank(Emu8080::state *s, Emu8080::scheduler *q, uint64_t time, void *context) {
+	screenInterrupt(s, q, 2, context);
+	q->schedule(time + INVADERS_FRAME, vblank, context);
+}
+
+// Load Space Invaders, path is a directory of split ROMs or a single combined image
+bool invadersLoad(Emu8080::state *s, const std::string &path) {
+	Emu8080::romImage probe(path + "/invaders.h");
+	return probe.valid() ? Emu8080::loadInvaders(s, path) : Emu8080::loadImage(s, path, 0);
+}
+
+// Load Space Invaders and schedule its screen interrupts, job.context is passed on to them
+bool invadersSetup(Emu8080::state *s, Emu8080::scheduler *q, const Emu8080::batchJob &job) {
+	bool loaded = invadersLoad(s, job.path);
+	q->schedule(INVADERS_FRAME / 2, midScreen, job.context);
+	q->schedule(INVADERS_FRAME, vblank, job.context);
+	return loaded;
+}
+
+// Run Space Invaders headless with its screen interrupts and I/O ports, the inputs stay idle
+// Records its I/O to recordPath, or replays it from replayPath with no interrupts of its own, when either is given
+// The input ports are then left to the host so their reads go through the log
+// Saves the last frame to screenPath when given
+void invaders(const std::string &path, int frames, const std::string &recordPath, const std::string &replayPath, const std::string &screenPath) {
+	Emu8080::state s;
+	Emu8080::scheduler q;
+	Emu8080::invadersPorts ports;
+	s.ports = &ports.bus;
+	if (!recordPath.empty() || !replayPath.empty()) {
+		for (int port = 0; port < 3; port++) {
+			ports.bus.readers[port] = nullptr;
+		}
+	}
+	std::unique_ptr<Emu8080::ioRecorder> recorder;
+	std::unique_ptr<Emu8080::ioReplay> replay;
+	if (!replayPath.empty()) {
+		replay.reset(new Emu8080::ioReplay(replayPath));
+		if (!replay->valid() || !invadersLoad(&s, path)) {
+			return;
+		}
+		replay->start(&q);
+	} else {
+		if (!recordPath.empty()) {
+			recorder.reset(new Emu8080::ioRecorder(recordPath));
+			if (!recorder->valid()) {
+				std::cout << "Error: Could not create " << recordPath << "\n";
+				return;
+			}
+		}
+		Emu8080::batchJob job;
+		job.path = path;
+		job.context = recorder.get();
+		if (!invadersSetup(&s, &q, job)) {
+			return;
+		}
+	}
+	auto start = std::chrono::steady_clock::now();
+	while (q.now < frames * INVADERS_FRAME) {
+		Emu8080::runResult result = Emu8080::runScheduled(&s, &q, frames * INVADERS_FRAME - q.now);
+		if (result.reason == Emu8080::STOP_IO) {
+			if (result.input) {
+				uint8_t value = s.port < 3 ? ports.inputs[s.port].value : 0;
+				if (replay != nullptr && !replay->input(q.now, s.port, value)) {
+					break;
+				}
+				if (recorder != nullptr) {
+					recorder->input(q.now, s.port, value);
+				}
+				s.r.a = value;
 			}
-			x = x >> 1;
+		} else if (result.reason != Emu8080::STOP_BUDGET) {
+			std::cout << "Stopped with reason " << result.reason << "\n";
+			break;
 		}
-		return (p & 0x01) == 0;
 	}
+	std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+	std::cout << q.now / INVADERS_FRAME << " frames, " << q.now << " cycles in " << time.count() << " s\n";
+	if (recorder != nullptr) {
+		std::cout << recorder->records << " I/O records\n";
+	}
+	if (replay != nullptr && !replay->finished()) {
+		std::cout << "Replay stopped before the end of the log\n";
+	}
+	if (!screenPath.empty()) {
+		Emu8080::invadersVideo video;
+		video.update(&s);
+		if (!video.savePnm(screenPath)) {
+			std::cout << "Error: Could not write " << screenPath << "\n";
+		}
+	}
+	Emu8080::printState(&s, s.memory[s.r.pc], (s.memory[s.r.pc + 2] << 8) | s.memory[s.r.pc + 1]);
+}
+
+// Convert a frame of Space Invaders video, context is the invadersVideo
+void invadersRender(Emu8080::state *s, void *context) {
+	static_cast<Emu8080::invadersVideo *>(context)->update(s);
+}
 
-	// Check carry 16 bit
-	void checkCarry16(state *s, uint16_t result) {
-		s->cc.cy = (result & 0xFF00) > 0;
+// Play Space Invaders paced to its 60 Hz screen, or in turbo as fast as it goes rendering every skip frames
+// Headless, rendering is the video conversion, and the inputs stay idle
+// Idle loops are fast forwarded when idle is set, hot code is translated when jit is set
+void play(const std::string &path, uint64_t frames, bool turbo, uint32_t skip, bool idle, bool jit) {
+	Emu8080::state s;
+	Emu8080::scheduler q;
+	Emu8080::invadersPorts ports;
+	s.ports = &ports.bus;
+	Emu8080::batchJob job;
+	job.path = path;
+	if (!invadersSetup(&s, &q, job)) {
+		return;
+	}
+	q.skipIdle = idle;
+	std::unique_ptr<Emu8080::jitCache> cache;
+	if (jit) {
+		cache.reset(new Emu8080::jitCache(&s));
+		q.jit = cache.get();
+	}
+	if (!turbo) {
+		// Halted stretches sleep to their interrupt rather than wait out the frame
+		q.pace(2000000);
 	}
-	// Check carry 32 bit
-	void checkCarry32(state *s, uint32_t result) {
-		s->cc.cy = (result & 0xFFFF0000) > 0;
+	Emu8080::invadersVideo video;
+	Emu8080::framePacer pacer(2000000.0 / INVADERS_FRAME, turbo, skip);
+	Emu8080::runResult result = Emu8080::runFrames(&s, &q, frames, INVADERS_FRAME, &pacer, invadersRender, &video);
+	if (result.reason != Emu8080::STOP_BUDGET) {
+		std::cout << "Stopped with reason " << result.reason << "\n";
 	}
+	pacer.report(std::cout);
+	std::cout << "  guest: " << result.cycles / pacer.seconds() / 2000000 << "x 2 MHz";
+	if (idle) {
+		std::cout << ", " << 100.0 * q.idleCycles / q.now << "% of cycles skipped in " << q.idleLoops << " idle loops";
+	}
+	std::cout << "\n";
+}
 
-	// Check flags
-	void checkFlags(state *s, uint16_t result, bool checkCY) {
-		s->cc.z = (result & 0xFF) == 0; // Check if equal to zero
-		s->cc.s = (result & 0x80) == 0x80; // Check if negative (msb is set)
-		s->cc.p = parity(result, 0xFF); // Check parity
-		if (checkCY) {
-			checkCarry16(s, result);
+// Run Space Invaders with and without idle loop skipping, report host time per emulated second
+// and check both end in the same state
+void idleBenchmark(const std::string &path, uint64_t frames) {
+	Emu8080::state states[2];
+	Emu8080::scheduler queues[2];
+	double seconds[2];
+	for (int i = 0; i < 2; i++) {
+		Emu8080::state &s = states[i];
+		Emu8080::scheduler &q = queues[i];
+		Emu8080::invadersPorts ports;
+		s.ports = &ports.bus;
+		Emu8080::batchJob job;
+		job.path = path;
+		if (!invadersSetup(&s, &q, job)) {
+			return;
+		}
+		q.skipIdle = i == 1;
+		auto start = std::chrono::steady_clock::now();
+		while (q.now < frames * INVADERS_FRAME) {
+			Emu8080::runResult result = Emu8080::runScheduled(&s, &q, frames * INVADERS_FRAME - q.now);
+			if (result.reason == Emu8080::STOP_IO) {
+				if (result.input) {
+					s.r.a = 0;
+				}
+			} else if (result.reason != Emu8080::STOP_BUDGET) {
+				std::cout << "Stopped with reason " << result.reason << "\n";
+				break;
+			}
 		}
-		s->cc.ac = result >= 0x0F; // Check half carry
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		seconds[i] = time.count();
+		s.ports = nullptr;
 	}
+	double emulated = queues[0].now / 2000000.0;
+	std::cout << path << ", " << frames << " frames\n"
+		<< "  run:  " << seconds[0] * 1e3 / emulated << " ms per emulated second\n"
+		<< "  idle: " << seconds[1] * 1e3 / emulated << " ms per emulated second, " << seconds[0] / seconds[1] << "x, "
+		<< 100.0 * queues[1].idleCycles / queues[1].now << "% of cycles skipped in " << queues[1].idleLoops << " loops, state "
+		<< (Emu8080::sameState(&states[0], &states[1]) && queues[0].now == queues[1].now ? "match" : "MISMATCH") << "\n";
+}
 
-	// Add value to 8 bit register
-	void add8(state *s, uint8_t &reg, uint8_t val, bool cy) {
-		uint16_t result = (uint16_t)reg + (uint16_t)val;
-		reg = result & 0xFF;
-		checkFlags(s, result, cy);
-	}
-	// Add value to 16 bit register as two 8 bit registers
-	void add16(uint8_t &reg1, uint8_t &reg2, uint8_t val) {
-		uint16_t result = (reg1 << 8 | reg2) + val;
-		reg1 = result >> 8;
-		reg2 = result & 0xFF;
-	}
-	// Add 16 bit register to 16 bit register as 8 bit registers
-	void add32_8(state *s, uint8_t &reg1, uint8_t &reg2, uint8_t &reg3, uint8_t &reg4) {
-		uint32_t reg12 = (reg1 << 8) | reg2;
-		uint32_t reg34 = (reg3 << 8) | reg4;
-		uint32_t result = reg12 + reg34;
-		reg1 = (result & 0xFF00) >> 8;
-		reg2 = result & 0xFF;
-		checkCarry32(s, result);
-	}
-	// Add 16 bit register to 16 bit register as 8 bit registers and a 16 bit register
-	void add32_16(state *s, uint8_t &reg1, uint8_t &reg2, uint16_t &reg3) {
-		uint32_t reg12 = (reg1 << 8) | reg2;
-		uint32_t result = reg12 + reg3;
-		reg1 = (result & 0xFF00) >> 8;
-		reg2 = result & 0xFF;
-		checkCarry32(s, result);
-	}
-	// Add value and carry to 8 bit register
-	void adc(state *s, uint8_t &reg, uint8_t val, bool cy) {
-		uint16_t result = (uint16_t)reg + (uint16_t)val + s->cc.cy;
-		reg = result & 0xFF;
-		checkFlags(s, result, cy);
+// Run a CP/M test program until it warm boots or stops, printing what it writes through BDOS
+void cpm(const std::string &path) {
+	const char *reasons[] = { "cycle budget", "halt", "breakpoint", "unimplemented instruction", "I/O" };
+	Emu8080::state s;
+	Emu8080::portBus bus;
+	Emu8080::cpmConsole console(&std::cout);
+	console.attach(&bus);
+	s.ports = &bus;
+	if (!Emu8080::loadCpm(&s, path)) {
+		return;
 	}
+	std::cout << path << "\n";
+	uint64_t instructions = 0;
+	Emu8080::runResult result;
+	auto start = std::chrono::steady_clock::now();
+	do {
+		result = Emu8080::run(&s, UINT64_MAX);
+		instructions += result.instructions;
+	} while (result.reason == Emu8080::STOP_IO);
+	std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+	console.flush();
+	if (result.reason == Emu8080::STOP_HALT && s.r.pc == Emu8080::CPM_WARM_BOOT) {
+		std::cout << "\nWarm boot";
+	} else {
+		std::cout << "\nStopped on " << reasons[result.reason] << " at " << s.r.pc;
+	}
+	std::cout << " after " << instructions << " instructions in " << time.count() << " s, "
+		<< instructions / time.count() / 1e6 << " MIPS, " << console.calls << " BDOS calls\n";
+}
 
-	// Subtract value from 8 bit register
-	void sub8(state *s, uint8_t &reg, uint8_t val, bool cy) {
-		uint16_t result = (uint16_t)reg - (uint16_t)val;
-		reg = result & 0xFF;
-		checkFlags(s, result, cy);
-	}
-	// Subtract value from 16 bit register
-	void sub16(uint8_t &reg1, uint8_t &reg2, uint8_t val) {
-		uint16_t result = (reg1 << 8 | reg2) - val;
-		reg1 = result >> 8;
-		reg2 = result & 0xFF;
-	}
-	// Subtract value and carry from 8 bit register
-	void sbb(state *s, uint8_t &reg, uint8_t val, bool cy) {
-		uint16_t result = (uint16_t)reg - (uint16_t)val - s->cc.cy;
-		reg = result & 0xFF;
-		checkFlags(s, result, cy);
+// Patches of cpudiagFix for cpudiag loaded as a CP/M program, page zero is left to loadCpm
+void cpudiagPatch(Emu8080::state *s) {
+	// Stack pointer from 0x6AD to 0x7AD
+	s->memory[368] = 0x7;
+}
+
+// Whether a file can be opened
+bool exists(const std::string &path) {
+	return Emu8080::romImage(path).valid();
+}
+
+// Run the benchmark suite, format is "table", "csv" or "json"
+// The synthetic loops always run, cpudiag.bin, 8080EXM.COM and Space Invaders are taken from romDirectory when there
+void benchSuite(const std::string &format, const std::string &romDirectory) {
+	std::vector<Emu8080::benchWorkload> workloads = Emu8080::syntheticWorkloads(100000000);
+	Emu8080::benchWorkload w;
+	if (exists(romDirectory + "/cpudiag.bin")) {
+		w.name = "cpudiag";
+		w.kind = Emu8080::WORKLOAD_CPM;
+		w.job.path = romDirectory + "/cpudiag.bin";
+		w.patch = cpudiagPatch;
+		w.instructions = 100000000;
+		workloads.push_back(w);
+	}
+	if (exists(romDirectory + "/8080EXM.COM")) {
+		w = Emu8080::benchWorkload();
+		w.name = "8080exm";
+		w.kind = Emu8080::WORKLOAD_CPM;
+		w.job.path = romDirectory + "/8080EXM.COM";
+		w.instructions = 1000000000;
+		workloads.push_back(w);
+	}
+	bool split = exists(romDirectory + "/invaders.h");
+	if (split || exists(romDirectory + "/invaders.bin")) {
+		w = Emu8080::benchWorkload();
+		w.name = "invaders";
+		w.kind = Emu8080::WORKLOAD_SCHEDULED;
+		w.job.path = split ? romDirectory : romDirectory + "/invaders.bin";
+		w.job.setup = invadersSetup;
+		w.job.cycles = 600 * INVADERS_FRAME; // 10 seconds of attract mode
+		workloads.push_back(w);
 	}
 
-	// AND value from 8 bit register
-	void ana(state *s, uint8_t &reg, uint8_t val) {
-		uint16_t result = (uint16_t)reg & (uint16_t)val;
-		reg = result & 0xFF;
-		checkFlags(s, result, true);
-	}
-	// XOR value from 8 bit register
-	void xra(state *s, uint8_t &reg, uint8_t val) {
-		uint16_t result = (uint16_t)reg ^ (uint16_t)val;
-		reg = result & 0xFF;
-		checkFlags(s, result, true);
-	}
-	// OR value from 8 bit register
-	void ora(state *s, uint8_t &reg, uint8_t val) {
-		uint16_t result = (uint16_t)reg | (uint16_t)val;
-		reg = result & 0xFF;
-		checkFlags(s, result, true);
+	std::vector<Emu8080::benchResult> results;
+	for (const Emu8080::benchWorkload &workload : workloads) {
+		std::vector<Emu8080::benchResult> r = Emu8080::runWorkload(workload);
+		results.insert(results.end(), r.begin(), r.end());
+	}
+	if (format == "csv") {
+		Emu8080::writeCsv(std::cout, results);
+	} else if (format == "json") {
+		Emu8080::writeJson(std::cout, results);
+	} else {
+		Emu8080::writeTable(std::cout, results);
 	}
+}
 
-	// Move 8 bit register to 8 bit register
-	void mov8(uint8_t &reg1, uint8_t &reg2) {
-		reg1 = reg2;
-	}
-	// Move 8 bit register to/from register at location HL
-	void movHL(state *s, uint8_t &reg, bool toHL) {
-		s->temp16 = (s->r.h << 8) | s->r.l;
-		if (toHL) {
-			s->memory[s->temp16] = reg;
-		} else {
-			reg = s->memory[s->temp16];
+// Where the ring trace goes if the process crashes, --show-trace prints it
+static const char *CRASH_TRACE = "crash.trace";
+
+// Print a trace written by ringTrace::save or a crash dump, oldest first
+void showTrace(const std::string &path) {
+	Emu8080::ringTrace trace;
+	if (!trace.load(path)) {
+		std::cout << "Error: Could not open " << path << "\n";
+		return;
+	}
+	trace.dump(std::cout);
+}
+
+// Text trace for the step-through session, the last instructions are kept for a crash dump
+class stepTrace {
+public:
+	Emu8080::textTrace text;
+	Emu8080::ringTrace ring;
+
+	void record(Emu8080::state *s, const uint8_t *opcode) {
+		text.record(s, opcode);
+		ring.record(s, opcode);
+	}
+	void stackMoved(Emu8080::state *s, uint8_t op, uint64_t cycles) {}
+	void resume(Emu8080::state *s) {}
+	void stop(Emu8080::state *s, const Emu8080::runResult &result) {}
+};
+
+// Cost of tracing, reports guest MIPS with no tracing and with the binary ring buffer
+void traceBenchmark(const std::string &path, uint64_t cycles) {
+	Emu8080::state plainState, ringState;
+	Emu8080::readFile(&plainState, path);
+	Emu8080::readFile(&ringState, path);
+	// None
+	Emu8080::noTrace none;
+	auto start = std::chrono::steady_clock::now();
+	Emu8080::runResult plain = Emu8080::runTraced(&plainState, cycles, none);
+	std::chrono::duration<double> plainTime = std::chrono::steady_clock::now() - start;
+	// Ring buffer, written out if the run crashes
+	Emu8080::ringTrace ring;
+	Emu8080::dumpOnCrash(&ring, CRASH_TRACE);
+	start = std::chrono::steady_clock::now();
+	Emu8080::runResult traced = Emu8080::runTraced(&ringState, cycles, ring);
+	std::chrono::duration<double> ringTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << path << "\n"
+		<< "  none: " << plain.instructions / plainTime.count() / 1e6 << " MIPS, " << plain.cycles << " cycles\n"
+		<< "  ring: " << ring.count / ringTime.count() / 1e6 << " MIPS, " << traced.cycles << " cycles\n";
+}
+
+// Run with a trace policy until cycles have run or it stops on anything but I/O, IN reads 0
+template <class tracePolicy>
+uint64_t runFor(Emu8080::state *s, uint64_t cycles, tracePolicy &trace) {
+	uint64_t ran = 0;
+	while (ran < cycles) {
+		Emu8080::runResult result = Emu8080::runTraced(s, cycles - ran, trace);
+		ran += result.cycles;
+		if (result.reason != Emu8080::STOP_IO) {
+			break;
+		}
+		if (result.input) {
+			s->r.a = 0;
 		}
 	}
+	return ran;
+}
 
-	// Compare register with accumulator
-	void cmp(state *s, uint8_t &reg) {
-		uint16_t result = (uint16_t)s->r.a - (uint16_t)reg;
-		checkFlags(s, result, true);
+// Profile a ROM for cycles, prints the opcode and hot address report and the profiler's overhead
+// Names come from symbolsPath and the collapsed call stacks go to collapsedPath, when given
+void profile(const std::string &path, uint64_t cycles, const std::string &symbolsPath, const std::string &collapsedPath) {
+	Emu8080::symbolMap symbols;
+	if (!symbolsPath.empty() && !symbols.load(symbolsPath)) {
+		std::cout << "Error: Could not open " << symbolsPath << "\n";
+		return;
+	}
+	// Alternate plain and profiled runs and keep the fastest of each, so the overhead isn't host noise
+	std::unique_ptr<Emu8080::guestProfile> guest;
+	double plainTime = 0, profiledTime = 0;
+	for (int i = 0; i < 3; i++) {
+		// None
+		Emu8080::state plainState;
+		Emu8080::readFile(&plainState, path);
+		Emu8080::noTrace none;
+		auto start = std::chrono::steady_clock::now();
+		runFor(&plainState, cycles, none);
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		plainTime = i == 0 ? time.count() : std::min(plainTime, time.count());
+		// Profiled
+		Emu8080::state profiledState;
+		Emu8080::readFile(&profiledState, path);
+		guest.reset(new Emu8080::guestProfile);
+		guest->paths = !collapsedPath.empty();
+		start = std::chrono::steady_clock::now();
+		runFor(&profiledState, cycles, *guest);
+		time = std::chrono::steady_clock::now() - start;
+		profiledTime = i == 0 ? time.count() : std::min(profiledTime, time.count());
 	}
 
-	// Push to stack
-	void push(state *s, uint8_t &reg1, uint8_t &reg2) {
-		s->memory[s->r.sp - 1] = reg1;
-		s->memory[s->r.sp - 2] = reg2;
-		s->r.sp -= 2;
-	}
-	// Pop from stack
-	void pop(state *s, uint8_t &reg1, uint8_t &reg2) {
-		reg2 = s->memory[s->r.sp];
-		reg1 = s->memory[s->r.sp + 1];
-		s->r.sp += 2;
+	guest->report(std::cout, symbols);
+	std::cout << "overhead " << (profiledTime / plainTime - 1) * 100 << "%\n";
+	if (!collapsedPath.empty()) {
+		std::ofstream collapsed(collapsedPath);
+		guest->writeCollapsed(collapsed, symbols);
+		if (!collapsed) {
+			std::cout << "Error: Could not write " << collapsedPath << "\n";
+		}
 	}
+}
 
-	// Return
-	void ret(state *s) {
-		s->r.pc = s->memory[s->r.sp] | (s->memory[s->r.sp + 1] << 8);
-		s->r.sp += 2;
+// ROM loading as readFile did before the mapped loader, one byte at a time through a stream iterator
+void streamLoad(Emu8080::state *s, const std::string &path) {
+	std::ifstream file(path, std::ios::binary);
+	file.unsetf(std::ios::skipws);
+	s->memory.insert(s->memory.begin(), std::istream_iterator<uint8_t>(file), std::istream_iterator<uint8_t>());
+}
+
+// Boot count CPUs from one ROM, reports microseconds per boot
+void loadBenchmark(const std::string &path, int count) {
+	// Stream
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		Emu8080::state s;
+		streamLoad(&s, path);
 	}
+	std::chrono::duration<double, std::micro> streamTime = std::chrono::steady_clock::now() - start;
+	// Mapped once, copied into each CPU
+	start = std::chrono::steady_clock::now();
+	Emu8080::romImage image(path);
+	for (int i = 0; i < count; i++) {
+		Emu8080::state s;
+		Emu8080::loadRegions(&s, { { &image, 0 } });
+	}
+	std::chrono::duration<double, std::micro> mappedTime = std::chrono::steady_clock::now() - start;
 
-	// Call adr
-	void call(state *s, uint8_t *reg) {
-		s->temp16 = s->r.pc + 2;
-		s->memory[s->r.sp - 1] = (s->temp16 >> 8) & 0xff;
-		s->memory[s->r.sp - 2] = (s->temp16 & 0xff);
-		s->r.sp = s->r.sp - 2;
-		s->r.pc = ((reg[2] << 8) | reg[1]) - 1; // -1 to account for PC + 1 at the end of switch
+	std::cout << path << ", " << image.size() << " bytes\n"
+		<< "  stream: " << streamTime.count() / count << " us/boot\n"
+		<< "  mapped: " << mappedTime.count() / count << " us/boot\n";
+}
+
+// State of the devices on s's bus, as a snapshot keeps it
+static std::vector<uint8_t> deviceState(Emu8080::state *s) {
+	std::vector<uint8_t> out;
+	for (const Emu8080::portDevice &d : s->ports->devices) {
+		d.save(out, d.context);
 	}
+	return out;
+}
 
-	// Jump adr
-	void jump(state* s, uint8_t *opcode) {
-		// -1 to account for PC + 1 at the end of switch
-		s->r.pc = ((opcode[2] << 8) | opcode[1]) - 1;
+// Snapshot a ROM every interval instructions, then restore the snapshots in a scrambled order
+// Every state has Space Invaders ports of its own, so the shift register and latches are snapshotted too
+// Reports microseconds per snapshot, restore and fork against copying the whole state, and the memory the snapshots hold
+void snapshotBenchmark(const std::string &path, int count, uint64_t interval) {
+	Emu8080::invadersPorts ports[4];
+	Emu8080::state s;
+	s.ports = &ports[0].bus;
+	Emu8080::readFile(&s, path);
+	std::vector<Emu8080::snapshot> snaps(count);
+	std::chrono::duration<double, std::micro> snapTime(0), copyTime;
+	for (int i = 0; i < count; i++) {
+		Emu8080::emulateThreaded(&s, interval);
+		auto start = std::chrono::steady_clock::now();
+		Emu8080::takeSnapshot(&s, snaps[i]);
+		snapTime += std::chrono::steady_clock::now() - start;
+	}
+	std::unordered_set<const void *> pages;
+	for (const Emu8080::snapshot &snap : snaps) {
+		for (const auto &page : snap.pages) {
+			pages.insert(page.get());
+		}
+	}
+	// Whole state copies, what a checkpoint cost before
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		Emu8080::state copy(s);
+	}
+	copyTime = std::chrono::steady_clock::now() - start;
+	// Restore into one state, in an order that jumps around
+	Emu8080::state child;
+	child.ports = &ports[1].bus;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		Emu8080::restoreSnapshot(&child, snaps[(i * 7919) % count]);
+	}
+	std::chrono::duration<double, std::micro> restoreTime = std::chrono::steady_clock::now() - start;
+	// Fork a running state over and over, each fork runs on for a while
+	Emu8080::state forked;
+	forked.ports = &ports[2].bus;
+	std::chrono::duration<double, std::micro> forkTime(0);
+	for (int i = 0; i < count; i++) {
+		start = std::chrono::steady_clock::now();
+		Emu8080::forkState(&s, &forked);
+		forkTime += std::chrono::steady_clock::now() - start;
+		Emu8080::emulateThreaded(&forked, interval);
+	}
+	// Running on from a restored snapshot must reach the next one
+	bool match = true;
+	Emu8080::state next;
+	next.ports = &ports[3].bus;
+	for (int i = 0; i + 1 < count; i += std::max(1, count / 16)) {
+		Emu8080::restoreSnapshot(&child, snaps[i]);
+		Emu8080::emulateThreaded(&child, interval);
+		Emu8080::restoreSnapshot(&next, snaps[i + 1]);
+		match = match && Emu8080::sameState(&child, &next) && deviceState(&child) == deviceState(&next);
 	}
 
-	// Parse code and execute instruction
-	void emulate8080(state *s) {
-		// Get the current instruction from the program counter
-		uint8_t *opcode = &s->memory[s->r.pc];
-		// Check the instruction and execute it
-		switch (*opcode) {
-		case 0x00: // NOP
-			break;
-		case 0x01: // LXI B, D16
-			s->r.c = opcode[1];
-			s->r.b = opcode[2];
-			s->r.pc += 2;
-			break;
-		case 0x02: // STAX B
-			s->temp16 = (s->r.b << 8) | s->r.c;
-			s->memory[s->temp16] = s->r.a;
-			break;
-		case 0x03: // INX B
-			add16(s->r.b, s->r.c, (uint8_t)1);
-			break;
-		case 0x04: // INR B
-			add8(s, s->r.b, (uint8_t)1, false);
-			break;
-		case 0x05: // DCR B
-			sub8(s, s->r.b, (uint8_t)1, false);
-			break;
-		case 0x06: // MVI B, D8
-			s->r.b = opcode[1];
-			s->r.pc++;
-			break;
-		case 0x07: // RLC
-			s->cc.cy = (s->r.a >> 7) & 1;
-			s->temp16 = (uint16_t)s->cc.cy;
-			s->r.a = (s->r.a << 1) | (uint8_t)s->temp16;
-			break;
-		case 0x08: // -
-			break;
-		case 0x09: // DAD B
-			add32_8(s, s->r.h, s->r.l, s->r.b, s->r.c);
-			break;
-		case 0x0A: // LDAX B
-			s->temp16 = (s->r.b << 8) | s->r.c;
-			s->r.a = s->memory[s->temp16];
-			break;
-		case 0x0B: // DCX B
-			sub16(s->r.b, s->r.c, (uint8_t)1);
-			break;
-		case 0x0C: // INR C
-			add8(s, s->r.c, (uint8_t)1, false);
-			break;
-		case 0x0D: // DCR C
-			sub8(s, s->r.c, (uint8_t)1, false);
-			break;
-		case 0x0E: // MVI C, D8
-			s->r.c = opcode[1];
-			s->r.pc++;
-			break;
-		case 0x0F: // RRC
-			s->cc.cy = s->r.a & 1;
-			s->temp16 = s->cc.cy;
-			s->r.a = (s->r.a >> 1) | (uint8_t)(s->temp16 << 7);
-			break;
-		case 0x10: // -
-			break;
-		case 0x11: // LXI D, D16
-			s->r.d = opcode[1];
-			s->r.e = opcode[2];
-			s->r.pc += 2;
-			break;
-		case 0x12: // STAX D
-			s->temp16 = (s->r.d << 8) | s->r.e;
-			s->memory[s->temp16] = s->r.a;
-			break;
-		case 0x13: // INX D
-			add16(s->r.d, s->r.e, (uint8_t)1);
-			break;
-		case 0x14: // INR D
-			add8(s, s->r.d, (uint8_t)1, false);
-			break;
-		case 0x15: // DCR D
-			sub8(s, s->r.d, (uint8_t)1, false);
-			break;
-		case 0x16: // MVI D, D8
-			s->r.d = opcode[1];
-			s->r.pc++;
-			break;
-		case 0x17: // RAL
-			s->temp16 = s->cc.cy;
-			s->cc.cy = (s->r.a >> 7) & 1;
-			s->r.a = (s->r.a << 1) | (uint8_t)s->temp16;
-			break;
-		case 0x18: // -
-			break;
-		case 0x19: // DAD D
-			add32_8(s, s->r.h, s->r.l, s->r.d, s->r.e);
-			break;
-		case 0x1A: // LDAX D
-			s->temp16 = (s->r.d << 8) | s->r.e;
-			s->r.a = s->memory[s->temp16];
-			break;
-		case 0x1B: // DCX D
-			sub16(s->r.d, s->r.e, (uint8_t)1);
-			break;
-		case 0x1C: // INR E
-			add8(s, s->r.e, (uint8_t)1, false);
-			break;
-		case 0x1D: // DCR E
-			sub8(s, s->r.e, (uint8_t)1, false);
-			break;
-		case 0x1E: // MVI E, D8
-			s->r.e = opcode[1];
-			s->r.pc++;
-			break;
-		case 0x1F: // RAR
-			s->cc.cy = s->r.a & 1;
-			s->temp16 = (uint16_t)s->r.a;
-			s->r.a = (s->r.a >> 1) | (uint8_t)(s->temp16 << 7);
-			break;
-		case 0x20: // -
-			break;
-		case 0x21: // LXI H, D16
-			s->r.l = opcode[1];
-			s->r.h = opcode[2];
-			s->r.pc += 2;
-			break;
-		case 0x22: // SHLD adr
-			s->temp16 = (opcode[2] << 8) | opcode[1];
-			s->memory[s->temp16] = s->r.l;
-			s->memory[s->temp16++] = s->r.h;
-			s->r.pc += 2;
-			break;
-		case 0x23: // INX H
-			add16(s->r.h, s->r.l, (uint8_t)1);
-			break;
-		case 0x24: // INR H
-			add8(s, s->r.h, (uint8_t)1, false);
-			break;
-		case 0x25: // DCR H
-			sub8(s, s->r.h, (uint8_t)1, false);
-			break;
-		case 0x26: // MVI H, D8
-			s->r.h = opcode[1];
-			s->r.pc++;
-			break;
-		case 0x27: // DAA - special
-			unimplementedInstruction(*opcode); break;
-		case 0x28: // -
-			break;
-		case 0x29: // DAD H
-			add32_8(s, s->r.h, s->r.l, s->r.h, s->r.l);
-			break;
-		case 0x2A: // LHLD adr
-			s->temp16 = (opcode[2] << 8) | opcode[1];
-			s->r.l = s->memory[s->temp16];
-			s->r.h = s->memory[s->temp16++];
-			s->r.pc += 2;
-			break;
-		case 0x2B: // DCX H
-			sub16(s->r.h, s->r.l, (uint8_t)1);
-			break;
-		case 0x2C: // INR L
-			add8(s, s->r.l, (uint8_t)1, false);
-			break;
-		case 0x2D: // DCR L
-			sub8(s, s->r.l, (uint8_t)1, false);
-			break;
-		case 0x2E: // MVI L, D8
-			s->r.l = opcode[1];
-			s->r.pc++;
-			break;
-		case 0x2F: // CMA
-			s->r.a = ~s->r.a;
-			break;
-		case 0x30: // -
-			break;
-		case 0x31: // LXI SP, D16
-			s->r.sp = (opcode[2] << 8) | opcode[1];
-			s->r.pc += 2;
-			break;
-		case 0x32: // STA adr
-			s->memory[(opcode[2] << 8) | opcode[1]] = s->r.a;
-			break;
-		case 0x33: // INX SP
-			s->r.sp++;
-			break;
-		case 0x34: // INR M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			add8(s, s->memory[s->temp16], (uint8_t)1, false);
-			break;
-		case 0x35: // DCR M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			sub8(s, s->memory[s->temp16], (uint8_t)1, false);
-			break;
-		case 0x36: // MVI M, D8
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			s->memory[s->temp16] = opcode[1];
-			s->r.pc++;
-			break;
-		case 0x37: // STC
-			s->cc.cy = 1;
-			break;
-		case 0x38: // -
-			break;
-		case 0x39: // DAD SP
-			add32_16(s, s->r.h, s->r.l, s->r.sp);
-			break;
-		case 0x3A: // LDA adr
-			s->temp16 = (opcode[2] << 8) | opcode[1];
-			s->r.a = s->memory[s->temp16];
-			break;
-		case 0x3B: // DCX SP
-			s->r.sp--;
-			break;
-		case 0x3C: // INR A
-			add8(s, s->r.a, (uint8_t)1, false);
-			break;
-		case 0x3D: // DCR A
-			sub8(s, s->r.a, (uint8_t)1, false);
-			break;
-		case 0x3E: // MVI A, D8
-			s->r.a = opcode[1];
-			s->r.pc++;
-			break;
-		case 0x3F: // CMC
-			s->cc.cy = ~s->cc.cy;
-			break;
-		case 0x40: // MOV B, B
-			mov8(s->r.b, s->r.b);
-			break;
-		case 0x41: // MOV B, C
-			mov8(s->r.b, s->r.c);
-			break;
-		case 0x42: // MOV B, D
-			mov8(s->r.b, s->r.d);
-			break;
-		case 0x43: // MOV B, E
-			mov8(s->r.b, s->r.e);
-			break;
-		case 0x44: // MOV B, H
-			mov8(s->r.b, s->r.h);
-			break;
-		case 0x45: // MOV B, L
-			mov8(s->r.b, s->r.l);
-			break;
-		case 0x46: // MOV B, M
-			movHL(s, s->r.b, false);
-			break;
-		case 0x47: // MOV B, A
-			mov8(s->r.b, s->r.a);
-			break;
-		case 0x48: // MOV C, B
-			mov8(s->r.c, s->r.b);
-			break;
-		case 0x49: // MOV C, C
-			mov8(s->r.c, s->r.c);
-			break;
-		case 0x4A: // MOV C, D
-			mov8(s->r.c, s->r.d);
-			break;
-		case 0x4B: // MOV C, E
-			mov8(s->r.c, s->r.e);
-			break;
-		case 0x4C: // MOV C, H
-			mov8(s->r.c, s->r.h);
-			break;
-		case 0x4D: // MOV C, L
-			mov8(s->r.c, s->r.l);
-			break;
-		case 0x4E: // MOV C, M
-			movHL(s, s->r.c, false);
-			break;
-		case 0x4F: // MOV C, A
-			mov8(s->r.c, s->r.a);
-			break;
-		case 0x50: // MOV D, B
-			mov8(s->r.d, s->r.b);
-			break;
-		case 0x51: // MOV D, C
-			mov8(s->r.d, s->r.c);
-			break;
-		case 0x52: // MOV D, D
-			mov8(s->r.d, s->r.d);
-			break;
-		case 0x53: // MOV D, E
-			mov8(s->r.d, s->r.e);
-			break;
-		case 0x54: // MOV D, H
-			mov8(s->r.d, s->r.h);
-			break;
-		case 0x55: // MOV D, L
-			mov8(s->r.d, s->r.l);
-			break;
-		case 0x56: // MOV D, M
-			movHL(s, s->r.d, false);
-			break;
-		case 0x57: // MOV D, A
-			mov8(s->r.d, s->r.a);
-			break;
-		case 0x58: // MOV E, B
-			mov8(s->r.e, s->r.b);
-			break;
-		case 0x59: // MOV E, C
-			mov8(s->r.e, s->r.c);
-			break;
-		case 0x5A: // MOV E, D
-			mov8(s->r.e, s->r.d);
-			break;
-		case 0x5B: // MOV E, E
-			mov8(s->r.e, s->r.e);
-			break;
-		case 0x5C: // MOV E, H
-			mov8(s->r.e, s->r.h);
-			break;
-		case 0x5D: // MOV E, L
-			mov8(s->r.e, s->r.l);
-			break;
-		case 0x5E: // MOV E, M
-			movHL(s, s->r.e, false);
-			break;
-		case 0x5F: // MOV E, A
-			mov8(s->r.e, s->r.a);
-			break;
-		case 0x60: // MOV H, B
-			mov8(s->r.h, s->r.b);
-			break;
-		case 0x61: // MOV H, C
-			mov8(s->r.h, s->r.c);
-			break;
-		case 0x62: // MOV H, D
-			mov8(s->r.h, s->r.d);
-			break;
-		case 0x63: // MOV H, E
-			mov8(s->r.h, s->r.e);
-			break;
-		case 0x64: // MOV H, H
-			mov8(s->r.h, s->r.h);
-			break;
-		case 0x65: // MOV H, L
-			mov8(s->r.h, s->r.l);
-			break;
-		case 0x66: // MOV H, M
-			movHL(s, s->r.h, false);
-			break;
-		case 0x67: // MOV H, A
-			mov8(s->r.h, s->r.a);
-			break;
-		case 0x68: // MOV L, B
-			mov8(s->r.l, s->r.b);
-			break;
-		case 0x69: // MOV L, C
-			mov8(s->r.l, s->r.c);
-			break;
-		case 0x6A: // MOV L, D
-			mov8(s->r.l, s->r.d);
-			break;
-		case 0x6B: // MOV L, E
-			mov8(s->r.l, s->r.e);
-			break;
-		case 0x6C: // MOV L, H
-			mov8(s->r.l, s->r.h);
-			break;
-		case 0x6D: // MOV L, L
-			mov8(s->r.l, s->r.l);
-			break;
-		case 0x6E: // MOV L, M
-			movHL(s, s->r.l, false);
-			break;
-		case 0x6F: // MOV M, A
-			mov8(s->r.l, s->r.a);
-			break;
-		case 0x70: // MOV M, B
-			movHL(s, s->r.b, true);
-			break;
-		case 0x71: // MOV M, C
-			movHL(s, s->r.c, true);
-			break;
-		case 0x72: // MOV M, D
-			movHL(s, s->r.d, true);
-			break;
-		case 0x73: // MOV M, E
-			movHL(s, s->r.e, true);
-			break;
-		case 0x74: // MOV M, H
-			movHL(s, s->r.h, true);
-			break;
-		case 0x75: // MOV M, L
-			movHL(s, s->r.l, true);
-			break;
-		case 0x76: // HLT - special
-			unimplementedInstruction(*opcode); break;
-		case 0x77: // MOV M, A
-			movHL(s, s->r.a, true);
-			break;
-		case 0x78: // MOV A, B
-			mov8(s->r.a, s->r.b);
-			break;
-		case 0x79: // MOV A, C
-			mov8(s->r.a, s->r.c);
-			break;
-		case 0x7A: // MOV A, D
-			mov8(s->r.a, s->r.d);
-			break;
-		case 0x7B: // MOV A, E
-			mov8(s->r.a, s->r.e);
-			break;
-		case 0x7C: // MOV A, H
-			mov8(s->r.a, s->r.h);
-			break;
-		case 0x7D: // MOV A, L
-			mov8(s->r.a, s->r.l);
-			break;
-		case 0x7E: // MOV A, M
-			movHL(s, s->r.a, false);
-			break;
-		case 0x7F: // MOV A, A
-			mov8(s->r.a, s->r.a);
-			break;
-		case 0x80: // ADD B
-			add8(s, s->r.a, s->r.b, true);
-			break;
-		case 0x81: // ADD C
-			add8(s, s->r.a, s->r.c, true);
-			break;
-		case 0x82: // ADD D
-			add8(s, s->r.a, s->r.d, true);
-			break;
-		case 0x83: // ADD E
-			add8(s, s->r.a, s->r.e, true);
-			break;
-		case 0x84: // ADD H
-			add8(s, s->r.a, s->r.h, true);
-			break;
-		case 0x85: // ADD L
-			add8(s, s->r.a, s->r.l, true);
-			break;
-		case 0x86: // ADD M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			add8(s, s->r.a, s->memory[s->temp16], true);
-			break;
-		case 0x87: // ADD A
-			add8(s, s->r.a, s->r.a, true);
-			break;
-		case 0x88: // ADC B
-			adc(s, s->r.a, s->r.b, true);
-			break;
-		case 0x89: // ADC C
-			adc(s, s->r.a, s->r.c, true);
-			break;
-		case 0x8A: // ADC D
-			adc(s, s->r.a, s->r.d, true);
-			break;
-		case 0x8B: // ADC E
-			adc(s, s->r.a, s->r.e, true);
-			break;
-		case 0x8C: // ADC H
-			adc(s, s->r.a, s->r.h, true);
-			break;
-		case 0x8D: // ADC L
-			adc(s, s->r.a, s->r.l, true);
-			break;
-		case 0x8E: // ADC M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			adc(s, s->r.a, s->memory[s->temp16], true);
-			break;
-		case 0x8F: // ADC A
-			adc(s, s->r.a, s->r.a, true);
-			break;
-		case 0x90: // SUB B
-			sub8(s, s->r.a, s->r.b, true);
-			break;
-		case 0x91: // SUB C
-			sub8(s, s->r.a, s->r.c, true);
-			break;
-		case 0x92: // SUB D
-			sub8(s, s->r.a, s->r.d, true);
-			break;
-		case 0x93: // SUB E
-			sub8(s, s->r.a, s->r.e, true);
-			break;
-		case 0x94: // SUB H
-			sub8(s, s->r.a, s->r.h, true);
-			break;
-		case 0x95: // SUB L
-			sub8(s, s->r.a, s->r.l, true);
-			break;
-		case 0x96: // SUB M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			sub8(s, s->r.a, s->memory[s->temp16], true);
-			break;
-		case 0x97: // SUB A
-			sub8(s, s->r.a, s->r.a, true);
-			break;
-		case 0x98: // SBB B
-			sbb(s, s->r.a, s->r.b, true);
-			break;
-		case 0x99: // SBB C
-			sbb(s, s->r.a, s->r.c, true);
-			break;
-		case 0x9A: // SBB D
-			sbb(s, s->r.a, s->r.d, true);
-			break;
-		case 0x9B: // SBB E
-			sbb(s, s->r.a, s->r.e, true);
-			break;
-		case 0x9C: // SBB H
-			sbb(s, s->r.a, s->r.h, true);
-			break;
-		case 0x9D: // SBB L
-			sbb(s, s->r.a, s->r.l, true);
-			break;
-		case 0x9E: // SBB M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			sbb(s, s->r.a, s->memory[s->temp16], true);
-			break;
-		case 0x9F: // SBB A
-			sbb(s, s->r.a, s->r.a, true);
-			break;
-		case 0xA0: // ANA B
-			ana(s, s->r.a, s->r.b);
-			break;
-		case 0xA1: // ANA C
-			ana(s, s->r.a, s->r.c);
-			break;
-		case 0xA2: // ANA D
-			ana(s, s->r.a, s->r.d);
-			break;
-		case 0xA3: // ANA E
-			ana(s, s->r.a, s->r.e);
-			break;
-		case 0xA4: // ANA H
-			ana(s, s->r.a, s->r.h);
-			break;
-		case 0xA5: // ANA L
-			ana(s, s->r.a, s->r.l);
-			break;
-		case 0xA6: // ANA M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			ana(s, s->r.a, s->memory[s->temp16]);
-			break;
-		case 0xA7: // ANA A
-			ana(s, s->r.a, s->r.a);
-			break;
-		case 0xA8: // XRA B
-			xra(s, s->r.a, s->r.b);
-			break;
-		case 0xA9: // XRA C
-			xra(s, s->r.a, s->r.c);
-			break;
-		case 0xAA: // XRA D
-			xra(s, s->r.a, s->r.d);
-			break;
-		case 0xAB: // XRA E
-			xra(s, s->r.a, s->r.e);
-			break;
-		case 0xAC: // XRA H
-			xra(s, s->r.a, s->r.h);
-			break;
-		case 0xAD: // XRA L
-			xra(s, s->r.a, s->r.l);
-			break;
-		case 0xAE: // XRA M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			xra(s, s->r.a, s->memory[s->temp16]);
-			break;
-		case 0xAF: // XRA A
-			xra(s, s->r.a, s->r.a);
-			break;
-		case 0xB0: // ORA B
-			ora(s, s->r.a, s->r.b);
-			break;
-		case 0xB1: // ORA C
-			ora(s, s->r.a, s->r.c);
-			break;
-		case 0xB2: // ORA D
-			ora(s, s->r.a, s->r.d);
-			break;
-		case 0xB3: // ORA E
-			ora(s, s->r.a, s->r.e);
-			break;
-		case 0xB4: // ORA H
-			ora(s, s->r.a, s->r.h);
-			break;
-		case 0xB5: // ORA L
-			ora(s, s->r.a, s->r.l);
-			break;
-		case 0xB6: // ORA M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			ora(s, s->r.a, s->memory[s->temp16]);
-			break;
-		case 0xB7: // ORA A
-			ora(s, s->r.a, s->r.a);
-			break;
-		case 0xB8: // CMP B
-			cmp(s, s->r.b);
-			break;
-		case 0xB9: // CMP C
-			cmp(s, s->r.c);
-			break;
-		case 0xBA: // CMP D
-			cmp(s, s->r.d);
-			break;
-		case 0xBB: // CMP E
-			cmp(s, s->r.e);
-			break;
-		case 0xBC: // CMP H
-			cmp(s, s->r.h);
-			break;
-		case 0xBD: // CMP L
-			cmp(s, s->r.l);
-			break;
-		case 0xBE: // CMP M
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			cmp(s, s->memory[s->temp16]);
-			break;
-		case 0xBF: // CMP A
-			cmp(s, s->r.a);
-			break;
-		case 0xC0: // RNZ
-			if (!s->cc.z) {
-				ret(s);
-			}
-			break;
-		case 0xC1: // POP B
-			pop(s, s->r.b, s->r.c);
-			break;
-		case 0xC2: // JNZ adr
-			if (s->cc.z) {
-				jump(s, opcode);
-			} else {
-				s->r.pc += 2;
-			}
-			break;
-		case 0xC3: // JMP adr
-			jump(s, opcode);
-			break;
-		case 0xC4: // CNZ adr
-			if (!s->cc.z) {
-				call(s, opcode);
-			}
-			break;
-		case 0xC5: // PUSH B
-			push(s, s->r.b, s->r.c);
-			break;
-		case 0xC6: // ADI D8
-			add8(s, s->r.a, opcode[1], true);
-			break;
-		case 0xC7: // RST 0
-			// TODO this is a special instruction, this subroutine might need to be implemented
-			call(s, (uint8_t*)0x00);
-			break;
-		case 0xC8: // RZ
-			if (s->cc.z) {
-				ret(s);
-			}
-			break;
-		case 0xC9: // RET
-			ret(s);
-			break;
-		case 0xCA: // JZ adr
-			if (s->cc.z) {
-				jump(s, opcode);
-			} else {
-				s->r.pc += 2;	
-			}
-			break;
-		case 0xCB: // -
-			break;
-		case 0xCC: // CZ adr
-			if (s->cc.z) {
-				call(s, opcode);
-			}
-			break;
-		case 0xCD: // CALL adr
-			call(s, opcode);
-			break;
-		case 0xCE: // ACI D8
-			add8(s, s->r.a, opcode[1] + s->cc.cy, true);
-			break;
-		case 0xCF: // RST 1
-			// TODO this is a special instruction, this subroutine might need to be implemented
-			call(s, (uint8_t*)0x08);
-			break;
-		case 0xD0: // RNC
-			if (!s->cc.cy) {
-				ret(s);
-			}
-			break;
-		case 0xD1: // POP D
-			pop(s, s->r.d, s->r.e); 
-			break;
-		case 0xD2: // JNC adr
-			if (!s->cc.cy) {
-				jump(s, opcode);
-			} else {
-				s->r.pc += 2;
-			}
-			break;
-		case 0xD3: // OUT D8 - special
-			unimplementedInstruction(*opcode); break;
-		case 0xD4: // CNC adr
-			if (!s->cc.cy) {
-				call(s, opcode);
-			}
-			break;
-		case 0xD5: // PUSH D
-			push(s, s->r.d, s->r.e);
-			break;
-		case 0xD6: // SUI D8
-			sub8(s, s->r.a, opcode[1], true);
-			break;
-		case 0xD7: // RST 2
-			// TODO this is a special instruction, this subroutine might need to be implemented
-			call(s, (uint8_t*)0x10);
-			break;
-		case 0xD8: // RC
-			if (s->cc.cy) {
-				ret(s);
-			}
-			break;
-		case 0xD9: // -
-			break;
-		case 0xDA: // JC adr
-			if (s->cc.cy) {
-				jump(s, opcode);
-			}
-			break;
-		case 0xDB: // IN D8 - special
-			unimplementedInstruction(*opcode); break;
-		case 0xDC: // CC adr
-			if (s->cc.cy) {
-				call(s, opcode);
-			}
-			break;
-		case 0xDD: // -
-			break;
-		case 0xDE: // SBI D8
-			sub8(s, s->r.a, opcode[1] - s->cc.cy, true);
-			break;
-		case 0xDF: // RST 3
-			// TODO this is a special instruction, this subroutine might need to be implemented
-			call(s, (uint8_t*)0x18);
-			break;
-		case 0xE0: // RPO
-			if (!s->cc.p) {
-				ret(s);
-			}
-			break;
-		case 0xE1: // POP H
-			pop(s, s->r.h, s->r.l);
-			break;
-		case 0xE2: // JPO adr
-			if (!s->cc.p) {
-				jump(s, opcode);
-			} else {
-				s->r.pc += 2;
-			}
-			break;
-		case 0xE3: // XTHL
-			// Swap L and SP
-			s->temp8 = s->memory[s->r.sp]; // Save SP
-			s->memory[s->r.sp] = s->r.l; // Move L to SP
-			s->r.l = s->temp8; // Move prev SP to L
-			// Swap H and SP + 1
-			s->temp8 = s->memory[s->r.sp + 1]; // Save SP + 1
-			s->memory[s->r.sp + 1] = s->r.h; // Move H to SP + 1
-			s->r.h = s->temp8; // Move prev SP + 1 to H
-			break;
-		case 0xE4: // CPO adr
-			if (!s->cc.p) {
-				call(s, opcode);
-			}
-			break;
-		case 0xE5: // PUSH H
-			push(s, s->r.h, s->r.l);
-			break;
-		case 0xE6: // ANI D8	
-			ana(s, s->r.a, opcode[1]);
-			s->r.pc++;
-			break;
-		case 0xE7: // RST 4
-			// TODO this is a special instruction, this subroutine might need to be implemented
-			call(s, (uint8_t*)0x20);
-			break;
-		case 0xE8: // RPE
-			if (s->cc.p) {
-				ret(s);
-			}
-			break;
-		case 0xE9: // PCHL
-			// High order is H
-			s->r.pc = (s->r.pc & 0x00ff) | (s->r.h << 8);
-			// Low order is L
-			s->r.pc = (s->r.pc & 0xff00) | s->r.l;		
-			break;
-		case 0xEA: // JPE adr
-			if (s->cc.p) {
-				jump(s, opcode);
-			} else {
-				s->r.pc += 2;
-			}
-			break;
-		case 0xEB: // XCHG
-			// Swap L and SP
-			s->temp8 = s->r.d; // Save D
-			s->r.d = s->r.h; // Move H to D
-			s->r.h = s->temp8; // Move prev D to H
-			// Swap H and SP + 1
-			s->temp8 = s->r.e; // Save E
-			s->r.e = s->r.l; // Move L to E
-			s->r.l = s->temp8; // Move prev E to L
-			break;
-		case 0xEC: // CPE adr
-			if (s->cc.p) {
-				call(s, opcode);
-			}
-			break;
-		case 0xED: // -
-			break;
-		case 0xEE: // XRI D8
-			xra(s, s->r.a, opcode[1]);
-			break;
-		case 0xEF: // RST 5
-			// TODO this is a special instruction, this subroutine might need to be implemented
-			call(s, (uint8_t*)0x28);
-			break;
-		case 0xF0: // RP
-			if (!s->cc.s) {
-				ret(s);
-			}
-			break;
-		case 0xF1: // POP PSW
-			s->r.a = s->memory[s->r.sp + 1];
-			s->temp8 = s->memory[s->r.sp]; // PSW
-			s->cc.z = (0x01 == (s->temp8 & 0x01));
-			s->cc.s = (0x02 == (s->temp8 & 0x02));
-			s->cc.p = (0x04 == (s->temp8 & 0x04));
-			s->cc.cy = (0x05 == (s->temp8 & 0x08));
-			s->cc.ac = (0x10 == (s->temp8 & 0x10));
-			s->r.sp += 2;
-			break;
-		case 0xF2: // JP adr
-			if (!s->cc.s) {
-				jump(s, opcode);
-			} else {
-				s->r.pc += 2;
-			}
-			break;
-		case 0xF3: // DI - special
-			unimplementedInstruction(*opcode); break;
-		case 0xF4: // CP adr
-			if (!s->cc.s) {
-				call(s, opcode);
-			}
-			break;
-		case 0xF5: // PUSH PSW
-			s->temp8 = (s->cc.z | s->cc.s << 1 | s->cc.p << 2 | s->cc.cy << 3 | s->cc.ac << 4); // PSW
-			push(s, s->r.a, s->temp8);
-			break;
-		case 0xF6: // ORI D8
-			ora(s, s->r.a, opcode[1]);
-			s->r.pc++;
-			break;
-		case 0xF7: // RST 6
-			// TODO this is a special instruction, this subroutine might need to be implemented
-			call(s, (uint8_t*)0x30);
-			break;
-		case 0xF8: // RM
-			if (s->cc.s) {
-				ret(s);
-			}
-			break;
-		case 0xF9: // SPHL
-			s->temp16 = (s->r.h << 8) | s->r.l;
-			s->r.sp = s->temp16;
-			break;
-		case 0xFA: // JM adr
-			if (s->cc.s) {
-				jump(s, opcode);
-			} else {
-				s->r.pc += 2;
-			}
-			break;
-		case 0xFB: // EI - special
-			unimplementedInstruction(*opcode); break;
-		case 0xFC: // CM adr
-			if (s->cc.s) {
-				call(s, opcode);
+	std::cout << path << ", " << count << " snapshots " << interval << " instructions apart\n"
+		<< "  copy:     " << copyTime.count() / count << " us, " << count * 64 << " KB\n"
+		<< "  snapshot: " << snapTime.count() / count << " us, " << pages.size() / 4 << " KB of pages\n"
+		<< "  restore:  " << restoreTime.count() / count << " us\n"
+		<< "  fork:     " << forkTime.count() / count << " us, state " << (match ? "match" : "MISMATCH") << "\n";
+}
+
+// Read a job list, one job per line, blank lines and lines starting with # are skipped
+//   rom cycles [address]     run a ROM loaded at address, 0 by default
+//   invaders rom|dir frames  run Space Invaders with its screen interrupts
+bool readJobs(const std::string &path, std::vector<Emu8080::batchJob> &jobs) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cout << "Error: Could not open " << path << "\n";
+		return false;
+	}
+	std::string line;
+	int number = 0;
+	while (std::getline(file, line)) {
+		number++;
+		std::istringstream fields(line);
+		std::string first;
+		if (!(fields >> first) || first[0] == '#') {
+			continue;
+		}
+		Emu8080::batchJob job;
+		bool valid;
+		if (first == "invaders") {
+			uint64_t frames = 0;
+			valid = (bool)(fields >> job.path >> frames);
+			job.cycles = frames * INVADERS_FRAME;
+			job.setup = invadersSetup;
+		} else {
+			std::string address;
+			job.path = first;
+			valid = (bool)(fields >> job.cycles);
+			if (valid && fields >> address) {
+				job.address = (uint16_t)std::strtoul(address.c_str(), nullptr, 0);
 			}
+		}
+		if (!valid) {
+			std::cout << "Error: " << path << " line " << number << " is not a job\n";
+			return false;
+		}
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+// Run a job list on every core and report how each job stopped
+void batch(const std::string &path, unsigned threads) {
+	const char *reasons[] = { "cycle budget", "halt", "breakpoint", "unimplemented instruction", "I/O" };
+	std::vector<Emu8080::batchJob> jobs;
+	if (!readJobs(path, jobs)) {
+		return;
+	}
+	Emu8080::batchStats stats = Emu8080::runBatch(jobs, threads);
+	uint64_t stopped[5] = {};
+	for (const Emu8080::batchJob &job : jobs) {
+		if (!job.loaded) {
+			std::cout << job.path << ": not loaded\n";
+			continue;
+		}
+		stopped[job.reason]++;
+	}
+	std::cout << jobs.size() << " jobs on " << stats.threads << " threads in " << stats.seconds << " s, "
+		<< stats.mips() << " MIPS, " << stats.cycles << " cycles, " << stats.steals << " stolen\n";
+	for (int i = 0; i < 5; i++) {
+		if (stopped[i] > 0) {
+			std::cout << "  " << reasons[i] << ": " << stopped[i] << "\n";
+		}
+	}
+}
+
+// Run count copies of a ROM on 1, 2, 4... threads up to every core and report how throughput scales
+void batchBenchmark(const std::string &path, int count, uint64_t cycles) {
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	double single = 0;
+	for (unsigned threads = 1; ; threads = std::min(threads * 2, cores)) {
+		std::vector<Emu8080::batchJob> jobs(count);
+		for (Emu8080::batchJob &job : jobs) {
+			job.path = path;
+			job.cycles = cycles;
+		}
+		Emu8080::batchStats stats = Emu8080::runBatch(jobs, threads);
+		if (threads == 1) {
+			single = stats.mips();
+		}
+		std::cout << "  " << threads << " threads: " << stats.mips() << " MIPS, "
+			<< stats.mips() / single << "x, " << stats.steals << " stolen\n";
+		if (threads == cores) {
 			break;
-		case 0xFD: // -
-			break;
-		case 0xFE: // CPI D8
-			s->temp16 = s->r.a - opcode[1];
-			checkFlags(s, s->temp16, true);
-			break;
-		case 0xFF: // RST 7
-			// TODO this is a special instruction, this subroutine might need to be implemented
-			call(s, (uint8_t*)0x38);
-			break;
-		default:
-			unimplementedInstruction(*opcode); break;
 		}
-		// Increment program counter
-		s->r.pc++;
-		// Print state - testing only
-		printState(s, *opcode, (opcode[2] << 8) | opcode[1]);
 	}
-	
-	// Tests
+}
+
+// Differential test emulate8080 against the reference model, a reproducer for each opcode that diverged
+// Returns the exit code, 1 if any case diverged
+int fuzz(uint64_t cases, uint64_t seed, unsigned threads) {
+	Emu8080::fuzzStats stats = Emu8080::runFuzz(cases, seed, threads);
+	std::cout << stats.cases << " cases, " << stats.instructions << " instructions, seed " << stats.seed << ", "
+		<< stats.threads << " threads in " << stats.seconds << " s, " << stats.casesPerSecond() / 1e6 << " M cases/s\n"
+		<< stats.divergent << " diverged on " << stats.divergences.size() << " opcodes, emulate8080 vs reference\n";
+	for (const Emu8080::fuzzDivergence &d : stats.divergences) {
+		Emu8080::writeDivergence(std::cout, d);
+	}
+	return stats.divergent > 0 ? 1 : 0;
+}
 
-	void testRegisters(state *s) {
-		s->r.c = 0x01;
-		s->r.e = 0xFF;
+// Differential test the tiered engine against emulate8080, a reproducer for each first opcode that diverged
+// Returns the exit code, 1 if any case diverged
+int fuzzJit(uint64_t cases, uint64_t seed) {
+	Emu8080::fuzzStats stats = Emu8080::runJitFuzz(cases, seed);
+	std::cout << stats.cases << " cases, " << stats.instructions << " instructions, seed " << stats.seed << " in "
+		<< stats.seconds << " s, " << stats.casesPerSecond() / 1e6 << " M cases/s\n"
+		<< stats.divergent << " diverged on " << stats.divergences.size() << " opcodes, emulate8080 vs emulateJit\n";
+	for (const Emu8080::fuzzDivergence &d : stats.divergences) {
+		Emu8080::writeDivergence(std::cout, d);
 	}
+	return stats.divergent > 0 ? 1 : 0;
+}
+
+// OUT 1 in a loop
+static const uint8_t GUEST_IO[] = {
+	0xD3, 0x01, // OUT 1
+	0xC3, 0x00, 0x00 // JMP 0
+};
 
-	void cpudiagFix(state *s) {
-		//Fix the first instruction to be JMP 0x100    
-		s->memory[0] = 0xc3;
-		s->memory[1] = 0;
-		s->memory[2] = 0x01;
+// HLT in a loop, each interrupt returns to the next one
+static const uint8_t GUEST_HALT[] = {
+	0x31, 0x00, 0xF0, // LXI SP, F000
+	0xFB, 0x76, // 03: EI, HLT
+	0xC3, 0x03, 0x00, // JMP 3
+	0xC9 // 08: RET
+};
 
-		//Fix the stack pointer from 0x6ad to 0x7ad    
-		// this 0x06 byte 112 in the code, which is    
-		// byte 112 + 0x100 = 368 in memory    
-		s->memory[368] = 0x7;
+// Answers each guest's OUT at once until it has made rounds of them, then leaves it waiting
+class guestCounter {
+public:
+	std::vector<uint64_t> outs;
+	uint64_t rounds = 0;
+};
 
-		//Skip DAA test    
-		s->memory[0x59c] = 0xc3; //JMP    
-		s->memory[0x59d] = 0xc2;
-		s->memory[0x59e] = 0x05;
+void guestOut(Emu8080::guestLoop *loop, uint32_t guest, uint8_t port, bool in, uint8_t value, void *context) {
+	guestCounter *counter = static_cast<guestCounter *>(context);
+	if (++counter->outs[guest] < counter->rounds) {
+		loop->complete(guest, value);
+	}
+}
+
+// Time guests suspending on OUT and HLT in a guestLoop on one thread, against the same work as a plain loop
+// over run() handling each stop inline, the difference is what a coroutine switch costs
+void guestBenchmark(uint32_t count, uint64_t rounds) {
+	const char *names[] = { "io", "halt" };
+	for (int kind = 0; kind < 2; kind++) {
+		const uint8_t *program = kind == 0 ? GUEST_IO : GUEST_HALT;
+		size_t size = kind == 0 ? sizeof(GUEST_IO) : sizeof(GUEST_HALT);
+		double seconds[2];
+		uint64_t switches[2] = {};
+		bool match = true;
+		std::vector<Emu8080::state> states[2];
+		for (int coroutines = 0; coroutines < 2; coroutines++) {
+			states[coroutines].resize(count);
+			for (Emu8080::state &s : states[coroutines]) {
+				std::memcpy(s.memory.data(), program, size);
+			}
+			guestCounter counter;
+			counter.outs.assign(count, 0);
+			counter.rounds = rounds;
+			Emu8080::guestLoop loop;
+			auto start = std::chrono::steady_clock::now();
+			if (coroutines) {
+				loop.attach(1, guestOut, &counter);
+				for (Emu8080::state &s : states[1]) {
+					loop.add(&s);
+				}
+				loop.runReady();
+				for (uint64_t round = 1; kind == 1 && round < rounds; round++) {
+					for (uint32_t id = 0; id < count; id++) {
+						loop.interrupt(id, 1);
+					}
+					loop.runReady();
+				}
+				switches[1] = loop.switches;
+			} else {
+				for (uint64_t round = 0; round < rounds; round++) {
+					for (Emu8080::state &s : states[0]) {
+						if (round > 0 && kind == 1) {
+							Emu8080::interrupt(&s, 1);
+						}
+						Emu8080::runResult result;
+						do {
+							result = Emu8080::run(&s, Emu8080::GUEST_SLICE);
+						} while (result.reason == Emu8080::STOP_BUDGET);
+						switches[0]++;
+					}
+				}
+			}
+			std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+			seconds[coroutines] = time.count();
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			match = match && Emu8080::sameState(&states[0][i], &states[1][i]);
+		}
+		double plain = seconds[0] * 1e9 / switches[0], resumed = seconds[1] * 1e9 / switches[1];
+		std::cout << "  " << names[kind] << ": " << count << " guests, " << switches[1] << " switches, "
+			<< resumed << " ns per switch, " << plain << " ns per stop without coroutines, "
+			<< resumed - plain << " ns overhead, state " << (match ? "match" : "MISMATCH") << "\n";
 	}
 }
 
 int main(int argc, char *argv[]) {
+	// Benchmark engines, --bench rom...
+	if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+		for (int i = 2; i < argc; i++) {
+			benchmark(argv[i], 100000000);
+		}
+		return 0;
+	}
+	// Benchmark tracing, --bench-trace rom..., the ring trace goes to crash.trace if it crashes
+	if (argc > 1 && std::strcmp(argv[1], "--bench-trace") == 0) {
+		for (int i = 2; i < argc; i++) {
+			traceBenchmark(argv[i], 1000000000);
+		}
+		return 0;
+	}
+	// Print a saved or crash dumped ring trace, --show-trace file
+	if (argc > 2 && std::strcmp(argv[1], "--show-trace") == 0) {
+		showTrace(argv[2]);
+		return 0;
+	}
+	// Profile a ROM, --profile rom cycles [--symbols map] [--collapsed file]
+	if (argc > 3 && std::strcmp(argv[1], "--profile") == 0) {
+		std::string symbols, collapsed;
+		for (int i = 4; i + 1 < argc; i += 2) {
+			if (std::strcmp(argv[i], "--symbols") == 0) {
+				symbols = argv[i + 1];
+			} else if (std::strcmp(argv[i], "--collapsed") == 0) {
+				collapsed = argv[i + 1];
+			}
+		}
+		profile(argv[2], std::strtoull(argv[3], nullptr, 10), symbols, collapsed);
+		return 0;
+	}
+	// Benchmark ROM loading, --bench-load rom...
+	if (argc > 1 && std::strcmp(argv[1], "--bench-load") == 0) {
+		for (int i = 2; i < argc; i++) {
+			loadBenchmark(argv[i], 10000);
+		}
+		return 0;
+	}
+	// Benchmark snapshots, --bench-snapshot rom...
+	if (argc > 1 && std::strcmp(argv[1], "--bench-snapshot") == 0) {
+		for (int i = 2; i < argc; i++) {
+			snapshotBenchmark(argv[i], 10000, 10000);
+		}
+		return 0;
+	}
+	// Benchmark lockstep lanes against separate CPUs, --bench-lockstep rom...
+	if (argc > 1 && std::strcmp(argv[1], "--bench-lockstep") == 0) {
+		for (int i = 2; i < argc; i++) {
+			lockstepBenchmark(argv[i], 10000000, false);
+			lockstepBenchmark(argv[i], 10000000, true);
+		}
+		return 0;
+	}
+	// Benchmark video conversion, --bench-video
+	if (argc > 1 && std::strcmp(argv[1], "--bench-video") == 0) {
+		videoBenchmark(20000);
+		return 0;
+	}
+	// Benchmark suite, --bench-suite [--csv | --json] [rom directory]
+	if (argc > 1 && std::strcmp(argv[1], "--bench-suite") == 0) {
+		std::string format = "table", directory = ".";
+		for (int i = 2; i < argc; i++) {
+			if (std::strcmp(argv[i], "--csv") == 0) {
+				format = "csv";
+			} else if (std::strcmp(argv[i], "--json") == 0) {
+				format = "json";
+			} else {
+				directory = argv[i];
+			}
+		}
+		benchSuite(format, directory);
+		return 0;
+	}
+	// Benchmark port dispatch, --bench-ports
+	if (argc > 1 && std::strcmp(argv[1], "--bench-ports") == 0) {
+		portsBenchmark(1000000000);
+		return 0;
+	}
+	// Benchmark flag computation, --bench-flags
+	if (argc > 1 && std::strcmp(argv[1], "--bench-flags") == 0) {
+		flagsBenchmark(100000000);
+		return 0;
+	}
+	// Benchmark coroutine guest switches, --bench-guests [guests] [rounds]
+	if (argc > 1 && std::strcmp(argv[1], "--bench-guests") == 0) {
+		guestBenchmark(argc > 2 ? std::atoi(argv[2]) : 1000, argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1000);
+		return 0;
+	}
+	// Differential test the instruction set, --fuzz [cases] [seed] [threads]
+	if (argc > 1 && std::strcmp(argv[1], "--fuzz") == 0) {
+		return fuzz(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000000,
+			argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1, argc > 4 ? std::atoi(argv[4]) : 0);
+	}
+	// Differential test the tiered engine, --fuzz-jit [cases] [seed]
+	if (argc > 1 && std::strcmp(argv[1], "--fuzz-jit") == 0) {
+		return fuzzJit(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000, argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1);
+	}
+	// Run a job list, --batch jobs [threads]
+	if (argc > 2 && std::strcmp(argv[1], "--batch") == 0) {
+		batch(argv[2], argc > 3 ? std::atoi(argv[3]) : 0);
+		return 0;
+	}
+	// Benchmark batch scaling, --bench-batch rom...
+	if (argc > 1 && std::strcmp(argv[1], "--bench-batch") == 0) {
+		for (int i = 2; i < argc; i++) {
+			std::cout << argv[i] << "\n";
+			batchBenchmark(argv[i], 256, 20000000);
+		}
+		return 0;
+	}
+	// Run a ROM headless until it stops, --run rom
+	if (argc > 2 && std::strcmp(argv[1], "--run") == 0) {
+		const char *reasons[] = { "cycle budget", "halt", "breakpoint", "unimplemented instruction", "I/O" };
+		Emu8080::state s;
+		Emu8080::readFile(&s, argv[2]);
+		Emu8080::runResult result = Emu8080::run(&s, 10000000000);
+		std::cout << "Stopped on " << reasons[result.reason] << " after " << result.cycles << " cycles\n";
+		Emu8080::printState(&s, s.memory[s.r.pc], (s.memory[s.r.pc + 2] << 8) | s.memory[s.r.pc + 1]);
+		return 0;
+	}
+	// Space Invaders in real time, --play rom frames [--turbo [skip]] [--idle] [--jit]
+	if (argc > 3 && std::strcmp(argv[1], "--play") == 0) {
+		bool turbo = false, idle = false, jit = false;
+		uint32_t skip = 1;
+		for (int i = 4; i < argc; i++) {
+			if (std::strcmp(argv[i], "--turbo") == 0) {
+				turbo = true;
+				if (i + 1 < argc && argv[i + 1][0] != '-') {
+					skip = std::atoi(argv[++i]);
+				}
+			} else if (std::strcmp(argv[i], "--idle") == 0) {
+				idle = true;
+			} else if (std::strcmp(argv[i], "--jit") == 0) {
+				jit = true;
+			}
+		}
+		play(argv[2], std::strtoull(argv[3], nullptr, 10), turbo, skip, idle, jit);
+		return 0;
+	}
+	// Benchmark idle loop skipping, --bench-idle rom frames
+	if (argc > 3 && std::strcmp(argv[1], "--bench-idle") == 0) {
+		idleBenchmark(argv[2], std::strtoull(argv[3], nullptr, 10));
+		return 0;
+	}
+	// CP/M test programs, --cpm program...
+	if (argc > 2 && std::strcmp(argv[1], "--cpm") == 0) {
+		for (int i = 2; i < argc; i++) {
+			cpm(argv[i]);
+		}
+		return 0;
+	}
+	// Space Invaders with interrupts, --invaders rom frames [--record log | --replay log] [--screen ppm]
+	if (argc > 3 && std::strcmp(argv[1], "--invaders") == 0) {
+		std::string record, replay, screen;
+		for (int i = 4; i + 1 < argc; i += 2) {
+			if (std::strcmp(argv[i], "--record") == 0) {
+				record = argv[i + 1];
+			} else if (std::strcmp(argv[i], "--replay") == 0) {
+				replay = argv[i + 1];
+			} else if (std::strcmp(argv[i], "--screen") == 0) {
+				screen = argv[i + 1];
+			}
+		}
+		invaders(argv[2], std::atoi(argv[3]), record, replay, screen);
+		return 0;
+	}
 	// New state
 	Emu8080::state s;
 	// Test emulation
@@ -1179,13 +1142,25 @@ int main(int argc, char *argv[]) {
 	// Emu8080::cpudiagFix(&s);
 	// Print state
 	std::cout << "Init\n";
-	// Emulate
-	while (s.r.pc < s.memory.size()) {
-		Emu8080::emulate8080(&s);
+	// Emulate one instruction at a time with full text tracing - testing only, the last instructions go to crash.trace on a crash
+	// IN and OUT go to the Invaders ports, any other port reads 0 and ignores writes, HLT ends it
+	Emu8080::invadersPorts ports;
+	s.ports = &ports.bus;
+	stepTrace trace;
+	Emu8080::dumpOnCrash(&trace.ring, CRASH_TRACE);
+	for (;;) {
+		Emu8080::runResult result = Emu8080::runTraced(&s, 1, trace);
+		if (result.reason == Emu8080::STOP_IO) {
+			if (result.input) {
+				s.r.a = 0;
+			}
+		} else if (result.reason != Emu8080::STOP_BUDGET) {
+			break;
+		}
 		// Wait for input
 		system("pause");
 	}
 	std::cout << "\nEnd of emulation.\n";
 	system("pause");
 	return 0;
-}
\ No newline at end of file
+}
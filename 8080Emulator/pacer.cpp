@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include "pacer.h"
+
+namespace Emu8080 {
+	void preciseSleep::until(std::chrono::steady_clock::time_point deadline) {
+		using clock = std::chrono::steady_clock;
+		for (;;) {
+			std::chrono::duration<double> left = deadline - clock::now();
+			if (left.count() <= estimate) {
+				break;
+			}
+			auto start = clock::now();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			std::chrono::duration<double> slept = clock::now() - start;
+			// Expect the mean plus a deviation, so a slow sleep rarely carries past the deadline
+			count++;
+			double delta = slept.count() - mean;
+			mean += delta / count;
+			m2 += delta * (slept.count() - mean);
+			estimate = mean + std::sqrt(m2 / (count - 1));
+		}
+		while (clock::now() < deadline) {
+		}
+	}
+
+	framePacer::framePacer(double hz, bool turbo, uint32_t skip) : hz(hz), turbo(turbo), skip(std::max(1u, skip)) {}
+
+	void framePacer::start() {
+		begin = frameStart = due = std::chrono::steady_clock::now();
+		cpuBegin = std::clock();
+	}
+
+	void framePacer::endFrame() {
+		using clock = std::chrono::steady_clock;
+		auto now = clock::now();
+		workTimes.push_back(std::chrono::duration<double>(now - frameStart).count());
+		frames++;
+		if (!turbo) {
+			auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1 / hz));
+			due += period;
+			if (now > due + PACE_MAX_BEHIND * period) {
+				// Too far behind to catch up, start the schedule again from here
+				late++;
+				due = now;
+			} else {
+				sleeper.until(due);
+			}
+			now = clock::now();
+		}
+		frameTimes.push_back(std::chrono::duration<double>(now - frameStart).count());
+		frameStart = now;
+	}
+
+	double framePacer::seconds() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+	double framePacer::cpuSeconds() const {
+		return (double)(std::clock() - cpuBegin) / CLOCKS_PER_SEC;
+	}
+
+	double percentile(std::vector<double> values, double p) {
+		if (values.empty()) {
+			return 0;
+		}
+		size_t i = std::min(values.size() - 1, (size_t)(p * values.size()));
+		std::nth_element(values.begin(), values.begin() + i, values.end());
+		return values[i];
+	}
+
+	void framePacer::report(std::ostream &out) const {
+		double wall = seconds();
+		out << frames << " frames, " << rendered << " rendered, " << late << " late, in " << wall << " s, "
+			<< (wall > 0 ? frames / wall : 0) << " fps, " << (wall > 0 ? 100 * cpuSeconds() / wall : 0) << "% CPU\n";
+		const char *names[] = { "frame", "work" };
+		const std::vector<double> *times[] = { &frameTimes, &workTimes };
+		for (int i = 0; i < 2; i++) {
+			out << "  " << names[i] << " ms: p50 " << percentile(*times[i], 0.5) * 1e3
+				<< ", p90 " << percentile(*times[i], 0.9) * 1e3
+				<< ", p99 " << percentile(*times[i], 0.99) * 1e3
+				<< ", max " << percentile(*times[i], 1) * 1e3 << "\n";
+		}
+	}
+
+	runResult runFrames(state *s, scheduler *q, uint64_t frames, uint64_t frameCycles, framePacer *pacer, frameRenderer render, void *context) {
+		runResult result;
+		pacer->start();
+		for (uint64_t frame = 0; frame < frames; frame++) {
+			uint64_t end = (q->now / frameCycles + 1) * frameCycles;
+			while (q->now < end) {
+				runResult slice = runScheduled(s, q, end - q->now);
+				result.cycles += slice.cycles;
+				result.instructions += slice.instructions;
+				if (slice.reason == STOP_IO) {
+					if (slice.input) {
+						s->r.a = 0;
+					}
+				} else if (slice.reason != STOP_BUDGET) {
+					result.reason = slice.reason;
+					return result;
+				}
+			}
+			if (render != nullptr && pacer->render()) {
+				render(s, context);
+				pacer->rendered++;
+			}
+			pacer->endFrame();
+		}
+		return result;
+	}
+}
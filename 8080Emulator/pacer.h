@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+#include <vector>
+#include "cpu.h"
+#include "emulator.h"
+#include "scheduler.h"
+
+namespace Emu8080 {
+	// Sleeps to a wall clock deadline with less jitter than a plain sleep
+	// Sleeps a millisecond at a time while more time is left than a sleep has been seen to take,
+	// then spins the rest on the monotonic clock, so only the last fraction of a millisecond burns CPU
+	class preciseSleep {
+	public:
+		void until(std::chrono::steady_clock::time_point deadline);
+
+	private:
+		// How long a 1 ms sleep takes, mean and deviation kept with Welford's method
+		double estimate = 5e-3;
+		double mean = 5e-3;
+		double m2 = 0;
+		uint64_t count = 1;
+	};
+
+	// Frames later than this many frame times resynchronize instead of being run back to back to catch up
+	constexpr int PACE_MAX_BEHIND = 2;
+
+	// Paces frame slices to the wall clock, or runs them flat out in turbo
+	// Keeps each frame's time so percentiles show the jitter, and the process CPU time so it shows the cost
+	class framePacer {
+	public:
+		double hz; // Frames per second
+		bool turbo; // Run unthrottled, rendering only every skip frames
+		uint32_t skip;
+		uint64_t frames = 0;
+		uint64_t rendered = 0;
+		uint64_t late = 0; // Frames that started more than a frame behind and were dropped from the schedule
+		std::vector<double> frameTimes; // Seconds from the start of each frame to the start of the next
+		std::vector<double> workTimes; // Seconds each frame spent emulating and rendering, before waiting
+
+		framePacer(double hz = 60, bool turbo = false, uint32_t skip = 1);
+
+		// Start the clock, the first frame is due now
+		void start();
+		// Whether the frame about to run should be rendered
+		bool render() const {
+			return !turbo || frames % skip == 0;
+		}
+		// The frame's work is done, wait for the next frame to be due unless in turbo
+		void endFrame();
+
+		// Seconds since start and process CPU seconds over them
+		double seconds() const;
+		double cpuSeconds() const;
+		// Frame times and work times at p50, p90, p99 and the worst, with frame rate and CPU use
+		void report(std::ostream &out) const;
+
+	private:
+		preciseSleep sleeper;
+		std::chrono::steady_clock::time_point begin, frameStart, due;
+		std::clock_t cpuBegin = 0;
+	};
+
+	// Value at fraction p through the sorted values, 0 if there are none
+	double percentile(std::vector<double> values, double p);
+
+	// Renders the current frame of s, context is whatever runFrames was given
+	typedef void (*frameRenderer)(state *s, void *context);
+
+	// Run frames of frameCycles guest cycles through runScheduled, paced by pacer, rendering the frames it says to
+	// IN on a port with no device reads 0 and OUT is ignored, like runBatch
+	// Returns early on any other stop reason, the result holds the totals
+	runResult runFrames(state *s, scheduler *q, uint64_t frames, uint64_t frameCycles, framePacer *pacer, frameRenderer render, void *context);
+}
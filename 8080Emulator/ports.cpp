@@ -0,0 +1,115 @@
+#include "ports.h"
+
+namespace Emu8080 {
+	static uint8_t nullRead(state *s, uint8_t port, void *context) {
+		return 0;
+	}
+
+	static void nullWrite(state *s, uint8_t port, uint8_t value, void *context) {
+	}
+
+	void attachNull(portBus *bus, uint8_t port) {
+		bus->readers[port] = nullRead;
+		bus->readerContexts[port] = nullptr;
+		bus->writers[port] = nullWrite;
+		bus->writerContexts[port] = nullptr;
+	}
+
+	// Shift register
+
+	static void shiftOffset(state *s, uint8_t port, uint8_t value, void *context) {
+		static_cast<shiftRegister *>(context)->offset = value & 0x07;
+	}
+
+	static void shiftData(state *s, uint8_t port, uint8_t value, void *context) {
+		static_cast<shiftRegister *>(context)->shift(value);
+	}
+
+	static uint8_t shiftResult(state *s, uint8_t port, void *context) {
+		return static_cast<shiftRegister *>(context)->result();
+	}
+
+	static void shiftSave(std::vector<uint8_t> &out, void *context) {
+		shiftRegister *shifter = static_cast<shiftRegister *>(context);
+		out.push_back(shifter->value & 0xFF);
+		out.push_back(shifter->value >> 8);
+		out.push_back(shifter->offset);
+	}
+
+	static const uint8_t *shiftLoad(const uint8_t *in, void *context) {
+		shiftRegister *shifter = static_cast<shiftRegister *>(context);
+		shifter->value = (uint16_t)(in[0] | (in[1] << 8));
+		shifter->offset = in[2];
+		return in + 3;
+	}
+
+	void shiftRegister::attach(portBus *bus, uint8_t offsetPort, uint8_t dataPort, uint8_t resultPort) {
+		bus->devices.push_back({ shiftSave, shiftLoad, this });
+		bus->writers[offsetPort] = shiftOffset;
+		bus->writerContexts[offsetPort] = this;
+		bus->writers[dataPort] = shiftData;
+		bus->writerContexts[dataPort] = this;
+		bus->readers[resultPort] = shiftResult;
+		bus->readerContexts[resultPort] = this;
+	}
+
+	// Latches
+
+	static uint8_t latchRead(state *s, uint8_t port, void *context) {
+		return static_cast<inputLatch *>(context)->value;
+	}
+
+	static void inputSave(std::vector<uint8_t> &out, void *context) {
+		out.push_back(static_cast<inputLatch *>(context)->value);
+	}
+
+	static const uint8_t *inputLoad(const uint8_t *in, void *context) {
+		static_cast<inputLatch *>(context)->value = in[0];
+		return in + 1;
+	}
+
+	void inputLatch::attach(portBus *bus, uint8_t port) {
+		bus->devices.push_back({ inputSave, inputLoad, this });
+		bus->readers[port] = latchRead;
+		bus->readerContexts[port] = this;
+	}
+
+	static void soundWrite(state *s, uint8_t port, uint8_t value, void *context) {
+		soundLatch *latch = static_cast<soundLatch *>(context);
+		latch->rising |= value & ~latch->value;
+		latch->value = value;
+	}
+
+	static void soundSave(std::vector<uint8_t> &out, void *context) {
+		soundLatch *latch = static_cast<soundLatch *>(context);
+		out.push_back(latch->value);
+		out.push_back(latch->rising);
+	}
+
+	static const uint8_t *soundLoad(const uint8_t *in, void *context) {
+		soundLatch *latch = static_cast<soundLatch *>(context);
+		latch->value = in[0];
+		latch->rising = in[1];
+		return in + 2;
+	}
+
+	void soundLatch::attach(portBus *bus, uint8_t port) {
+		bus->devices.push_back({ soundSave, soundLoad, this });
+		bus->writers[port] = soundWrite;
+		bus->writerContexts[port] = this;
+	}
+
+	// Space Invaders
+
+	invadersPorts::invadersPorts() {
+		for (int port = 0; port < 8; port++) {
+			attachNull(&bus, (uint8_t)port);
+		}
+		for (int port = 0; port < 3; port++) {
+			inputs[port].attach(&bus, (uint8_t)port);
+		}
+		shifter.attach(&bus, 2, 4, 3);
+		sounds[0].attach(&bus, 3);
+		sounds[1].attach(&bus, 5);
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include "cpu.h"
+
+namespace Emu8080 {
+	// Port devices
+	// Each device is attached to a portBus by filling in the handlers of its ports
+	// A device can be attached to the buses of several CPUs, devices that keep guest state
+	// such as the shift register should only be shared by CPUs meant to see the same hardware
+	// Devices with state of their own also add themselves to the bus's devices, so snapshots keep that state
+
+	// Nothing on the port, reads 0 and drops writes
+	void attachNull(portBus *bus, uint8_t port);
+
+	// 16 bit shift register, OUT to the data port shifts a byte in from the top,
+	// IN from the result port reads the 8 bits starting offset bits below the top
+	class shiftRegister {
+	public:
+		uint16_t value = 0;
+		uint8_t offset = 0; // 0 to 7, set through the offset port
+
+		void attach(portBus *bus, uint8_t offsetPort, uint8_t dataPort, uint8_t resultPort);
+		uint8_t result() const {
+			return (uint8_t)((value << offset) >> 8);
+		}
+		void shift(uint8_t data) {
+			value = (uint16_t)((data << 8) | (value >> 8));
+		}
+	};
+
+	// Byte the host sets, such as switches or buttons, read by IN
+	class inputLatch {
+	public:
+		uint8_t value;
+
+		inputLatch(uint8_t value = 0) : value(value) {}
+		void attach(portBus *bus, uint8_t port);
+	};
+
+	// Byte last written by OUT, such as sound triggers
+	class soundLatch {
+	public:
+		uint8_t value = 0;
+		uint8_t rising = 0; // Bits that went from 0 to 1 since the host last took them
+
+		void attach(portBus *bus, uint8_t port);
+		// Bits that went from 0 to 1 since the last call
+		uint8_t take() {
+			uint8_t bits = rising;
+			rising = 0;
+			return bits;
+		}
+	};
+
+	// Space Invaders I/O
+	//   IN 0, 1, 2: inputs, port 1 is coins and player 1, port 2 is DIP switches and player 2
+	//   IN 3: shift register result
+	//   OUT 2: shift offset, OUT 4: shift data
+	//   OUT 3, 5: sound triggers
+	//   OUT 6: watchdog, ignored
+	class invadersPorts {
+	public:
+		portBus bus;
+		shiftRegister shifter;
+		inputLatch inputs[3] = { inputLatch(0x0E), inputLatch(0x08), inputLatch(0x00) }; // Idle values of the real board
+		soundLatch sounds[2]; // Ports 3 and 5
+
+		invadersPorts();
+		// The bus points at the devices inside, so it can't be copied
+		invadersPorts(const invadersPorts &) = delete;
+		invadersPorts &operator=(const invadersPorts &) = delete;
+	};
+}
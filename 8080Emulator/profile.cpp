@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include "profile.h"
+
+namespace Emu8080 {
+	// Call paths kept, guests that call from ever new paths stop growing them here
+	constexpr size_t PROFILE_MAX_NODES = 0x10000;
+
+	bool symbolMap::load(const std::string &path) {
+		std::ifstream file(path);
+		if (!file) {
+			return false;
+		}
+		std::string line;
+		while (std::getline(file, line)) {
+			std::istringstream fields(line);
+			std::string address, name;
+			if (!(fields >> address >> name) || address[0] == ';' || address[0] == '#') {
+				continue;
+			}
+			size_t skip = address.compare(0, 2, "0x") == 0 ? 2 : address[0] == '$' ? 1 : 0;
+			char *end;
+			unsigned long value = std::strtoul(address.c_str() + skip, &end, 16);
+			if (end != address.c_str() + skip && *end == '\0' && value <= 0xFFFF) {
+				names[(uint16_t)value] = name;
+			}
+		}
+		return true;
+	}
+
+	std::string symbolMap::name(uint16_t address) const {
+		std::ostringstream out;
+		auto it = names.upper_bound(address);
+		if (it == names.begin()) {
+			out << "0x" << std::uppercase << std::hex << std::setw(4) << std::setfill('0') << address;
+			return out.str();
+		}
+		--it;
+		out << it->second;
+		if (it->first != address) {
+			out << "+" << address - it->first;
+		}
+		return out.str();
+	}
+
+	void guestProfile::recode(uint16_t pc, uint8_t op) {
+		counted[code[pc]] += (uint32_t)(hot[pc] - folded[pc]);
+		folded[pc] = hot[pc];
+		code[pc] = op;
+	}
+
+	void guestProfile::fold() {
+		for (uint32_t pc = 0; pc < 0x10000; pc++) {
+			recode((uint16_t)pc, code[pc]);
+		}
+		unfolded = 0;
+	}
+
+	std::array<uint64_t, 256> guestProfile::opcodes() const {
+		std::array<uint64_t, 256> counts;
+		std::copy(std::begin(counted), std::end(counted), counts.begin());
+		for (uint32_t pc = 0; pc < 0x10000; pc++) {
+			counts[code[pc]] += (uint32_t)(hot[pc] - folded[pc]);
+		}
+		return counts;
+	}
+
+	uint64_t guestProfile::instructions() const {
+		std::array<uint64_t, 256> counts = opcodes();
+		return std::accumulate(counts.begin(), counts.end(), (uint64_t)0);
+	}
+
+	uint64_t guestProfile::cycles() const {
+		std::array<uint64_t, 256> counts = opcodes();
+		uint64_t n = 0;
+		for (int op = 0; op < 256; op++) {
+			n += opcodeCycles((uint8_t)op, counts[op]);
+		}
+		return n;
+	}
+
+	void guestProfile::unwind(uint16_t pc, uint64_t now) {
+		// Back to the frame that returns here, returning anywhere else is a computed jump
+		for (size_t i = depth; i-- > 0;) {
+			if (stack[i].ret == pc) {
+				charge(now);
+				current = stack[i].node;
+				depth = i;
+				return;
+			}
+		}
+	}
+
+	void guestProfile::enter(uint16_t address, uint16_t ret, uint64_t now) {
+		if (depth >= PROFILE_MAX_DEPTH) {
+			return;
+		}
+		charge(now);
+		uint32_t child = nodes[current].child, previous = 0;
+		while (child != 0 && nodes[child].address != address) {
+			previous = child;
+			child = nodes[child].sibling;
+		}
+		if (child == 0 && nodes.size() < PROFILE_MAX_NODES) {
+			child = (uint32_t)nodes.size();
+			node n;
+			n.parent = current;
+			n.address = address;
+			n.sibling = nodes[current].child;
+			nodes.push_back(n);
+			nodes[current].child = child;
+		} else if (child != 0 && previous != 0) {
+			// Move to the front
+			nodes[previous].sibling = nodes[child].sibling;
+			nodes[child].sibling = nodes[current].child;
+			nodes[current].child = child;
+		}
+		stack[depth++] = { current, ret };
+		current = child != 0 ? child : current;
+	}
+
+	std::string guestProfile::path(uint32_t n, const symbolMap &symbols) const {
+		if (n == 0) {
+			return "root";
+		}
+		return path(nodes[n].parent, symbols) + ";" + symbols.name(nodes[n].address);
+	}
+
+	void guestProfile::report(std::ostream &out, const symbolMap &symbols, size_t top) const {
+		std::array<uint64_t, 256> counts = opcodes();
+		uint64_t instructions = this->instructions();
+		uint64_t cycles = this->cycles();
+		out << instructions << " instructions, " << cycles << " cycles\n";
+		// Opcodes by cycles
+		std::vector<int> ops;
+		for (int op = 0; op < 256; op++) {
+			if (counts[op] > 0) {
+				ops.push_back(op);
+			}
+		}
+		std::sort(ops.begin(), ops.end(), [&](int a, int b) {
+			return opcodeCycles((uint8_t)a, counts[a]) > opcodeCycles((uint8_t)b, counts[b]);
+		});
+		out << "opcodes by cycles\n";
+		for (size_t i = 0; i < ops.size() && i < top; i++) {
+			int op = ops[i];
+			out << "  " << std::uppercase << std::hex << std::setw(2) << std::setfill('0') << op << std::dec
+				<< "  " << std::setw(12) << std::setfill(' ') << counts[op]
+				<< "  " << std::setw(12) << opcodeCycles((uint8_t)op, counts[op])
+				<< "  " << std::fixed << std::setprecision(2) << std::setw(6) << 100.0 * opcodeCycles((uint8_t)op, counts[op]) / cycles << "%\n";
+		}
+		// Hottest addresses
+		std::vector<uint16_t> pcs;
+		for (uint32_t pc = 0; pc < 0x10000; pc++) {
+			if (hot[pc] > 0) {
+				pcs.push_back((uint16_t)pc);
+			}
+		}
+		size_t shown = std::min(top, pcs.size());
+		std::partial_sort(pcs.begin(), pcs.begin() + shown, pcs.end(), [this](uint16_t a, uint16_t b) { return hot[a] > hot[b]; });
+		out << "hottest addresses\n";
+		for (size_t i = 0; i < shown; i++) {
+			uint16_t pc = pcs[i];
+			out << "  " << std::uppercase << std::hex << std::setw(4) << std::setfill('0') << pc << std::dec
+				<< "  " << std::setw(12) << std::setfill(' ') << hot[pc]
+				<< "  " << std::setw(6) << 100.0 * hot[pc] / instructions << "%  " << symbols.name(pc) << "\n";
+		}
+		out << std::defaultfloat << std::setprecision(6);
+	}
+
+	void guestProfile::writeCollapsed(std::ostream &out, const symbolMap &symbols) {
+		charge(base);
+		for (uint32_t n = 0; n < nodes.size(); n++) {
+			if (nodes[n].cycles > 0) {
+				out << path(n, symbols) << " " << nodes[n].cycles << "\n";
+			}
+		}
+	}
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "cpu.h"
+#include "instructions.h"
+
+namespace Emu8080 {
+	// Guest names for addresses, read from a map file
+	class symbolMap {
+	public:
+		std::map<uint16_t, std::string> names;
+
+		// One "address name" per line, the address in hex with an optional 0x or $ in front
+		// Blank lines and lines starting with ; or # are skipped, returns false if the file couldn't be read
+		bool load(const std::string &path);
+		// Name of the symbol at or before address, with +offset when past it, the hex address if there is none
+		std::string name(uint16_t address) const;
+	};
+
+	// How an opcode can leave the straight line
+	enum flowKind : uint8_t { FLOW_NONE, FLOW_JUMP, FLOW_CALL, FLOW_RETURN };
+
+	constexpr std::array<uint8_t, 256> makeFlowTable() {
+		std::array<uint8_t, 256> t{};
+		for (int op = 0xC0; op < 0x100; op++) {
+			// The undocumented aliases DD, ED, FD, D9 and CB count as the instruction they run as
+			if ((op & 0xCF) == 0xCD || (op & 0xC7) == 0xC4 || (op & 0xC7) == 0xC7) { // CALL, Ccc, RST
+				t[op] = FLOW_CALL;
+			} else if (op == 0xC9 || op == 0xD9 || (op & 0xC7) == 0xC0) { // RET, Rcc
+				t[op] = FLOW_RETURN;
+			} else if (op == 0xC3 || op == 0xCB || (op & 0xC7) == 0xC2 || op == 0xE9) { // JMP, Jcc, PCHL
+				t[op] = FLOW_JUMP;
+			}
+		}
+		return t;
+	}
+	constexpr std::array<uint8_t, 256> flowTable = makeFlowTable();
+
+	// Shadow stack depth kept, guests that leave calls without returning stop growing it here
+	constexpr size_t PROFILE_MAX_DEPTH = 256;
+
+	// Guest profiler, a trace policy for runTraced
+	// Counts each PC, and unless paths is off keeps a shadow call stack so cycles can be charged to the guest
+	// call path they were spent under
+	// Recording is one increment, opcode counts are folded from the PC counts when the opcode at an address
+	// changes and when they are read, the shadow stack is only looked at when SP moves and when runTraced
+	// resumes, which is the only time an interrupt can come in
+	// Cycles aren't counted per instruction, totals come from the opcode and taken branch counts and call paths
+	// are charged from the cycles runTraced passes to stackMoved
+	class guestProfile {
+	public:
+		uint32_t hot[0x10000] = {}; // Times the instruction at each address ran, wrapping past 4G
+		uint64_t taken[256] = {}; // Times each call or return was taken
+		bool paths = true; // Keep the shadow stack for writeCollapsed, off leaves only the counts
+
+		// Large, allocate it rather than keeping it on the stack
+		guestProfile() {
+			nodes.push_back(node());
+		}
+
+		void record(state *s, const uint8_t *opcode) {
+			uint16_t pc = s->r.pc;
+			// Self modifying code, the runs so far were of the old opcode
+			if (code[pc] != opcode[0]) [[unlikely]] {
+				recode(pc, opcode[0]);
+			}
+			hot[pc]++;
+		}
+		// Calls to the path's most recent callee and returns to the top frame stay inline
+		void stackMoved(state *s, uint8_t op, uint64_t cycles) {
+			uint8_t flow = flowTable[op];
+			if (flow < FLOW_CALL) {
+				return;
+			}
+			taken[op]++;
+			if (!paths) {
+				return;
+			}
+			if (flow == FLOW_RETURN) {
+				if (depth > 0 && stack[depth - 1].ret == s->r.pc) {
+					charge(base + cycles);
+					current = stack[--depth].node;
+				} else {
+					unwind(s->r.pc, base + cycles);
+				}
+			} else {
+				uint16_t ret = s->memory[s->r.sp] | (s->memory[(uint16_t)(s->r.sp + 1)] << 8);
+				uint32_t child = nodes[current].child;
+				if (child != 0 && nodes[child].address == s->r.pc && depth < PROFILE_MAX_DEPTH) {
+					charge(base + cycles);
+					stack[depth++] = { current, ret };
+					current = child;
+				} else {
+					enter(s->r.pc, ret, base + cycles);
+				}
+			}
+		}
+		// An interrupt accepted while runTraced was stopped pushed the address the guest would have gone on from
+		void resume(state *s) {
+			if (paths && started && s->r.pc != stopped
+				&& (s->memory[s->r.sp] | (s->memory[(uint16_t)(s->r.sp + 1)] << 8)) == stopped) {
+				enter(s->r.pc, stopped, base);
+			}
+		}
+		void stop(state *s, const runResult &result) {
+			base += result.cycles;
+			stopped = s->r.pc;
+			started = true;
+			// Fold before an address can run 4G times unfolded, only a single run over 4G instructions still wraps
+			unfolded += result.instructions;
+			if (unfolded >= 0x80000000) {
+				fold();
+			}
+		}
+
+		// Times each opcode ran
+		std::array<uint64_t, 256> opcodes() const;
+		uint64_t instructions() const;
+		uint64_t cycles() const;
+		// Cycles spent on an opcode that ran count times, including its taken branches
+		uint64_t opcodeCycles(uint8_t op, uint64_t count) const {
+			return count * instructionCycles[op] + taken[op] * branchCycles[op];
+		}
+		// Opcode counts and the hottest addresses, named from symbols
+		void report(std::ostream &out, const symbolMap &symbols, size_t top = 20) const;
+		// Cycles by guest call path, one "root;caller;callee cycles" line per path, the collapsed
+		// stack format flamegraph tools read
+		void writeCollapsed(std::ostream &out, const symbolMap &symbols);
+
+	private:
+		// A guest call path, the root is where profiling started
+		// Children are a list, most recently called first, calls from one path go to few places
+		class node {
+		public:
+			uint32_t parent = 0;
+			uint32_t child = 0; // First child, 0 for none
+			uint32_t sibling = 0; // Next child of the parent
+			uint16_t address = 0; // Called address
+			uint64_t cycles = 0; // Spent in this path and not its callees
+		};
+		// A call on the shadow stack
+		class frame {
+		public:
+			uint32_t node;
+			uint16_t ret; // Where it returns to
+		};
+
+		uint8_t code[0x10000] = {}; // Opcode each address last ran
+		uint32_t folded[0x10000] = {}; // Its hot count already in counted
+		uint64_t counted[256] = {}; // Opcode counts folded so far
+		uint64_t unfolded = 0; // Instructions run since the last fold
+		std::vector<node> nodes;
+		frame stack[PROFILE_MAX_DEPTH];
+		size_t depth = 0;
+		uint32_t current = 0;
+		uint64_t base = 0; // Cycles of the runs before this one
+		uint64_t charged = 0; // Cycles already charged to a node
+		uint16_t stopped = 0; // PC the last run stopped on
+		bool started = false;
+
+		// Fold the runs of the opcode at pc, which now holds op
+		void recode(uint16_t pc, uint8_t op);
+		// Fold the runs at every address
+		void fold();
+		// A return to pc now cycles in that isn't to the top frame
+		void unwind(uint16_t pc, uint64_t now);
+		// Push a call to address that returns to ret
+		void enter(uint16_t address, uint16_t ret, uint64_t now);
+		void charge(uint64_t now) {
+			nodes[current].cycles += now - charged;
+			charged = now;
+		}
+		std::string path(uint32_t n, const symbolMap &symbols) const;
+	};
+}
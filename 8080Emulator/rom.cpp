@@ -0,0 +1,125 @@
+#include <iostream>
+#include <cstring>
+#include <memory>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "bus.h"
+#include "rom.h"
+
+namespace Emu8080 {
+	romImage::romImage(const std::string &path) : name(path) {
+#ifdef _WIN32
+		HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (f == INVALID_HANDLE_VALUE) {
+			return;
+		}
+		file = f;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+			return;
+		}
+		HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m == nullptr) {
+			return;
+		}
+		mapping = m;
+		bytes = (const uint8_t *)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+		length = bytes != nullptr ? (size_t)size.QuadPart : 0;
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return;
+		}
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void *m = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (m != MAP_FAILED) {
+				bytes = (const uint8_t *)m;
+				length = (size_t)info.st_size;
+			}
+		}
+		// The mapping stays valid once the descriptor is closed
+		close(fd);
+#endif
+	}
+
+	romImage::~romImage() {
+#ifdef _WIN32
+		if (bytes != nullptr) {
+			UnmapViewOfFile(bytes);
+		}
+		if (mapping != nullptr) {
+			CloseHandle(mapping);
+		}
+		if (file != nullptr) {
+			CloseHandle(file);
+		}
+#else
+		if (bytes != nullptr) {
+			munmap((void *)bytes, length);
+		}
+#endif
+	}
+
+	bool loadRegions(state *s, const std::vector<romRegion> &regions) {
+		// Check every image before touching memory
+		for (const romRegion &r : regions) {
+			if (!r.image->valid()) {
+				std::cout << "Error: Could not open " << r.image->path() << "\n";
+				return false;
+			}
+			if (r.image->size() > 0x10000 - (size_t)r.address) {
+				std::cout << "Error: " << r.image->path() << " is " << r.image->size()
+					<< " bytes, too large to load at " << r.address << "\n";
+				return false;
+			}
+			for (const romRegion &other : regions) {
+				if (&other != &r && other.address >= r.address && other.address < r.address + r.image->size()) {
+					std::cout << "Error: " << other.image->path() << " overlaps " << r.image->path() << "\n";
+					return false;
+				}
+			}
+		}
+		for (const romRegion &r : regions) {
+			std::memcpy(&s->memory[r.address], r.image->data(), r.image->size());
+			// Anything decoded or snapshotted from these addresses is stale
+			for (size_t page = r.address >> 8; page <= (r.address + r.image->size() - 1) >> 8; page++) {
+				pageWritten(s, (uint8_t)page);
+			}
+		}
+		// Refresh the wrap mirror
+		s->memory[0x10000] = s->memory[0];
+		s->memory[0x10001] = s->memory[1];
+		return true;
+	}
+
+	bool loadImage(state *s, const std::string &path, uint16_t address) {
+		romImage image(path);
+		return loadRegions(s, { { &image, address } });
+	}
+
+	bool loadInvaders(state *s, const std::string &directory) {
+		const char *names[] = { "invaders.h", "invaders.g", "invaders.f", "invaders.e" };
+		std::vector<std::unique_ptr<romImage>> images;
+		std::vector<romRegion> regions;
+		for (int i = 0; i < 4; i++) {
+			images.emplace_back(new romImage(directory + "/" + names[i]));
+			regions.push_back({ images.back().get(), (uint16_t)(i * 0x800) });
+		}
+		if (!loadRegions(s, regions)) {
+			return false;
+		}
+		mapRom(s, 0x0000, 0x2000);
+		// The RAM at 2000 shows again at 4000, the address line above it isn't decoded
+		mapMirror(s, 0x2000, 0x2000, 0x4000);
+		return true;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cpu.h"
+
+namespace Emu8080 {
+	// Read only view of a ROM file, mapped rather than read so any number of CPUs can boot from one image
+	class romImage {
+	public:
+		romImage(const std::string &path);
+		~romImage();
+		romImage(const romImage &) = delete;
+		romImage &operator=(const romImage &) = delete;
+
+		// False if the file couldn't be opened or mapped
+		bool valid() const {
+			return bytes != nullptr;
+		}
+		const uint8_t *data() const {
+			return bytes;
+		}
+		size_t size() const {
+			return length;
+		}
+		const std::string &path() const {
+			return name;
+		}
+
+	private:
+		std::string name;
+		const uint8_t *bytes = nullptr;
+		size_t length = 0;
+#ifdef _WIN32
+		void *file = nullptr;
+		void *mapping = nullptr;
+#endif
+	};
+
+	// An image placed at a guest address
+	class romRegion {
+	public:
+		const romImage *image;
+		uint16_t address;
+	};
+
+	// Copy each image into memory at its address
+	// Returns false, loading nothing, if an image is missing, empty or runs past the end of memory
+	bool loadRegions(state *s, const std::vector<romRegion> &regions);
+	// Load a single file at address
+	bool loadImage(state *s, const std::string &path, uint16_t address);
+	// Load Space Invaders from the directory holding invaders.h, .g, .f and .e, write protect it and mirror its RAM
+	bool loadInvaders(state *s, const std::string &directory);
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <thread>
+#include "jit.h"
+#include "scheduler.h"
+
+namespace Emu8080 {
+	// Heap order, the earliest event is at the front
+	static bool later(const scheduler::event &e1, const scheduler::event &e2) {
+		if (e1.time != e2.time) {
+			return e1.time > e2.time;
+		}
+		return e1.id > e2.id;
+	}
+
+	uint32_t scheduler::schedule(uint64_t time, eventHandler handler, void *context) {
+		event e;
+		e.time = time;
+		e.id = nextId++;
+		e.handler = handler;
+		e.context = context;
+		events.push_back(e);
+		std::push_heap(events.begin(), events.end(), later);
+		return e.id;
+	}
+
+	uint32_t scheduler::scheduleIn(uint64_t delay, eventHandler handler, void *context) {
+		return schedule(now + delay, handler, context);
+	}
+
+	bool scheduler::cancel(uint32_t id) {
+		for (size_t i = 0; i < events.size(); i++) {
+			if (events[i].id == id) {
+				events.erase(events.begin() + i);
+				std::make_heap(events.begin(), events.end(), later);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint64_t scheduler::nextDeadline() const {
+		return events.empty() ? UINT64_MAX : events.front().time;
+	}
+
+	void scheduler::dispatch(state *s) {
+		while (!events.empty() && events.front().time <= now) {
+			std::pop_heap(events.begin(), events.end(), later);
+			event e = events.back();
+			events.pop_back();
+			// The handler may schedule more events, including ones already due
+			e.handler(s, this, e.time, e.context);
+		}
+	}
+
+	// Wall clock time from cycle 0 to cycle time at hz
+	static std::chrono::steady_clock::duration wallTime(uint64_t time, uint32_t hz) {
+		return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((double)time / hz));
+	}
+
+	void scheduler::pace(uint32_t hz) {
+		clockRate = hz;
+		if (hz != 0) {
+			epoch = std::chrono::steady_clock::now() - wallTime(now, hz);
+		}
+	}
+
+	void scheduler::waitUntil(uint64_t time) {
+		if (clockRate != 0) {
+			std::this_thread::sleep_until(epoch + wallTime(time, clockRate));
+		}
+	}
+
+	static void add(runResult &total, const runResult &part) {
+		total.cycles += part.cycles;
+		total.instructions += part.instructions;
+		total.reason = part.reason;
+		total.input = part.input;
+	}
+
+	// Run one instruction that can be part of an idle loop, false if it can't be or it stopped run
+	static bool idleStep(state *s, uint64_t cycleBudget, runResult &result) {
+		uint8_t op = s->memory[s->r.pc];
+		bool safe = idleSafe[op]
+			|| (op == 0xDB && s->ports != nullptr && s->ports->readers[s->memory[s->r.pc + 1]] != nullptr); // IN
+		if (!safe || result.cycles >= cycleBudget) {
+			return false;
+		}
+		add(result, run(s, 1));
+		return result.reason == STOP_BUDGET;
+	}
+
+	// Look for an idle loop from PC, running the instructions looked through into result
+	// Runs to a jump back, then round once more to where it landed, and returns the cycles and instructions
+	// of that round if the registers came back the same, none if they didn't or anything else ran
+	static runResult findIdleLoop(state *s, uint64_t cycleBudget, runResult &result) {
+		runResult round;
+		bool back = false;
+		for (int i = 0; i < IDLE_MAX_STEPS && !back; i++) {
+			uint16_t pc = s->r.pc;
+			if (!idleStep(s, cycleBudget, result)) {
+				return round;
+			}
+			back = s->r.pc <= pc;
+		}
+		if (!back) {
+			return round;
+		}
+		registers head = s->r;
+		uint8_t f = flags(s);
+		runResult start = result;
+		for (int i = 0; i < IDLE_MAX_STEPS; i++) {
+			if (!idleStep(s, cycleBudget, result)) {
+				return round;
+			}
+			if (s->r.pc == head.pc) {
+				if (s->r.a == head.a && flags(s) == f && s->r.bc == head.bc && s->r.de == head.de
+					&& s->r.hl == head.hl && s->r.sp == head.sp) {
+					round.cycles = result.cycles - start.cycles;
+					round.instructions = result.instructions - start.instructions;
+				}
+				return round;
+			}
+		}
+		return round;
+	}
+
+	// Run for cycleBudget cycles, looking for an idle loop every so often and skipping whole rounds of one when found
+	// Ends on the same instruction run would, at least one cycle is always left to run normally
+	static runResult runIdle(state *s, scheduler *q, uint64_t cycleBudget) {
+		runResult result;
+		uint64_t probe = IDLE_PROBE;
+		while (result.cycles < cycleBudget) {
+			add(result, run(s, std::min(probe, cycleBudget - result.cycles)));
+			if (result.reason != STOP_BUDGET || result.cycles >= cycleBudget) {
+				return result;
+			}
+			probe *= 2;
+			runResult round = findIdleLoop(s, cycleBudget, result);
+			if (result.reason != STOP_BUDGET) {
+				return result;
+			}
+			if (round.cycles > 0 && result.cycles < cycleBudget) {
+				uint64_t rounds = (cycleBudget - result.cycles - 1) / round.cycles;
+				if (rounds > 0) {
+					result.cycles += rounds * round.cycles;
+					result.instructions += rounds * round.instructions;
+					q->idleCycles += rounds * round.cycles;
+					q->idleLoops++;
+				}
+			}
+		}
+		return result;
+	}
+
+	runResult runScheduled(state *s, scheduler *q, uint64_t cycleBudget) {
+		runResult result;
+		uint64_t end = q->now + cycleBudget;
+		while (q->now < end) {
+			uint64_t deadline = std::min(end, q->nextDeadline());
+			if (s->halted) {
+				if (q->nextDeadline() == UINT64_MAX) {
+					result.reason = STOP_HALT;
+					return result;
+				}
+				// Nothing runs until an event, the halted cycles are counted all at once
+				q->waitUntil(deadline);
+				result.cycles += deadline - q->now;
+				q->now = deadline;
+				q->dispatch(s);
+				continue;
+			}
+			uint64_t budget = deadline > q->now ? deadline - q->now : 0;
+			runResult slice;
+			if (q->jit != nullptr && s->breakpoints.empty()) {
+				slice = runJit(s, q->jit, budget);
+			} else {
+				slice = q->skipIdle && s->breakpoints.empty() ? runIdle(s, q, budget) : run(s, budget);
+			}
+			// Interrupts are only taken after the instruction following EI, run it before the events
+			// That can be another EI, which delays them again
+			while (s->eiDelay && slice.reason == STOP_BUDGET) {
+				add(slice, run(s, 1));
+			}
+			q->now += slice.cycles;
+			result.cycles += slice.cycles;
+			result.instructions += slice.instructions;
+			q->dispatch(s);
+			if (slice.reason != STOP_BUDGET && slice.reason != STOP_HALT) {
+				result.reason = slice.reason;
+				result.input = slice.input;
+				return result;
+			}
+		}
+		return result;
+	}
+}
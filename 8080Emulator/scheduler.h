@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "cpu.h"
+#include "emulator.h"
+
+namespace Emu8080 {
+	class scheduler;
+	class jitCache;
+
+	// Called when an event comes due, time is the cycle it was scheduled for and context is whatever was passed to schedule
+	// Periodic events reschedule from time rather than now, which may have run a few cycles past it
+	typedef void (*eventHandler)(state *s, scheduler *q, uint64_t time, void *context);
+
+	// Cycle timestamped event queue
+	// Interrupts, device timers and frame boundaries are scheduled here, and runScheduled
+	// runs the CPU flat out from one deadline to the next
+	class scheduler {
+	public:
+		class event {
+		public:
+			uint64_t time; // Cycle the event fires at
+			uint32_t id;
+			eventHandler handler;
+			void *context;
+		};
+
+		uint64_t now = 0; // Cycles run since reset
+		// Fast forward idle loops, short loops that only read memory or ports and come back to the same registers
+		// Their iterations change nothing but the cycle count, so whole ones are skipped up to the next deadline
+		// Port readers must have no side effects, and breakpoints turn it off
+		bool skipIdle = false;
+		uint64_t idleCycles = 0; // Cycles skipped
+		uint64_t idleLoops = 0; // Times a loop was skipped
+		// Run through the tiered engine with this cache of the state's translated code, in place of idle skipping
+		// Breakpoints turn it off, snapshots leave it as it was
+		jitCache *jit = nullptr;
+
+		// Fire handler at cycle time, returns an id for cancel
+		uint32_t schedule(uint64_t time, eventHandler handler, void *context);
+		// Fire handler delay cycles from now
+		uint32_t scheduleIn(uint64_t delay, eventHandler handler, void *context);
+		// Drop a pending event, returns false if it already fired
+		bool cancel(uint32_t id);
+		// Cycle of the earliest pending event, UINT64_MAX if there is none
+		uint64_t nextDeadline() const;
+		// Fire every event due by now, in time order
+		void dispatch(state *s);
+		// Pace to hz guest cycles per second of wall clock time, 0 runs flat out
+		void pace(uint32_t hz);
+		// Block the host thread until the wall clock catches up with cycle time, returns at once when not pacing
+		void waitUntil(uint64_t time);
+
+	private:
+		std::vector<event> events; // Min heap on time, ties fire in the order they were scheduled
+		uint32_t nextId = 0;
+		uint32_t clockRate = 0;
+		std::chrono::steady_clock::time_point epoch; // Wall clock time of cycle 0 when pacing
+	};
+
+	// Instructions an idle loop can be made of, they store nothing and leave interrupts and the stack alone
+	// IN is allowed too when its port has a reader
+	constexpr std::array<uint8_t, 256> makeIdleSafe() {
+		std::array<uint8_t, 256> t{};
+		for (int op = 0; op < 0xC0; op++) {
+			t[op] = 1;
+		}
+		const uint8_t stores[] = { 0x02, 0x12, 0x22, 0x32, 0x34, 0x35, 0x36 }; // STAX, SHLD, STA, INR M, DCR M, MVI M
+		for (uint8_t op : stores) {
+			t[op] = 0;
+		}
+		for (int op = 0x70; op < 0x78; op++) { // MOV M, r and HLT
+			t[op] = 0;
+		}
+		for (int op = 0xC0; op < 0x100; op++) {
+			t[op] = op == 0xC3 || (op & 0xC7) == 0xC2 // JMP, Jcc
+				|| (op & 0xC7) == 0xC6 // Immediates
+				|| op == 0xE9 || op == 0xEB || op == 0xF9; // PCHL, XCHG, SPHL
+		}
+		return t;
+	}
+	constexpr std::array<uint8_t, 256> idleSafe = makeIdleSafe();
+	// Cycles run between looking for an idle loop, doubled each time one isn't found until the next deadline
+	constexpr uint64_t IDLE_PROBE = 1000;
+	// Most instructions in an idle loop, and to look through for the jump back that closes one
+	constexpr int IDLE_MAX_STEPS = 16;
+
+	// Execute for cycleBudget cycles, firing events as they come due
+	// A halted CPU skips straight to the next event, STOP_HALT is only returned when no event is left to wake it
+	// With skipIdle set, an idle loop skips to just short of the next event and runs the rest of the way
+	// Returns early with the other stop reasons of run, due events still fire first
+	runResult runScheduled(state *s, scheduler *q, uint64_t cycleBudget);
+}
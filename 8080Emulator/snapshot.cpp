@@ -0,0 +1,88 @@
+#include <cstring>
+#include "bus.h"
+#include "snapshot.h"
+
+namespace Emu8080 {
+	void takeSnapshot(state *s, snapshot &snap, const scheduler *q) {
+		flags(s);
+		snap.r = s->r;
+		snap.enabled = s->enabled;
+		snap.eiDelay = s->eiDelay;
+		snap.halted = s->halted;
+		snap.port = s->port;
+		for (int page = 0; page < 256; page++) {
+			if (!(s->pageFlags[page] & PAGE_SHARED)) {
+				// Written since it was last shared, stores take the bus path until it is written again
+				std::shared_ptr<memoryPage> copy = std::make_shared<memoryPage>();
+				std::memcpy(copy->data(), &s->memory[page << 8], 0x100);
+				s->sharedPages[page] = copy;
+				s->pageFlags[page] |= PAGE_SHARED;
+			}
+			snap.pages[page] = s->sharedPages[page];
+		}
+		if (!s->sharedMap) {
+			std::shared_ptr<busMap> map = std::make_shared<busMap>();
+			for (int page = 0; page < 256; page++) {
+				map->pageFlags[page] = s->pageFlags[page] & ~(PAGE_CODE | PAGE_SHARED | PAGE_WATCH);
+			}
+			std::memcpy(map->mirrors, s->mirrors, sizeof(map->mirrors));
+			std::memcpy(map->writers, s->writers, sizeof(map->writers));
+			std::memcpy(map->writerContexts, s->writerContexts, sizeof(map->writerContexts));
+			s->sharedMap = map;
+		}
+		snap.map = s->sharedMap;
+		snap.devices.clear();
+		if (s->ports != nullptr) {
+			for (const portDevice &d : s->ports->devices) {
+				d.save(snap.devices, d.context);
+			}
+		}
+		snap.hasEvents = q != nullptr;
+		if (q != nullptr) {
+			snap.events = *q;
+		}
+	}
+
+	void restoreSnapshot(state *s, const snapshot &snap, scheduler *q) {
+		const busMap &map = *snap.map;
+		if (s->sharedMap != snap.map) {
+			std::memcpy(s->mirrors, map.mirrors, sizeof(s->mirrors));
+			std::memcpy(s->writers, map.writers, sizeof(s->writers));
+			std::memcpy(s->writerContexts, map.writerContexts, sizeof(s->writerContexts));
+			s->sharedMap = snap.map;
+		}
+		for (int page = 0; page < 256; page++) {
+			if (!(s->pageFlags[page] & PAGE_SHARED) || s->sharedPages[page] != snap.pages[page]) {
+				std::memcpy(&s->memory[page << 8], snap.pages[page]->data(), 0x100);
+				pageWritten(s, (uint8_t)page);
+				s->sharedPages[page] = snap.pages[page];
+			}
+			s->pageFlags[page] = map.pageFlags[page] | (s->pageFlags[page] & (PAGE_CODE | PAGE_WATCH)) | PAGE_SHARED;
+		}
+		s->memory[0x10000] = s->memory[0];
+		s->memory[0x10001] = s->memory[1];
+		s->r = snap.r;
+		s->lazy = lazyFlags();
+		s->enabled = snap.enabled;
+		s->eiDelay = snap.eiDelay;
+		s->halted = snap.halted;
+		s->port = snap.port;
+		if (s->ports != nullptr && !snap.devices.empty()) {
+			const uint8_t *in = snap.devices.data();
+			for (const portDevice &d : s->ports->devices) {
+				in = d.load(in, d.context);
+			}
+		}
+		if (q != nullptr && snap.hasEvents) {
+			jitCache *jit = q->jit; // Belongs to s, not to the state the snapshot was taken of
+			*q = snap.events;
+			q->jit = jit;
+		}
+	}
+
+	void forkState(state *parent, state *child) {
+		snapshot snap;
+		takeSnapshot(parent, snap);
+		restoreSnapshot(child, snap);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cpu.h"
+#include "scheduler.h"
+
+namespace Emu8080 {
+	// Memory map of a state as kept by snapshots
+	class busMap {
+	public:
+		uint8_t pageFlags[256]; // Without PAGE_CODE, PAGE_SHARED and PAGE_WATCH, which belong to the state
+		uint8_t mirrors[256];
+		pageWriter writers[256];
+		void *writerContexts[256];
+	};
+
+	// Everything needed to put a CPU back where it was
+	// Memory pages and the memory map are shared, with other snapshots and with the states they are restored to,
+	// so a snapshot only costs the pages written since the last one. Shared pages are never written,
+	// so states on different threads can be restored from the same snapshot
+	class snapshot {
+	public:
+		registers r; // F is current, pending lazy flags are worked out first
+		uint8_t enabled = 0;
+		uint8_t eiDelay = 0;
+		uint8_t halted = 0;
+		uint8_t port = 0;
+		std::shared_ptr<const memoryPage> pages[256];
+		std::shared_ptr<const busMap> map;
+		std::vector<uint8_t> devices; // State of the devices on the state's portBus, in the bus's order
+		bool hasEvents = false;
+		scheduler events; // Pending events and cycle count, when a scheduler was given
+	};
+
+	// Capture s and the events of q, if any
+	// Pages are copied only if s wrote them since it last took or was restored from a snapshot
+	void takeSnapshot(state *s, snapshot &snap, const scheduler *q = nullptr);
+	// Put s and q back to snap, q is left alone if snap has no events
+	// The devices on s->ports are put back too, they must be the same kinds attached in the same order as when snap was taken
+	// Only pages that no longer match snap are copied, so restoring the same state over and over is cheap
+	// Breakpoints are left as they are
+	void restoreSnapshot(state *s, const snapshot &snap, scheduler *q = nullptr);
+	// Make child a copy of parent, they share every page until one of them writes it
+	void forkState(state *parent, state *child);
+}
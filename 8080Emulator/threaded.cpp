@@ -0,0 +1,360 @@
+#include "emulator.h"
+#include "instructions.h"
+
+namespace Emu8080 {
+	const instruction instructionTable[256] = {
+		op00, op01, op02, op03, op04, op05, op06, op07,
+		op08, op09, op0A, op0B, op0C, op0D, op0E, op0F,
+		op10, op11, op12, op13, op14, op15, op16, op17,
+		op18, op19, op1A, op1B, op1C, op1D, op1E, op1F,
+		op20, op21, op22, op23, op24, op25, op26, op27,
+		op28, op29, op2A, op2B, op2C, op2D, op2E, op2F,
+		op30, op31, op32, op33, op34, op35, op36, op37,
+		op38, op39, op3A, op3B, op3C, op3D, op3E, op3F,
+		op40, op41, op42, op43, op44, op45, op46, op47,
+		op48, op49, op4A, op4B, op4C, op4D, op4E, op4F,
+		op50, op51, op52, op53, op54, op55, op56, op57,
+		op58, op59, op5A, op5B, op5C, op5D, op5E, op5F,
+		op60, op61, op62, op63, op64, op65, op66, op67,
+		op68, op69, op6A, op6B, op6C, op6D, op6E, op6F,
+		op70, op71, op72, op73, op74, op75, op76, op77,
+		op78, op79, op7A, op7B, op7C, op7D, op7E, op7F,
+		op80, op81, op82, op83, op84, op85, op86, op87,
+		op88, op89, op8A, op8B, op8C, op8D, op8E, op8F,
+		op90, op91, op92, op93, op94, op95, op96, op97,
+		op98, op99, op9A, op9B, op9C, op9D, op9E, op9F,
+		opA0, opA1, opA2, opA3, opA4, opA5, opA6, opA7,
+		opA8, opA9, opAA, opAB, opAC, opAD, opAE, opAF,
+		opB0, opB1, opB2, opB3, opB4, opB5, opB6, opB7,
+		opB8, opB9, opBA, opBB, opBC, opBD, opBE, opBF,
+		opC0, opC1, opC2, opC3, opC4, opC5, opC6, opC7,
+		opC8, opC9, opCA, opCB, opCC, opCD, opCE, opCF,
+		opD0, opD1, opD2, opD3, opD4, opD5, opD6, opD7,
+		opD8, opD9, opDA, opDB, opDC, opDD, opDE, opDF,
+		opE0, opE1, opE2, opE3, opE4, opE5, opE6, opE7,
+		opE8, opE9, opEA, opEB, opEC, opED, opEE, opEF,
+		opF0, opF1, opF2, opF3, opF4, opF5, opF6, opF7,
+		opF8, opF9, opFA, opFB, opFC, opFD, opFE, opFF
+	};
+
+	// Execute count instructions through threaded dispatch
+	// Each handler jumps straight to the next one through the label table, so every handler
+	// ends in its own indirect branch instead of sharing the single one of the central switch.
+	// Compilers without computed goto call through the handler table instead
+	void emulateThreaded(state *s, uint64_t count) {
+		uint8_t *opcode;
+		// The first instruction ends the delay of an EI before the call, one inside it is ended
+		// by the next instruction unless it was the last
+		if (count > 0) {
+			s->eiDelay = 0;
+		}
+#if defined(__GNUC__)
+		static void *const labels[256] = {
+			&&L00, &&L01, &&L02, &&L03, &&L04, &&L05, &&L06, &&L07,
+			&&L08, &&L09, &&L0A, &&L0B, &&L0C, &&L0D, &&L0E, &&L0F,
+			&&L10, &&L11, &&L12, &&L13, &&L14, &&L15, &&L16, &&L17,
+			&&L18, &&L19, &&L1A, &&L1B, &&L1C, &&L1D, &&L1E, &&L1F,
+			&&L20, &&L21, &&L22, &&L23, &&L24, &&L25, &&L26, &&L27,
+			&&L28, &&L29, &&L2A, &&L2B, &&L2C, &&L2D, &&L2E, &&L2F,
+			&&L30, &&L31, &&L32, &&L33, &&L34, &&L35, &&L36, &&L37,
+			&&L38, &&L39, &&L3A, &&L3B, &&L3C, &&L3D, &&L3E, &&L3F,
+			&&L40, &&L41, &&L42, &&L43, &&L44, &&L45, &&L46, &&L47,
+			&&L48, &&L49, &&L4A, &&L4B, &&L4C, &&L4D, &&L4E, &&L4F,
+			&&L50, &&L51, &&L52, &&L53, &&L54, &&L55, &&L56, &&L57,
+			&&L58, &&L59, &&L5A, &&L5B, &&L5C, &&L5D, &&L5E, &&L5F,
+			&&L60, &&L61, &&L62, &&L63, &&L64, &&L65, &&L66, &&L67,
+			&&L68, &&L69, &&L6A, &&L6B, &&L6C, &&L6D, &&L6E, &&L6F,
+			&&L70, &&L71, &&L72, &&L73, &&L74, &&L75, &&L76, &&L77,
+			&&L78, &&L79, &&L7A, &&L7B, &&L7C, &&L7D, &&L7E, &&L7F,
+			&&L80, &&L81, &&L82, &&L83, &&L84, &&L85, &&L86, &&L87,
+			&&L88, &&L89, &&L8A, &&L8B, &&L8C, &&L8D, &&L8E, &&L8F,
+			&&L90, &&L91, &&L92, &&L93, &&L94, &&L95, &&L96, &&L97,
+			&&L98, &&L99, &&L9A, &&L9B, &&L9C, &&L9D, &&L9E, &&L9F,
+			&&LA0, &&LA1, &&LA2, &&LA3, &&LA4, &&LA5, &&LA6, &&LA7,
+			&&LA8, &&LA9, &&LAA, &&LAB, &&LAC, &&LAD, &&LAE, &&LAF,
+			&&LB0, &&LB1, &&LB2, &&LB3, &&LB4, &&LB5, &&LB6, &&LB7,
+			&&LB8, &&LB9, &&LBA, &&LBB, &&LBC, &&LBD, &&LBE, &&LBF,
+			&&LC0, &&LC1, &&LC2, &&LC3, &&LC4, &&LC5, &&LC6, &&LC7,
+			&&LC8, &&LC9, &&LCA, &&LCB, &&LCC, &&LCD, &&LCE, &&LCF,
+			&&LD0, &&LD1, &&LD2, &&LD3, &&LD4, &&LD5, &&LD6, &&LD7,
+			&&LD8, &&LD9, &&LDA, &&LDB, &&LDC, &&LDD, &&LDE, &&LDF,
+			&&LE0, &&LE1, &&LE2, &&LE3, &&LE4, &&LE5, &&LE6, &&LE7,
+			&&LE8, &&LE9, &&LEA, &&LEB, &&LEC, &&LED, &&LEE, &&LEF,
+			&&LF0, &&LF1, &&LF2, &&LF3, &&LF4, &&LF5, &&LF6, &&LF7,
+			&&LF8, &&LF9, &&LFA, &&LFB, &&LFC, &&LFD, &&LFE, &&LFF
+		};
+		// Fetch the next instruction, step PC past it and jump to its handler
+#define DISPATCH() \
+	if (count-- == 0) return; \
+	opcode = &s->memory[s->r.pc]; \
+	s->r.pc += instructionLength[*opcode]; \
+	goto *labels[*opcode]
+
+		DISPATCH();
+	L00: op00(s, opcode); DISPATCH();
+	L01: op01(s, opcode); DISPATCH();
+	L02: op02(s, opcode); DISPATCH();
+	L03: op03(s, opcode); DISPATCH();
+	L04: op04(s, opcode); DISPATCH();
+	L05: op05(s, opcode); DISPATCH();
+	L06: op06(s, opcode); DISPATCH();
+	L07: op07(s, opcode); DISPATCH();
+	L08: op08(s, opcode); DISPATCH();
+	L09: op09(s, opcode); DISPATCH();
+	L0A: op0A(s, opcode); DISPATCH();
+	L0B: op0B(s, opcode); DISPATCH();
+	L0C: op0C(s, opcode); DISPATCH();
+	L0D: op0D(s, opcode); DISPATCH();
+	L0E: op0E(s, opcode); DISPATCH();
+	L0F: op0F(s, opcode); DISPATCH();
+	L10: op10(s, opcode); DISPATCH();
+	L11: op11(s, opcode); DISPATCH();
+	L12: op12(s, opcode); DISPATCH();
+	L13: op13(s, opcode); DISPATCH();
+	L14: op14(s, opcode); DISPATCH();
+	L15: op15(s, opcode); DISPATCH();
+	L16: op16(s, opcode); DISPATCH();
+	L17: op17(s, opcode); DISPATCH();
+	L18: op18(s, opcode); DISPATCH();
+	L19: op19(s, opcode); DISPATCH();
+	L1A: op1A(s, opcode); DISPATCH();
+	L1B: op1B(s, opcode); DISPATCH();
+	L1C: op1C(s, opcode); DISPATCH();
+	L1D: op1D(s, opcode); DISPATCH();
+	L1E: op1E(s, opcode); DISPATCH();
+	L1F: op1F(s, opcode); DISPATCH();
+	L20: op20(s, opcode); DISPATCH();
+	L21: op21(s, opcode); DISPATCH();
+	L22: op22(s, opcode); DISPATCH();
+	L23: op23(s, opcode); DISPATCH();
+	L24: op24(s, opcode); DISPATCH();
+	L25: op25(s, opcode); DISPATCH();
+	L26: op26(s, opcode); DISPATCH();
+	L27: op27(s, opcode); DISPATCH();
+	L28: op28(s, opcode); DISPATCH();
+	L29: op29(s, opcode); DISPATCH();
+	L2A: op2A(s, opcode); DISPATCH();
+	L2B: op2B(s, opcode); DISPATCH();
+	L2C: op2C(s, opcode); DISPATCH();
+	L2D: op2D(s, opcode); DISPATCH();
+	L2E: op2E(s, opcode); DISPATCH();
+	L2F: op2F(s, opcode); DISPATCH();
+	L30: op30(s, opcode); DISPATCH();
+	L31: op31(s, opcode); DISPATCH();
+	L32: op32(s, opcode); DISPATCH();
+	L33: op33(s, opcode); DISPATCH();
+	L34: op34(s, opcode); DISPATCH();
+	L35: op35(s, opcode); DISPATCH();
+	L36: op36(s, opcode); DISPATCH();
+	L37: op37(s, opcode); DISPATCH();
+	L38: op38(s, opcode); DISPATCH();
+	L39: op39(s, opcode); DISPATCH();
+	L3A: op3A(s, opcode); DISPATCH();
+	L3B: op3B(s, opcode); DISPATCH();
+	L3C: op3C(s, opcode); DISPATCH();
+	L3D: op3D(s, opcode); DISPATCH();
+	L3E: op3E(s, opcode); DISPATCH();
+	L3F: op3F(s, opcode); DISPATCH();
+	L40: op40(s, opcode); DISPATCH();
+	L41: op41(s, opcode); DISPATCH();
+	L42: op42(s, opcode); DISPATCH();
+	L43: op43(s, opcode); DISPATCH();
+	L44: op44(s, opcode); DISPATCH();
+	L45: op45(s, opcode); DISPATCH();
+	L46: op46(s, opcode); DISPATCH();
+	L47: op47(s, opcode); DISPATCH();
+	L48: op48(s, opcode); DISPATCH();
+	L49: op49(s, opcode); DISPATCH();
+	L4A: op4A(s, opcode); DISPATCH();
+	L4B: op4B(s, opcode); DISPATCH();
+	L4C: op4C(s, opcode); DISPATCH();
+	L4D: op4D(s, opcode); DISPATCH();
+	L4E: op4E(s, opcode); DISPATCH();
+	L4F: op4F(s, opcode); DISPATCH();
+	L50: op50(s, opcode); DISPATCH();
+	L51: op51(s, opcode); DISPATCH();
+	L52: op52(s, opcode); DISPATCH();
+	L53: op53(s, opcode); DISPATCH();
+	L54: op54(s, opcode); DISPATCH();
+	L55: op55(s, opcode); DISPATCH();
+	L56: op56(s, opcode); DISPATCH();
+	L57: op57(s, opcode); DISPATCH();
+	L58: op58(s, opcode); DISPATCH();
+	L59: op59(s, opcode); DISPATCH();
+	L5A: op5A(s, opcode); DISPATCH();
+	L5B: op5B(s, opcode); DISPATCH();
+	L5C: op5C(s, opcode); DISPATCH();
+	L5D: op5D(s, opcode); DISPATCH();
+	L5E: op5E(s, opcode); DISPATCH();
+	L5F: op5F(s, opcode); DISPATCH();
+	L60: op60(s, opcode); DISPATCH();
+	L61: op61(s, opcode); DISPATCH();
+	L62: op62(s, opcode); DISPATCH();
+	L63: op63(s, opcode); DISPATCH();
+	L64: op64(s, opcode); DISPATCH();
+	L65: op65(s, opcode); DISPATCH();
+	L66: op66(s, opcode); DISPATCH();
+	L67: op67(s, opcode); DISPATCH();
+	L68: op68(s, opcode); DISPATCH();
+	L69: op69(s, opcode); DISPATCH();
+	L6A: op6A(s, opcode); DISPATCH();
+	L6B: op6B(s, opcode); DISPATCH();
+	L6C: op6C(s, opcode); DISPATCH();
+	L6D: op6D(s, opcode); DISPATCH();
+	L6E: op6E(s, opcode); DISPATCH();
+	L6F: op6F(s, opcode); DISPATCH();
+	L70: op70(s, opcode); DISPATCH();
+	L71: op71(s, opcode); DISPATCH();
+	L72: op72(s, opcode); DISPATCH();
+	L73: op73(s, opcode); DISPATCH();
+	L74: op74(s, opcode); DISPATCH();
+	L75: op75(s, opcode); DISPATCH();
+	L76: op76(s, opcode); DISPATCH();
+	L77: op77(s, opcode); DISPATCH();
+	L78: op78(s, opcode); DISPATCH();
+	L79: op79(s, opcode); DISPATCH();
+	L7A: op7A(s, opcode); DISPATCH();
+	L7B: op7B(s, opcode); DISPATCH();
+	L7C: op7C(s, opcode); DISPATCH();
+	L7D: op7D(s, opcode); DISPATCH();
+	L7E: op7E(s, opcode); DISPATCH();
+	L7F: op7F(s, opcode); DISPATCH();
+	L80: op80(s, opcode); DISPATCH();
+	L81: op81(s, opcode); DISPATCH();
+	L82: op82(s, opcode); DISPATCH();
+	L83: op83(s, opcode); DISPATCH();
+	L84: op84(s, opcode); DISPATCH();
+	L85: op85(s, opcode); DISPATCH();
+	L86: op86(s, opcode); DISPATCH();
+	L87: op87(s, opcode); DISPATCH();
+	L88: op88(s, opcode); DISPATCH();
+	L89: op89(s, opcode); DISPATCH();
+	L8A: op8A(s, opcode); DISPATCH();
+	L8B: op8B(s, opcode); DISPATCH();
+	L8C: op8C(s, opcode); DISPATCH();
+	L8D: op8D(s, opcode); DISPATCH();
+	L8E: op8E(s, opcode); DISPATCH();
+	L8F: op8F(s, opcode); DISPATCH();
+	L90: op90(s, opcode); DISPATCH();
+	L91: op91(s, opcode); DISPATCH();
+	L92: op92(s, opcode); DISPATCH();
+	L93: op93(s, opcode); DISPATCH();
+	L94: op94(s, opcode); DISPATCH();
+	L95: op95(s, opcode); DISPATCH();
+	L96: op96(s, opcode); DISPATCH();
+	L97: op97(s, opcode); DISPATCH();
+	L98: op98(s, opcode); DISPATCH();
+	L99: op99(s, opcode); DISPATCH();
+	L9A: op9A(s, opcode); DISPATCH();
+	L9B: op9B(s, opcode); DISPATCH();
+	L9C: op9C(s, opcode); DISPATCH();
+	L9D: op9D(s, opcode); DISPATCH();
+	L9E: op9E(s, opcode); DISPATCH();
+	L9F: op9F(s, opcode); DISPATCH();
+	LA0: opA0(s, opcode); DISPATCH();
+	LA1: opA1(s, opcode); DISPATCH();
+	LA2: opA2(s, opcode); DISPATCH();
+	LA3: opA3(s, opcode); DISPATCH();
+	LA4: opA4(s, opcode); DISPATCH();
+	LA5: opA5(s, opcode); DISPATCH();
+	LA6: opA6(s, opcode); DISPATCH();
+	LA7: opA7(s, opcode); DISPATCH();
+	LA8: opA8(s, opcode); DISPATCH();
+	LA9: opA9(s, opcode); DISPATCH();
+	LAA: opAA(s, opcode); DISPATCH();
+	LAB: opAB(s, opcode); DISPATCH();
+	LAC: opAC(s, opcode); DISPATCH();
+	LAD: opAD(s, opcode); DISPATCH();
+	LAE: opAE(s, opcode); DISPATCH();
+	LAF: opAF(s, opcode); DISPATCH();
+	LB0: opB0(s, opcode); DISPATCH();
+	LB1: opB1(s, opcode); DISPATCH();
+	LB2: opB2(s, opcode); DISPATCH();
+	LB3: opB3(s, opcode); DISPATCH();
+	LB4: opB4(s, opcode); DISPATCH();
+	LB5: opB5(s, opcode); DISPATCH();
+	LB6: opB6(s, opcode); DISPATCH();
+	LB7: opB7(s, opcode); DISPATCH();
+	LB8: opB8(s, opcode); DISPATCH();
+	LB9: opB9(s, opcode); DISPATCH();
+	LBA: opBA(s, opcode); DISPATCH();
+	LBB: opBB(s, opcode); DISPATCH();
+	LBC: opBC(s, opcode); DISPATCH();
+	LBD: opBD(s, opcode); DISPATCH();
+	LBE: opBE(s, opcode); DISPATCH();
+	LBF: opBF(s, opcode); DISPATCH();
+	LC0: opC0(s, opcode); DISPATCH();
+	LC1: opC1(s, opcode); DISPATCH();
+	LC2: opC2(s, opcode); DISPATCH();
+	LC3: opC3(s, opcode); DISPATCH();
+	LC4: opC4(s, opcode); DISPATCH();
+	LC5: opC5(s, opcode); DISPATCH();
+	LC6: opC6(s, opcode); DISPATCH();
+	LC7: opC7(s, opcode); DISPATCH();
+	LC8: opC8(s, opcode); DISPATCH();
+	LC9: opC9(s, opcode); DISPATCH();
+	LCA: opCA(s, opcode); DISPATCH();
+	LCB: opCB(s, opcode); DISPATCH();
+	LCC: opCC(s, opcode); DISPATCH();
+	LCD: opCD(s, opcode); DISPATCH();
+	LCE: opCE(s, opcode); DISPATCH();
+	LCF: opCF(s, opcode); DISPATCH();
+	LD0: opD0(s, opcode); DISPATCH();
+	LD1: opD1(s, opcode); DISPATCH();
+	LD2: opD2(s, opcode); DISPATCH();
+	LD3: opD3(s, opcode); DISPATCH();
+	LD4: opD4(s, opcode); DISPATCH();
+	LD5: opD5(s, opcode); DISPATCH();
+	LD6: opD6(s, opcode); DISPATCH();
+	LD7: opD7(s, opcode); DISPATCH();
+	LD8: opD8(s, opcode); DISPATCH();
+	LD9: opD9(s, opcode); DISPATCH();
+	LDA: opDA(s, opcode); DISPATCH();
+	LDB: opDB(s, opcode); DISPATCH();
+	LDC: opDC(s, opcode); DISPATCH();
+	LDD: opDD(s, opcode); DISPATCH();
+	LDE: opDE(s, opcode); DISPATCH();
+	LDF: opDF(s, opcode); DISPATCH();
+	LE0: opE0(s, opcode); DISPATCH();
+	LE1: opE1(s, opcode); DISPATCH();
+	LE2: opE2(s, opcode); DISPATCH();
+	LE3: opE3(s, opcode); DISPATCH();
+	LE4: opE4(s, opcode); DISPATCH();
+	LE5: opE5(s, opcode); DISPATCH();
+	LE6: opE6(s, opcode); DISPATCH();
+	LE7: opE7(s, opcode); DISPATCH();
+	LE8: opE8(s, opcode); DISPATCH();
+	LE9: opE9(s, opcode); DISPATCH();
+	LEA: opEA(s, opcode); DISPATCH();
+	LEB: opEB(s, opcode); DISPATCH();
+	LEC: opEC(s, opcode); DISPATCH();
+	LED: opED(s, opcode); DISPATCH();
+	LEE: opEE(s, opcode); DISPATCH();
+	LEF: opEF(s, opcode); DISPATCH();
+	LF0: opF0(s, opcode); DISPATCH();
+	LF1: opF1(s, opcode); DISPATCH();
+	LF2: opF2(s, opcode); DISPATCH();
+	LF3: opF3(s, opcode); DISPATCH();
+	LF4: opF4(s, opcode); DISPATCH();
+	LF5: opF5(s, opcode); DISPATCH();
+	LF6: opF6(s, opcode); DISPATCH();
+	LF7: opF7(s, opcode); DISPATCH();
+	LF8: opF8(s, opcode); DISPATCH();
+	LF9: opF9(s, opcode); DISPATCH();
+	LFA: opFA(s, opcode); DISPATCH();
+	LFB: opFB(s, opcode); s->eiDelay = count == 0; DISPATCH();
+	LFC: opFC(s, opcode); DISPATCH();
+	LFD: opFD(s, opcode); DISPATCH();
+	LFE: opFE(s, opcode); DISPATCH();
+	LFF: opFF(s, opcode); DISPATCH();
+#undef DISPATCH
+#else
+		for (; count > 0; count--) {
+			opcode = &s->memory[s->r.pc];
+			s->r.pc += instructionLength[*opcode];
+			s->eiDelay = 0;
+			instructionTable[*opcode](s, opcode);
+		}
+#endif
+	}
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <iomanip>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "trace.h"
+
+namespace Emu8080 {
+	void ringTrace::dump(std::ostream &out) const {
+		uint64_t first = count > entries.size() ? count - entries.size() : 0;
+		for (uint64_t i = first; i < count; i++) {
+			const traceEntry &t = entries[i & mask];
+			out << std::uppercase << std::hex << std::setfill('0')
+				<< std::setw(4) << t.pc << "  "
+				<< std::setw(2) << (int)t.opcode[0] << " "
+				<< std::setw(2) << (int)t.opcode[1] << " "
+				<< std::setw(2) << (int)t.opcode[2]
+				<< "  A:" << std::setw(2) << (int)t.a
+				<< " B:" << std::setw(2) << (int)t.b
+				<< " C:" << std::setw(2) << (int)t.c
+				<< " D:" << std::setw(2) << (int)t.d
+				<< " E:" << std::setw(2) << (int)t.e
+				<< " H:" << std::setw(2) << (int)t.h
+				<< " L:" << std::setw(2) << (int)t.l
+				<< " SP:" << std::setw(4) << t.sp
+				<< " Z:" << ((t.flags & FLAG_Z) != 0)
+				<< " S:" << ((t.flags & FLAG_S) != 0)
+				<< " P:" << ((t.flags & FLAG_P) != 0)
+				<< " CY:" << ((t.flags & FLAG_CY) != 0)
+				<< " AC:" << ((t.flags & FLAG_AC) != 0)
+				<< "\n";
+		}
+		out << std::dec;
+	}
+
+	// Where the entries are, oldest first: count from start, then the rest from the front of the ring
+	// Only reads fields, so the crash handler can call it
+	static void ringSpans(const ringTrace &trace, size_t &start, size_t &first, size_t &rest) {
+		size_t size = trace.entries.size();
+		size_t used = trace.count < size ? (size_t)trace.count : size;
+		start = trace.count < size ? 0 : (size_t)(trace.count & (size - 1));
+		first = std::min(used, size - start);
+		rest = used - first;
+	}
+
+	bool ringTrace::save(const std::string &path) const {
+		std::FILE *file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			return false;
+		}
+		size_t start, first, rest;
+		ringSpans(*this, start, first, rest);
+		bool ok = std::fwrite(&entries[start], sizeof(traceEntry), first, file) == first
+			&& std::fwrite(&entries[0], sizeof(traceEntry), rest, file) == rest;
+		return std::fclose(file) == 0 && ok;
+	}
+
+	bool ringTrace::load(const std::string &path) {
+		std::FILE *file = std::fopen(path.c_str(), "rb");
+		if (file == nullptr) {
+			return false;
+		}
+		std::vector<traceEntry> read;
+		traceEntry t;
+		while (std::fread(&t, sizeof(t), 1, file) == 1) {
+			read.push_back(t);
+		}
+		std::fclose(file);
+		size_t size = 1;
+		while (size < read.size()) {
+			size *= 2;
+		}
+		entries.assign(size, traceEntry());
+		std::copy(read.begin(), read.end(), entries.begin());
+		mask = size - 1;
+		count = read.size();
+		return true;
+	}
+
+	// Crash dump target, set by dumpOnCrash
+	// The handler only reads these and calls write, everything else isn't safe in a signal handler
+	static const ringTrace *crashTrace = nullptr;
+	static int crashFile = -1;
+
+	static void crashHandler(int signal) {
+		size_t start, first, rest;
+		ringSpans(*crashTrace, start, first, rest);
+#ifdef _WIN32
+		_write(crashFile, &crashTrace->entries[start], (unsigned)(first * sizeof(traceEntry)));
+		_write(crashFile, &crashTrace->entries[0], (unsigned)(rest * sizeof(traceEntry)));
+		_close(crashFile);
+#else
+		ssize_t ignored = write(crashFile, &crashTrace->entries[start], first * sizeof(traceEntry));
+		ignored = write(crashFile, &crashTrace->entries[0], rest * sizeof(traceEntry));
+		(void)ignored;
+		close(crashFile);
+#endif
+		std::signal(signal, SIG_DFL);
+		std::raise(signal);
+	}
+
+	bool dumpOnCrash(const ringTrace *trace, const std::string &path) {
+#ifdef _WIN32
+		int file = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		int file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+		if (file < 0) {
+			return false;
+		}
+		if (crashFile >= 0) {
+#ifdef _WIN32
+			_close(crashFile);
+#else
+			close(crashFile);
+#endif
+		}
+		crashTrace = trace;
+		crashFile = file;
+		std::signal(SIGSEGV, crashHandler);
+		std::signal(SIGABRT, crashHandler);
+		std::signal(SIGFPE, crashHandler);
+		std::signal(SIGILL, crashHandler);
+		return true;
+	}
+}
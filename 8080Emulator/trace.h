@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "cpu.h"
+#include "emulator.h"
+#include "instructions.h"
+
+namespace Emu8080 {
+	// Trace policies for runTraced
+	// record is called before each instruction executes, with PC still on it
+	// stackMoved is called after an instruction that moved SP, a taken call, return or restart as well as PUSH, POP
+	// and the like, with the cycles runTraced has run so far
+	// resume is called each time runTraced starts, the host may have changed the state since it returned,
+	// and stop each time it returns
+
+	// No tracing, record compiles away
+	class noTrace {
+	public:
+		void record(state *s, const uint8_t *opcode) {}
+		void stackMoved(state *s, uint8_t op, uint64_t cycles) {}
+		void resume(state *s) {}
+		void stop(state *s, const runResult &result) {}
+	};
+
+	// Full text, the whole state through printState before every instruction
+	class textTrace {
+	public:
+		void record(state *s, const uint8_t *opcode) {
+			printState(s, opcode[0], (opcode[2] << 8) | opcode[1]);
+		}
+		void stackMoved(state *s, uint8_t op, uint64_t cycles) {}
+		void resume(state *s) {}
+		void stop(state *s, const runResult &result) {}
+	};
+
+	// One instruction in a ringTrace
+	class traceEntry {
+	public:
+		uint16_t pc;
+		uint16_t sp;
+		uint8_t opcode[3];
+		uint8_t a, b, c, d, e, h, l;
+		uint8_t flags; // PSW flag byte
+		uint8_t pad;
+	};
+
+	// Binary ring buffer holding the last entries.size() instructions
+	// Preallocated, recording is a handful of stores
+	class ringTrace {
+	public:
+		std::vector<traceEntry> entries;
+		uint64_t count = 0; // Instructions recorded, the newest is at (count - 1) % size
+
+		// size must be a power of two
+		ringTrace(size_t size = 4096) : entries(size), mask(size - 1) {}
+
+		void record(state *s, const uint8_t *opcode) {
+			traceEntry &t = entries[count++ & mask];
+			t.pc = s->r.pc;
+			t.sp = s->r.sp;
+			t.opcode[0] = opcode[0];
+			t.opcode[1] = opcode[1];
+			t.opcode[2] = opcode[2];
+			t.a = s->r.a;
+			t.b = s->r.b;
+			t.c = s->r.c;
+			t.d = s->r.d;
+			t.e = s->r.e;
+			t.h = s->r.h;
+			t.l = s->r.l;
+			t.flags = flags(s);
+			t.pad = 0;
+		}
+		void stackMoved(state *s, uint8_t op, uint64_t cycles) {}
+		void resume(state *s) {}
+		void stop(state *s, const runResult &result) {}
+
+		// Print the recorded instructions, oldest first
+		void dump(std::ostream &out) const;
+		// Write the raw entries, oldest first, returns false if the file couldn't be written
+		bool save(const std::string &path) const;
+		// Read entries written by save or a crash dump, the ring grows to hold them all
+		bool load(const std::string &path);
+
+	private:
+		size_t mask;
+	};
+
+	// Write the raw entries of trace to path if the process crashes, in the format of ringTrace::save
+	// path is opened here and stays empty unless it crashes, the last call wins
+	// Returns false if path couldn't be opened
+	bool dumpOnCrash(const ringTrace *trace, const std::string &path);
+
+	// Execute instructions until the cycle budget runs out or a stop condition fires, recording each one to trace
+	template <class tracePolicy>
+	runResult runTraced(state *s, uint64_t cycleBudget, tracePolicy &trace) {
+		runResult result;
+		if (s->halted) {
+			result.reason = STOP_HALT;
+			return result;
+		}
+		trace.resume(s);
+		bool breakpoints = !s->breakpoints.empty();
+		while (result.cycles < cycleBudget) {
+			uint8_t *opcode = &s->memory[s->r.pc];
+			uint8_t op = *opcode;
+			trace.record(s, opcode);
+			s->eiDelay = 0; // Any instruction ends the delay of an EI before it
+			switch (op) {
+			case 0x76: // HLT
+				s->r.pc += 1;
+				op76(s, opcode);
+				result.cycles += instructionCycles[op];
+				result.instructions++;
+				result.reason = STOP_HALT;
+				trace.stop(s, result);
+				return result;
+			case 0xD3: // OUT D8, a device on the port takes it without stopping
+				s->port = opcode[1];
+				s->r.pc += 2;
+				result.cycles += instructionCycles[op];
+				result.instructions++;
+				if (s->ports != nullptr && s->ports->writers[s->port] != nullptr) {
+					s->ports->writers[s->port](s, s->port, s->r.a, s->ports->writerContexts[s->port]);
+					break;
+				}
+				result.reason = STOP_IO;
+				trace.stop(s, result);
+				return result;
+			case 0xDB: // IN D8
+				s->port = opcode[1];
+				s->r.pc += 2;
+				result.cycles += instructionCycles[op];
+				result.instructions++;
+				if (s->ports != nullptr && s->ports->readers[s->port] != nullptr) {
+					s->r.a = s->ports->readers[s->port](s, s->port, s->ports->readerContexts[s->port]);
+					break;
+				}
+				result.reason = STOP_IO;
+				result.input = true;
+				trace.stop(s, result);
+				return result;
+			default: {
+				uint16_t next = s->r.pc + instructionLength[op];
+				uint16_t sp = s->r.sp;
+				s->r.pc = next;
+				instructionTable[op](s, opcode);
+				result.cycles += instructionCycles[op];
+				result.instructions++;
+				// A taken call or return moves SP, even when it lands on the next instruction
+				if (s->r.pc != next || s->r.sp != sp) {
+					result.cycles += branchCycles[op];
+					if (s->r.sp != sp) {
+						trace.stackMoved(s, op, result.cycles);
+					}
+				}
+			}
+			}
+			if (breakpoints && s->breakpoints[s->r.pc]) {
+				result.reason = STOP_BREAKPOINT;
+				trace.stop(s, result);
+				return result;
+			}
+		}
+		trace.stop(s, result);
+		return result;
+	}
+}
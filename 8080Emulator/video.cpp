@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <cstring>
+#include "video.h"
+
+namespace Emu8080 {
+	// Transpose an 8x8 bit matrix held one row per byte, bit c of byte r moves to bit r of byte c
+	// Three rounds of swaps inside one register rather than 64 single bit moves
+	static uint64_t transpose8(uint64_t x) {
+		uint64_t t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+		x ^= t ^ (t << 7);
+		t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+		x ^= t ^ (t << 14);
+		t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+		x ^= t ^ (t << 28);
+		return x;
+	}
+
+	invadersVideo::invadersVideo(videoFormat format, uint32_t on, uint32_t off) : format(format) {
+		bytesPerPixel = format == VIDEO_RGBA ? 4 : 1;
+		pixels.assign((size_t)VIDEO_WIDTH * VIDEO_HEIGHT * bytesPerPixel, 0);
+		for (int v = 0; v < 256; v++) {
+			for (int bit = 0; bit < 8; bit++) {
+				uint32_t colour = (v >> bit) & 1 ? on : off;
+				for (int i = 0; i < bytesPerPixel; i++) {
+					expand[v][bit * bytesPerPixel + i] = (uint8_t)(colour >> (24 - 8 * i));
+				}
+			}
+		}
+	}
+
+	void invadersVideo::convertPage(const uint8_t *page, int column) {
+		size_t run = 8 * bytesPerPixel;
+		for (int k = 0; k < 32; k++) {
+			// Byte k of each of the 8 lines, then one byte of 8 screen bits per bit of k
+			uint64_t x = 0;
+			for (int line = 0; line < 8; line++) {
+				x |= (uint64_t)page[line * 32 + k] << (8 * line);
+			}
+			x = transpose8(x);
+			for (int bit = 0; bit < 8; bit++) {
+				int y = VIDEO_HEIGHT - 1 - (k * 8 + bit);
+				std::memcpy(&pixels[((size_t)y * VIDEO_WIDTH + column) * bytesPerPixel], expand[(x >> (8 * bit)) & 0xFF], run);
+			}
+		}
+	}
+
+	void invadersVideo::update(state *s, bool all) {
+		all = all || !started;
+		started = true;
+		for (int page = VIDEO_RAM >> 8; page < 0x40; page++) {
+			if (all || s->writtenPages[page]) {
+				s->writtenPages[page] = 0;
+				s->pageFlags[page] |= PAGE_WATCH;
+				convertPage(&s->memory[page << 8], (page - (VIDEO_RAM >> 8)) * 8);
+				converted += 8;
+			}
+		}
+		frames++;
+	}
+
+	bool invadersVideo::savePnm(const std::string &path) const {
+		std::FILE *file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			return false;
+		}
+		bool ok = std::fprintf(file, "%s\n%d %d\n255\n", format == VIDEO_RGBA ? "P6" : "P5", VIDEO_WIDTH, VIDEO_HEIGHT) > 0;
+		if (format == VIDEO_RGBA) {
+			// PPM has no alpha
+			std::vector<uint8_t> rgb((size_t)VIDEO_WIDTH * VIDEO_HEIGHT * 3);
+			for (size_t i = 0; i < (size_t)VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
+				std::memcpy(&rgb[i * 3], &pixels[i * 4], 3);
+			}
+			ok = ok && std::fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+		} else {
+			ok = ok && std::fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+		}
+		return std::fclose(file) == 0 && ok;
+	}
+
+	bool invadersVideo::saveRaw(const std::string &path) const {
+		std::FILE *file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			return false;
+		}
+		bool ok = std::fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+		return std::fclose(file) == 0 && ok;
+	}
+}
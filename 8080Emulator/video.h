@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cpu.h"
+
+namespace Emu8080 {
+	// Space Invaders screen, 256x224 at one bit per pixel, stored as 224 lines of 32 bytes from VIDEO_RAM
+	// The monitor is turned a quarter turn anticlockwise, so each line is a screen column read bottom to top
+	constexpr uint16_t VIDEO_RAM = 0x2400;
+	constexpr int VIDEO_WIDTH = 224;
+	constexpr int VIDEO_HEIGHT = 256;
+
+	enum videoFormat {
+		VIDEO_RGBA, // 4 bytes per pixel, R G B A
+		VIDEO_GRAY // 1 byte per pixel
+	};
+
+	// Converts video RAM to an upright frame, row major from the top left
+	// The pages of video RAM are watched, so each update only converts the columns under pages written since the last one
+	class invadersVideo {
+	public:
+		videoFormat format;
+		std::vector<uint8_t> pixels; // VIDEO_WIDTH * VIDEO_HEIGHT pixels
+		uint64_t frames = 0; // Updates
+		uint64_t converted = 0; // Screen columns converted
+
+		// on and off are the lit and dark pixel colours as 0xRRGGBBAA, gray uses their R byte
+		invadersVideo(videoFormat format = VIDEO_RGBA, uint32_t on = 0xFFFFFFFF, uint32_t off = 0x000000FF);
+
+		// Convert what changed in s since the last update, or all of it when all is set or on the first update
+		void update(state *s, bool all = false);
+		// Write the frame as a binary PPM, or a PGM when gray, returns false if the file couldn't be written
+		bool savePnm(const std::string &path) const;
+		// Write the pixels as they are
+		bool saveRaw(const std::string &path) const;
+
+	private:
+		int bytesPerPixel;
+		// Pixels of a byte of 8 horizontal screen bits, lowest bit leftmost
+		uint8_t expand[256][32];
+		bool started = false;
+
+		// Convert the 8 screen columns held in one page of video RAM
+		void convertPage(const uint8_t *page, int column);
+	};
+}